@@ -0,0 +1,44 @@
+#
+# Copyright (c) 2019 Carnegie Mellon University,
+# Copyright (c) 2019 Triad National Security, LLC, as operator of
+#     Los Alamos National Laboratory.
+#
+# All rights reserved.
+#
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file. See the AUTHORS file for names of contributors.
+#
+
+#
+# find lz4 library and set up an imported target for it since
+# lz4 doesn't provide this for us...
+#
+
+# 
+# inputs:
+#   - LZ4_INCLUDE_DIR: hint for finding lz4.h
+#   - LZ4_LIBRARY_DIR: hint for finding lz4 lib
+#
+# output:
+#   - "lz4" library target 
+#   - LZ4_FOUND  (set if found)
+#
+
+include (FindPackageHandleStandardArgs)
+
+find_path (LZ4_INCLUDE lz4.h HINTS ${LZ4_INCLUDE_DIR})
+find_library (LZ4_LIBRARY lz4 HINTS ${LZ4_LIBRARY_DIR})
+
+find_package_handle_standard_args (Lz4 DEFAULT_MSG 
+    LZ4_INCLUDE LZ4_LIBRARY)
+
+mark_as_advanced (LZ4_INCLUDE LZ4_LIBRARY)
+
+if (LZ4_FOUND AND NOT TARGET lz4)
+    add_library (lz4 UNKNOWN IMPORTED)
+    set_target_properties (lz4 PROPERTIES
+        INTERFACE_INCLUDE_DIRECTORIES "${LZ4_INCLUDE}")
+    set_property (TARGET lz4 APPEND PROPERTY
+        IMPORTED_LOCATION "${LZ4_LIBRARY}")
+endif ()
+
@@ -0,0 +1,44 @@
+#
+# Copyright (c) 2019 Carnegie Mellon University,
+# Copyright (c) 2019 Triad National Security, LLC, as operator of
+#     Los Alamos National Laboratory.
+#
+# All rights reserved.
+#
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file. See the AUTHORS file for names of contributors.
+#
+
+#
+# find zstd library and set up an imported target for it since
+# zstd doesn't provide this for us...
+#
+
+# 
+# inputs:
+#   - ZSTD_INCLUDE_DIR: hint for finding zstd.h
+#   - ZSTD_LIBRARY_DIR: hint for finding zstd lib
+#
+# output:
+#   - "zstd" library target 
+#   - ZSTD_FOUND  (set if found)
+#
+
+include (FindPackageHandleStandardArgs)
+
+find_path (ZSTD_INCLUDE zstd.h HINTS ${ZSTD_INCLUDE_DIR})
+find_library (ZSTD_LIBRARY zstd HINTS ${ZSTD_LIBRARY_DIR})
+
+find_package_handle_standard_args (Zstd DEFAULT_MSG 
+    ZSTD_INCLUDE ZSTD_LIBRARY)
+
+mark_as_advanced (ZSTD_INCLUDE ZSTD_LIBRARY)
+
+if (ZSTD_FOUND AND NOT TARGET zstd)
+    add_library (zstd UNKNOWN IMPORTED)
+    set_target_properties (zstd PROPERTIES
+        INTERFACE_INCLUDE_DIRECTORIES "${ZSTD_INCLUDE}")
+    set_property (TARGET zstd APPEND PROPERTY
+        IMPORTED_LOCATION "${ZSTD_LIBRARY}")
+endif ()
+
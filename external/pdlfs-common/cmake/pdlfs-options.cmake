@@ -44,9 +44,15 @@ include (xpkg-import)
 #   -DPDLFS_RADOS=ON                       -- compile in RADOS env
 #     - RADOS_INCLUDE_DIR: optional hint for finding rado/librados.h
 #     - RADOS_LIBRARY_DIR: optional hint for finding rados lib
+#   -DPDLFS_LZ4=ON                         -- compile in lz4 compression
+#     - LZ4_INCLUDE_DIR: optional hint for finding lz4.h
+#     - LZ4_LIBRARY_DIR: optional hint for finding lz4 lib
 #   -DPDLFS_SNAPPY=ON                      -- compile in snappy compression
 #     - SNAPPY_INCLUDE_DIR: optional hint for finding snappy.h
 #     - SNAPPY_LIBRARY_DIR: optional hint for finding snappy lib
+#   -DPDLFS_ZSTD=ON                        -- compile in zstd compression
+#     - ZSTD_INCLUDE_DIR: optional hint for finding zstd.h
+#     - ZSTD_LIBRARY_DIR: optional hint for finding zstd lib
 #   -DPDLFS_VERBOSE=1                      -- set max log verbose level
 #
 # output variables:
@@ -118,7 +124,9 @@ set (PDLFS_GLOG        "OFF" CACHE BOOL "Use GLOG for logging")
 set (PDLFS_MARGO_RPC   "OFF" CACHE BOOL "Use Margo RPC")
 set (PDLFS_MERCURY_RPC "OFF" CACHE BOOL "Use Mercury RPC")
 set (PDLFS_RADOS       "OFF" CACHE BOOL "Use RADOS OSD")
+set (PDLFS_LZ4         "OFF" CACHE BOOL "Use LZ4 for compression")
 set (PDLFS_SNAPPY      "OFF" CACHE BOOL "Use Snappy for compression")
+set (PDLFS_ZSTD        "OFF" CACHE BOOL "Use Zstd for compression")
 
 #
 # now start pulling the parts in.  currently we set find_package to
@@ -164,3 +172,15 @@ if (PDLFS_SNAPPY)
     list (APPEND PDLFS_COMPONENT_CFG "Snappy")
     message (STATUS "Enabled Snappy - PDLFS_SNAPPY=ON")
 endif ()
+
+if (PDLFS_LZ4)
+    find_package(Lz4 MODULE REQUIRED)
+    list (APPEND PDLFS_COMPONENT_CFG "Lz4")
+    message (STATUS "Enabled LZ4 - PDLFS_LZ4=ON")
+endif ()
+
+if (PDLFS_ZSTD)
+    find_package(Zstd MODULE REQUIRED)
+    list (APPEND PDLFS_COMPONENT_CFG "Zstd")
+    message (STATUS "Enabled Zstd - PDLFS_ZSTD=ON")
+endif ()
@@ -67,6 +67,17 @@ class Env {
   // Result of this call belongs to the caller and should be deleted after use.
   static Env* NewMmapIoEnvWrapper(Env* base);
 
+  // Return a new Env wrapper object performing random reads (as defined in
+  // RandomAccessFile) and sequential writes (as defined in WritableFile)
+  // through Linux io_uring. Batches of random reads issued via
+  // RandomAccessFile::ReadMulti() are submitted to the kernel at once. All
+  // other operations are forwarded to base. Options are specified through
+  // conf as a comma-separated list of key=value pairs (e.g.,
+  // "queue_depth=64,num_rings=4,write_buffer=1MB"). Return NULL if io_uring
+  // is not supported by the build or the running kernel. Result of this call
+  // belongs to the caller and should be deleted after use.
+  static Env* NewIoUringEnvWrapper(Env* base, const char* conf);
+
   // Return an Env implementation that performs sequential io using standard os
   // io calls such as open(), read(), write(), lseek(), fsync(), and
   // close(), and random reads using pread(). Result of this call belongs to the
@@ -246,6 +257,24 @@ class RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // A single read within a batch of reads.
+  struct ReadRequest {
+    uint64_t offset;
+    size_t n;
+    char* scratch;  // Must hold at least n bytes
+    Slice result;   // Set by ReadMulti()
+    Status status;  // Set by ReadMulti()
+  };
+
+  // Perform a batch of reads, storing the result and the status of each read
+  // in its request. Implementations may issue all reads at once and complete
+  // them in any order. The default implementation calls Read() for each
+  // request in turn. Return OK if all reads succeeded, or the status of the
+  // first failed read otherwise.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status ReadMulti(ReadRequest* reqs, size_t n) const;
+
  private:
   // No copying allowed
   RandomAccessFile(const RandomAccessFile&);
@@ -355,6 +355,17 @@ class MonitoredRandomAccessFile : public RandomAccessFile {
     return status;
   }
 
+  // Implementation is safe for concurrent use by multiple threads.
+  virtual Status ReadMulti(ReadRequest* reqs, size_t n) const {
+    Status status = base_->ReadMulti(reqs, n);
+    for (size_t i = 0; i < n; i++) {
+      if (reqs[i].status.ok()) {
+        stats_->AcceptRead(reqs[i].result.size());
+      }
+    }
+    return status;
+  }
+
  private:
   // Reset the counters and the base target.
   void Reset(RandomAccessFile* base) {
@@ -57,8 +57,11 @@ class AbstractBlockBuilder {
   // Finish building the block and return a slice that refers to the
   // block contents.  The returned slice will remain valid for the
   // lifetime of this builder or until Reset() or Finalize() is called.
+  // "compression_level" and "compression_dict" are only used by
+  // compression algorithms that support them (currently zstd).
   Slice Finish(CompressionType compression = kNoCompression,
-               bool force_compression = false);
+               bool force_compression = false, int compression_level = 0,
+               const Slice& compression_dict = Slice());
 
   // Reserve a certain amount of buffer space.
   void Reserve(size_t size) { buffer_.reserve(buffer_start_ + size); }
@@ -117,7 +120,8 @@ class BlockBuilder : public AbstractBlockBuilder {
   // block contents.  The returned slice will remain valid for the
   // lifetime of this builder or until Reset() or Finalize() is called.
   Slice Finish(CompressionType compression = kNoCompression,
-               bool force_compression = false);
+               bool force_compression = false, int compression_level = 0,
+               const Slice& compression_dict = Slice());
 
   // Returns an estimate of the current (uncompressed) size of the block
   // we are building.
@@ -150,8 +150,20 @@ struct DBOptions {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  //
+  // kZstdCompression typically gives a much higher compression ratio at
+  // a lower speed, while kLz4Compression typically decompresses faster
+  // than kSnappyCompression. Both must be compiled in (PDLFS_ZSTD and
+  // PDLFS_LZ4); otherwise blocks are stored uncompressed.
   CompressionType compression;
 
+  // Compression level for compression algorithms that support levels
+  // (currently kZstdCompression only). Set to 0 to use the algorithm's
+  // default level.
+  //
+  // Default: 0
+  int compression_level;
+
   // If non-NULL, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
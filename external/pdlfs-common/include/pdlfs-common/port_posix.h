@@ -61,6 +61,12 @@
 #ifdef PDLFS_SNAPPY
 #include <snappy.h>
 #endif
+#ifdef PDLFS_LZ4
+#include <lz4.h>
+#endif
+#ifdef PDLFS_ZSTD
+#include <zstd.h>
+#endif
 #include "pdlfs-common/atomic_pointer.h"  // Platform-specific atomic pointer
 
 #include <limits.h>
@@ -185,6 +191,118 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 #endif
 }
 
+// LZ4 blocks do not record their uncompressed length, so compressed
+// contents are prefixed with the uncompressed length as a 32-bit
+// little-endian integer.
+inline bool Lz4_Compress(const char* input, size_t length,
+                         ::std::string* output) {
+#ifdef PDLFS_LZ4
+  if (length > LZ4_MAX_INPUT_SIZE) return false;
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(4 + static_cast<size_t>(bound));
+  char* const dst = &(*output)[0];
+  const uint32_t n = static_cast<uint32_t>(length);
+  dst[0] = static_cast<char>(n & 0xff);
+  dst[1] = static_cast<char>((n >> 8) & 0xff);
+  dst[2] = static_cast<char>((n >> 16) & 0xff);
+  dst[3] = static_cast<char>((n >> 24) & 0xff);
+  const int outlen =
+      LZ4_compress_default(input, dst + 4, static_cast<int>(length), bound);
+  if (outlen <= 0) return false;
+  output->resize(4 + static_cast<size_t>(outlen));
+  return true;
+#endif
+
+  return false;
+}
+
+inline bool Lz4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result) {
+#ifdef PDLFS_LZ4
+  if (length < 4) return false;
+  const unsigned char* const p = reinterpret_cast<const unsigned char*>(input);
+  *result = static_cast<size_t>(p[0]) | (static_cast<size_t>(p[1]) << 8) |
+            (static_cast<size_t>(p[2]) << 16) |
+            (static_cast<size_t>(p[3]) << 24);
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline bool Lz4_Uncompress(const char* input, size_t length, char* output) {
+#ifdef PDLFS_LZ4
+  size_t ulength;
+  if (!Lz4_GetUncompressedLength(input, length, &ulength)) return false;
+  const int outlen =
+      LZ4_decompress_safe(input + 4, output, static_cast<int>(length - 4),
+                          static_cast<int>(ulength));
+  return outlen >= 0 && static_cast<size_t>(outlen) == ulength;
+#else
+  return false;
+#endif
+}
+
+// A level of 0 selects zstd's default compression level. If dict_length is
+// not 0, the same dictionary must be used to uncompress the contents.
+inline bool Zstd_Compress(int level, const char* dict, size_t dict_length,
+                          const char* input, size_t length,
+                          ::std::string* output) {
+#ifdef PDLFS_ZSTD
+  output->resize(ZSTD_compressBound(length));
+  size_t outlen;
+  if (dict_length != 0) {
+    ZSTD_CCtx* const ctx = ZSTD_createCCtx();
+    if (ctx == NULL) return false;
+    outlen = ZSTD_compress_usingDict(ctx, &(*output)[0], output->size(), input,
+                                     length, dict, dict_length, level);
+    ZSTD_freeCCtx(ctx);
+  } else {
+    outlen = ZSTD_compress(&(*output)[0], output->size(), input, length, level);
+  }
+  if (ZSTD_isError(outlen)) return false;
+  output->resize(outlen);
+  return true;
+#endif
+
+  return false;
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#ifdef PDLFS_ZSTD
+  const unsigned long long n = ZSTD_getFrameContentSize(input, length);
+  if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = static_cast<size_t>(n);
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline bool Zstd_Uncompress(const char* dict, size_t dict_length,
+                            const char* input, size_t length, char* output) {
+#ifdef PDLFS_ZSTD
+  size_t ulength;
+  if (!Zstd_GetUncompressedLength(input, length, &ulength)) return false;
+  size_t outlen;
+  if (dict_length != 0) {
+    ZSTD_DCtx* const ctx = ZSTD_createDCtx();
+    if (ctx == NULL) return false;
+    outlen = ZSTD_decompress_usingDict(ctx, output, ulength, input, length,
+                                       dict, dict_length);
+    ZSTD_freeDCtx(ctx);
+  } else {
+    outlen = ZSTD_decompress(output, ulength, input, length);
+  }
+  return !ZSTD_isError(outlen) && outlen == ulength;
+#else
+  return false;
+#endif
+}
+
 inline bool GetHeapProfile(void (*)(void*, const char*, int), void*) {
   return false;
 }
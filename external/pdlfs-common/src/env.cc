@@ -42,6 +42,18 @@ SequentialFile::~SequentialFile() {}
 
 RandomAccessFile::~RandomAccessFile() {}
 
+Status RandomAccessFile::ReadMulti(ReadRequest* reqs, size_t n) const {
+  Status status;
+  for (size_t i = 0; i < n; i++) {
+    ReadRequest* const r = &reqs[i];
+    r->status = Read(r->offset, r->n, &r->result, r->scratch);
+    if (status.ok() && !r->status.ok()) {
+      status = r->status;
+    }
+  }
+  return status;
+}
+
 WritableFile::~WritableFile() {}
 
 WritableFileWrapper::~WritableFileWrapper() {}
@@ -72,6 +84,15 @@ Env* Env::Open(const char* name, const char* conf, bool* is_system) {
     *is_system = true;
     return Env::GetUnBufferedIoEnv();
   }
+  if (env_name == "iouring") {
+    Env* env = Env::NewIoUringEnvWrapper(Env::Default(), conf);
+    if (env != NULL) {
+      return env;
+    }
+    fprintf(stderr, "Warning: io_uring not available, using default env...\n");
+    *is_system = true;
+    return Env::Default();
+  }
   if (env_name.empty())
     fprintf(stderr, "Warning: open env without specifying a name...\n");
   if (env_name.empty() || env_name == "default") {
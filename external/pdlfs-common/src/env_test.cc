@@ -18,6 +18,9 @@
 #include "pdlfs-common/port.h"
 #include "pdlfs-common/testharness.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace pdlfs {
 
 static const int kDelayMicros = 100000;
@@ -108,6 +111,68 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+static std::string TestData(size_t n) {
+  std::string data;
+  data.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    data.push_back(static_cast<char>('a' + (i * 7 + i / 13) % 26));
+  }
+  return data;
+}
+
+TEST(EnvPosixTest, IoUring) {
+  bool is_system;
+  // Small buffers and queues to exercise buffer rotation and batching
+  Env* const env =
+      Env::Open("iouring", "queue_depth=8,num_rings=1,write_buffer=4KB",
+                &is_system);
+  ASSERT_TRUE(env != NULL);
+  std::string dir;
+  ASSERT_OK(env->GetTestDirectory(&dir));
+  const std::string fname = dir + "/iouring";
+  const std::string data = TestData(100 << 10);
+  WritableFile* wf;
+  ASSERT_OK(env->NewWritableFile(fname.c_str(), &wf));
+  for (size_t off = 0; off < data.size(); off += 1000) {
+    const size_t n = std::min<size_t>(1000, data.size() - off);
+    ASSERT_OK(wf->Append(Slice(data.data() + off, n)));
+  }
+  ASSERT_OK(wf->Sync());
+  ASSERT_OK(wf->Close());
+  delete wf;
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize(fname.c_str(), &size));
+  ASSERT_EQ(size, data.size());
+
+  RandomAccessFile* rf;
+  ASSERT_OK(env->NewRandomAccessFile(fname.c_str(), &rf));
+  char tmp[100];
+  Slice result;
+  ASSERT_OK(rf->Read(12345, sizeof(tmp), &result, tmp));
+  ASSERT_EQ(result, Slice(data.data() + 12345, sizeof(tmp)));
+  // Reads crossing the end of the file are short
+  ASSERT_OK(rf->Read(data.size() - 10, sizeof(tmp), &result, tmp));
+  ASSERT_EQ(result, Slice(data.data() + data.size() - 10, 10));
+  const size_t num_reqs = 50;
+  std::vector<RandomAccessFile::ReadRequest> reqs(num_reqs);
+  std::string buf(num_reqs * 512, 0);
+  for (size_t i = 0; i < num_reqs; i++) {
+    reqs[i].offset = (i * 7919) % (data.size() - 512);
+    reqs[i].n = 512;
+    reqs[i].scratch = &buf[i * 512];
+  }
+  ASSERT_OK(rf->ReadMulti(&reqs[0], num_reqs));
+  for (size_t i = 0; i < num_reqs; i++) {
+    ASSERT_OK(reqs[i].status);
+    ASSERT_EQ(reqs[i].result, Slice(data.data() + reqs[i].offset, 512));
+  }
+  delete rf;
+  ASSERT_OK(env->DeleteFile(fname.c_str()));
+  if (!is_system) {
+    delete env;
+  }
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
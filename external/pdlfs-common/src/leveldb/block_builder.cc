@@ -92,10 +92,12 @@ void AbstractBlockBuilder::TEST_Pad(size_t n) {
 
 void AbstractBlockBuilder::Reset() {
   buffer_.resize(buffer_start_);
+  compression_ = kNoCompression;
   finished_ = false;
 }
 
-Slice AbstractBlockBuilder::Finish(CompressionType compression, bool force) {
+Slice AbstractBlockBuilder::Finish(CompressionType compression, bool force,
+                                   int level, const Slice& dict) {
   assert(!finished_);
   finished_ = true;
   Slice contents = buffer_;
@@ -116,6 +118,21 @@ Slice AbstractBlockBuilder::Finish(CompressionType compression, bool force) {
         compressed.clear();
       }
       break;
+    case kZstdCompression:
+      if (!port::Zstd_Compress(level, dict.data(), dict.size(),
+                               contents.data(), sz, &compressed) ||
+          (compressed.size() >= (sz - sz / 8u) && !force)) {
+        compression = kNoCompression;
+        compressed.clear();
+      }
+      break;
+    case kLz4Compression:
+      if (!port::Lz4_Compress(contents.data(), sz, &compressed) ||
+          (compressed.size() >= (sz - sz / 8u) && !force)) {
+        compression = kNoCompression;
+        compressed.clear();
+      }
+      break;
   }
 
   if (!compressed.empty()) {
@@ -148,7 +165,8 @@ size_t BlockBuilder::CurrentSizeEstimate() const {
 }
 
 Slice BlockBuilder::Finish(CompressionType compression,
-                           bool force_compression) {
+                           bool force_compression, int compression_level,
+                           const Slice& compression_dict) {
   assert(!finished_);
   // Append restart array
   for (size_t i = 0; i < restarts_.size(); i++) {
@@ -157,7 +175,8 @@ Slice BlockBuilder::Finish(CompressionType compression,
   uint32_t num_restarts = static_cast<uint32_t>(restarts_.size());
   // Remember the array size
   PutFixed32(&buffer_, num_restarts);
-  return AbstractBlockBuilder::Finish(compression, force_compression);
+  return AbstractBlockBuilder::Finish(compression, force_compression,
+                                      compression_level, compression_dict);
 }
 
 Slice AbstractBlockBuilder::Finalize(bool crc32c, uint32_t padding_target,
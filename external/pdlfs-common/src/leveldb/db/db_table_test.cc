@@ -851,6 +851,67 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Write a table using the given compression type and read it back.
+// Return false if the compression type is not compiled in.
+static bool CheckCompressedTable(CompressionType type, int level) {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  if (type == kZstdCompression) {
+    if (!port::Zstd_Compress(level, NULL, 0, in.data(), in.size(), &out)) {
+      return false;
+    }
+  } else if (type == kLz4Compression) {
+    if (!port::Lz4_Compress(in.data(), in.size(), &out)) {
+      return false;
+    }
+  }
+
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  std::string tmp;
+  char key[20];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    c.Add(key, test::CompressibleString(&rnd, 0.25, 1000, &tmp));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  DBOptions options;
+  options.block_size = 1024;
+  options.compression = type;
+  options.compression_level = level;
+  c.Finish(options, &keys, &kvmap);
+
+  // All blocks should have been compressed
+  const uint64_t size = c.ApproximateOffsetOf("xyz");
+  ASSERT_TRUE(Between(size, 0, 100 * 1000 / 2));
+  Iterator* iter = c.NewIterator();
+  KVMap::const_iterator it = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(it != kvmap.end());
+    ASSERT_EQ(iter->key().ToString(), it->first);
+    ASSERT_EQ(iter->value().ToString(), it->second);
+    ++it;
+  }
+  ASSERT_TRUE(it == kvmap.end());
+  ASSERT_OK(iter->status());
+  delete iter;
+  return true;
+}
+
+TEST(TableTest, ZstdCompressed) {
+  if (!CheckCompressedTable(kZstdCompression, 0) ||
+      !CheckCompressedTable(kZstdCompression, 19)) {
+    fprintf(stderr, "skipping zstd compression tests\n");
+  }
+}
+
+TEST(TableTest, Lz4Compressed) {
+  if (!CheckCompressedTable(kLz4Compression, 0)) {
+    fprintf(stderr, "skipping lz4 compression tests\n");
+  }
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
@@ -41,6 +41,7 @@ DBOptions::DBOptions()
       block_restart_interval(16),
       index_block_restart_interval(1),
       compression(kSnappyCompression),
+      compression_level(0),
       filter_policy(NULL),
       no_memtable(false),
       gc_skip_deletion(false),
@@ -211,6 +211,35 @@ void TableBuilder::WriteBlock(const Slice& block_contents,
       }
       break;
     }
+
+    case kZstdCompression: {
+      std::string* compressed = &r->compressed_output;
+      if (port::Zstd_Compress(r->options.compression_level, NULL, 0,
+                              block_contents.data(), block_contents.size(),
+                              compressed) &&
+          compressed->size() <
+              block_contents.size() - (block_contents.size() / 8u)) {
+        raw_block_contents = *compressed;
+      } else {
+        raw_block_contents = block_contents;
+        type = kNoCompression;
+      }
+      break;
+    }
+
+    case kLz4Compression: {
+      std::string* compressed = &r->compressed_output;
+      if (port::Lz4_Compress(block_contents.data(), block_contents.size(),
+                             compressed) &&
+          compressed->size() <
+              block_contents.size() - (block_contents.size() / 8u)) {
+        raw_block_contents = *compressed;
+      } else {
+        raw_block_contents = block_contents;
+        type = kNoCompression;
+      }
+      break;
+    }
   }
   WriteRawBlock(raw_block_contents, type, handle);
   r->compressed_output.clear();
@@ -0,0 +1,626 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "posix_io_uring.h"
+
+#include "pdlfs-common/strutil.h"
+
+#if defined(PDLFS_IO_URING)
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <vector>
+#endif
+
+#if __cplusplus >= 201103L
+#define OVERRIDE override
+#else
+#define OVERRIDE
+#endif
+
+namespace pdlfs {
+
+#if defined(PDLFS_IO_URING)
+namespace {
+
+int SysSetup(unsigned entries, struct io_uring_params* p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int SysEnter(int fd, unsigned to_submit, unsigned min_complete,
+             unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, NULL, 0));
+}
+
+int SysRegister(int fd, unsigned opcode, const void* arg, unsigned n) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, n));
+}
+
+unsigned LoadAcquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+IoUringOptions::IoUringOptions()
+    : queue_depth(64), num_rings(4), write_buffer(1 << 20) {}
+
+IoUring::IoUring()
+    : fd_(-1),
+      sq_ptr_(NULL),
+      sq_size_(0),
+      cq_ptr_(NULL),
+      cq_size_(0),
+      sqes_(NULL),
+      sqes_size_(0),
+      sq_head_(NULL),
+      sq_tail_(NULL),
+      sq_array_(NULL),
+      sq_mask_(0),
+      sq_entries_(0),
+      cq_head_(NULL),
+      cq_tail_(NULL),
+      cqes_(NULL),
+      cq_mask_(0),
+      sqe_tail_(0) {}
+
+IoUring::~IoUring() {
+  if (sqes_ != NULL) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ptr_ != NULL && cq_ptr_ != sq_ptr_) {
+    munmap(cq_ptr_, cq_size_);
+  }
+  if (sq_ptr_ != NULL) {
+    munmap(sq_ptr_, sq_size_);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+static void* MapRing(int fd, size_t size, off_t off) {
+  void* const ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, off);
+  return ptr != MAP_FAILED ? ptr : NULL;
+}
+
+Status IoUring::Open(unsigned entries) {
+  assert(fd_ == -1);
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  fd_ = SysSetup(entries, &p);
+  if (fd_ < 0) {
+    return PosixError("io_uring_setup", errno);
+  }
+  sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+  }
+  sq_ptr_ = MapRing(fd_, sq_size_, IORING_OFF_SQ_RING);
+  if (sq_ptr_ == NULL) {
+    return PosixError("io_uring_mmap", errno);
+  }
+  if (single_mmap) {
+    cq_ptr_ = sq_ptr_;
+  } else {
+    cq_ptr_ = MapRing(fd_, cq_size_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == NULL) {
+      return PosixError("io_uring_mmap", errno);
+    }
+  }
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = reinterpret_cast<struct io_uring_sqe*>(
+      MapRing(fd_, sqes_size_, IORING_OFF_SQES));
+  if (sqes_ == NULL) {
+    return PosixError("io_uring_mmap", errno);
+  }
+
+  char* const sq = reinterpret_cast<char*>(sq_ptr_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+  sq_entries_ = p.sq_entries;
+  char* const cq = reinterpret_cast<char*>(cq_ptr_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+  sqe_tail_ = *sq_tail_;
+  return Status::OK();
+}
+
+Status IoUring::RegisterBuffers(const struct iovec* iovs, unsigned n) {
+  if (SysRegister(fd_, IORING_REGISTER_BUFFERS, iovs, n) != 0) {
+    return PosixError("io_uring_register", errno);
+  } else {
+    return Status::OK();
+  }
+}
+
+struct io_uring_sqe* IoUring::GetSqe() {
+  if (sqe_tail_ - LoadAcquire(sq_head_) >= sq_entries_) {
+    return NULL;
+  }
+  const unsigned idx = sqe_tail_ & sq_mask_;
+  struct io_uring_sqe* const sqe = &sqes_[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[idx] = idx;
+  sqe_tail_++;
+  return sqe;
+}
+
+Status IoUring::Submit(unsigned min_complete) {
+  StoreRelease(sq_tail_, sqe_tail_);
+  unsigned to_submit = sqe_tail_ - LoadAcquire(sq_head_);
+  unsigned flags = min_complete != 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (true) {
+    const int r = SysEnter(fd_, to_submit, min_complete, flags);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return PosixError("io_uring_enter", errno);
+    } else if (static_cast<unsigned>(r) >= to_submit) {
+      return Status::OK();
+    } else if (r == 0) {
+      return Status::IOError("io_uring_enter", "Cannot submit");
+    }
+    // The kernel consumed part of the queue. Waiting has been done.
+    to_submit -= static_cast<unsigned>(r);
+    min_complete = 0;
+    flags = 0;
+  }
+}
+
+bool IoUring::Reap(uint64_t* user_data, int* res) {
+  const unsigned head = *cq_head_;
+  if (head == LoadAcquire(cq_tail_)) {
+    return false;
+  }
+  const struct io_uring_cqe* const cqe = &cqes_[head & cq_mask_];
+  *user_data = cqe->user_data;
+  *res = cqe->res;
+  StoreRelease(cq_head_, head + 1);
+  return true;
+}
+
+namespace {
+
+class IoUringEnv;
+
+// Random reads are submitted through one of the rings shared by all files of
+// an env. Reads are issued directly against the caller's buffers.
+class IoUringRandomAccessFile : public RandomAccessFile {
+ public:
+  IoUringRandomAccessFile(const char* fname, int fd, IoUringEnv* env)
+      : filename_(fname), fd_(fd), env_(env), base_(fname, fd) {}
+  virtual ~IoUringRandomAccessFile() {}  // fd_ is closed by base_
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const OVERRIDE {
+    ReadRequest req;
+    req.offset = offset;
+    req.n = n;
+    req.scratch = scratch;
+    Status status = ReadMulti(&req, 1);
+    *result = req.result;
+    return status;
+  }
+
+  virtual Status ReadMulti(ReadRequest* reqs, size_t n) const OVERRIDE;
+
+ private:
+  Status RingRead(IoUring* ring, ReadRequest* reqs, size_t n) const;
+  void Complete(ReadRequest* req, int res) const;
+
+  const std::string filename_;
+  const int fd_;
+  IoUringEnv* const env_;
+  PosixRandomAccessFile base_;
+};
+
+// Appends are copied into one of two registered buffers. A full buffer is
+// written out in the background using a fixed-buffer write while appends
+// continue into the other buffer. Each file owns a small ring.
+class IoUringWritableFile : public WritableFile {
+ public:
+  // We take ownership of the ring and the buffer memory.
+  IoUringWritableFile(const char* fname, int fd, IoUring* ring, char* mem,
+                      size_t buf_size)
+      : filename_(fname),
+        fd_(fd),
+        ring_(ring),
+        mem_(mem),
+        buf_size_(buf_size),
+        offset_(0),
+        cur_(0),
+        base_(fname, fd) {
+    for (int i = 0; i < 2; i++) {
+      len_[i] = 0;
+      pending_[i] = false;
+      off_[i] = 0;
+    }
+  }
+
+  virtual ~IoUringWritableFile() {
+    Flush();  // Ignoring any potential errors
+    delete ring_;
+    delete[] mem_;
+  }
+
+  virtual Status Append(const Slice& data) OVERRIDE {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left != 0 && status_.ok()) {
+      const size_t n = std::min(left, buf_size_ - len_[cur_]);
+      memcpy(mem_ + cur_ * buf_size_ + len_[cur_], p, n);
+      len_[cur_] += n;
+      p += n;
+      left -= n;
+      if (len_[cur_] == buf_size_) {
+        Rotate();
+      }
+    }
+    return status_;
+  }
+
+  virtual Status Flush() OVERRIDE {
+    if (len_[cur_] != 0 && status_.ok()) {
+      Rotate();
+    }
+    Wait(0);
+    Wait(1);
+    return status_;
+  }
+
+  virtual Status Sync() OVERRIDE {
+    Status s = Flush();
+    if (s.ok()) {
+      s = base_.Sync();
+    }
+    return s;
+  }
+
+  virtual Status Close() OVERRIDE {
+    Status s = Flush();
+    base_.Close();
+    return s;
+  }
+
+ private:
+  // Write out the current buffer and switch to the other buffer, waiting for
+  // its previous write to finish.
+  void Rotate() {
+    struct io_uring_sqe* const sqe = ring_->GetSqe();
+    assert(sqe != NULL);  // At most 2 writes outstanding
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd_;
+    sqe->off = offset_;
+    sqe->addr = reinterpret_cast<uintptr_t>(mem_ + cur_ * buf_size_);
+    sqe->len = static_cast<unsigned>(len_[cur_]);
+    sqe->buf_index = static_cast<unsigned short>(cur_);
+    sqe->user_data = cur_;
+    Status s = ring_->Submit(0);
+    if (!s.ok()) {
+      status_ = s;
+      return;
+    }
+    pending_[cur_] = true;
+    off_[cur_] = offset_;
+    offset_ += len_[cur_];
+    cur_ ^= 1;
+    Wait(cur_);
+    len_[cur_] = 0;
+  }
+
+  // Wait for the outstanding write of a given buffer to finish.
+  void Wait(int i) {
+    while (pending_[i]) {
+      uint64_t id;
+      int res;
+      if (!ring_->Reap(&id, &res)) {
+        Status s = ring_->Submit(1);
+        if (!s.ok()) {
+          if (status_.ok()) status_ = s;
+          return;
+        }
+        continue;
+      }
+      pending_[id] = false;
+      if (res < 0) {
+        if (status_.ok()) status_ = PosixError(filename_, -res);
+      } else if (static_cast<size_t>(res) < len_[id]) {
+        WriteRemaining(static_cast<int>(id), static_cast<size_t>(res));
+      }
+    }
+  }
+
+  // Finish a short write using pwrite().
+  void WriteRemaining(int i, size_t done) {
+    const char* const buf = mem_ + i * buf_size_;
+    while (done < len_[i]) {
+      const ssize_t nw = pwrite(fd_, buf + done, len_[i] - done,
+                                static_cast<off_t>(off_[i] + done));
+      if (nw < 0) {
+        if (errno == EINTR) continue;
+        if (status_.ok()) status_ = PosixError(filename_, errno);
+        return;
+      }
+      done += static_cast<size_t>(nw);
+    }
+  }
+
+  const std::string filename_;
+  const int fd_;
+  IoUring* const ring_;
+  char* const mem_;  // Memory of both buffers
+  const size_t buf_size_;
+  uint64_t offset_;  // File offset of the next write
+  int cur_;          // Buffer receiving appends
+  size_t len_[2];
+  bool pending_[2];  // True if a buffer is being written out
+  uint64_t off_[2];  // File offset of each outstanding write
+  Status status_;    // Sticky write error
+  PosixWritableFile base_;  // Closes fd_ and implements Sync()
+};
+
+class IoUringEnv : public EnvWrapper {
+ public:
+  IoUringEnv(Env* base, const IoUringOptions& options)
+      : EnvWrapper(base), options_(options) {}
+
+  virtual ~IoUringEnv() {
+    for (size_t i = 0; i < rings_.size(); i++) {
+      delete rings_[i];
+    }
+  }
+
+  // Set up the rings shared by random access files. Return OK if at least
+  // one ring is set up, or a non-OK status otherwise.
+  Status Init() {
+    Status s;
+    for (int i = 0; i < options_.num_rings; i++) {
+      IoUring* const ring = new IoUring;
+      s = ring->Open(options_.queue_depth);
+      if (!s.ok()) {
+        delete ring;
+        break;
+      }
+      rings_.push_back(ring);
+    }
+    free_rings_ = rings_;
+    if (!rings_.empty()) {
+      return Status::OK();
+    } else if (s.ok()) {
+      return Status::InvalidArgument("num_rings");
+    } else {
+      return s;
+    }
+  }
+
+  virtual Status NewRandomAccessFile(const char* fname,
+                                     RandomAccessFile** r) OVERRIDE {
+    int fd = open(fname, O_RDONLY);
+    if (fd != -1) {
+      *r = new IoUringRandomAccessFile(fname, fd, this);
+      return Status::OK();
+    } else {
+      *r = NULL;
+      return PosixError(fname, errno);
+    }
+  }
+
+  virtual Status NewWritableFile(const char* fname, WritableFile** r) OVERRIDE {
+    int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      *r = NULL;
+      return PosixError(fname, errno);
+    }
+    // Fall back to plain writes if the buffers cannot be registered
+    const size_t buf_size = options_.write_buffer;
+    IoUring* ring = new IoUring;
+    char* mem = NULL;
+    Status s = ring->Open(2);
+    if (s.ok()) {
+      mem = new char[2 * buf_size];
+      struct iovec iovs[2];
+      for (int i = 0; i < 2; i++) {
+        iovs[i].iov_base = mem + i * buf_size;
+        iovs[i].iov_len = buf_size;
+      }
+      s = ring->RegisterBuffers(iovs, 2);
+    }
+    if (s.ok()) {
+      *r = new IoUringWritableFile(fname, fd, ring, mem, buf_size);
+    } else {
+      delete[] mem;
+      delete ring;
+      *r = new PosixWritableFile(fname, fd);
+    }
+    return Status::OK();
+  }
+
+  // Return a free ring, or NULL if all rings are in use.
+  IoUring* TryAcquireRing() {
+    MutexLock ml(&mu_);
+    if (free_rings_.empty()) {
+      return NULL;
+    }
+    IoUring* const ring = free_rings_.back();
+    free_rings_.pop_back();
+    return ring;
+  }
+
+  void ReleaseRing(IoUring* ring) {
+    MutexLock ml(&mu_);
+    free_rings_.push_back(ring);
+  }
+
+ private:
+  const IoUringOptions options_;
+  port::Mutex mu_;
+  std::vector<IoUring*> rings_;  // All rings
+  std::vector<IoUring*> free_rings_;
+};
+
+Status IoUringRandomAccessFile::ReadMulti(ReadRequest* reqs, size_t n) const {
+  IoUring* const ring = env_->TryAcquireRing();
+  if (ring == NULL) {
+    return base_.ReadMulti(reqs, n);
+  }
+  Status status = RingRead(ring, reqs, n);
+  env_->ReleaseRing(ring);
+  if (status.ok()) {
+    for (size_t i = 0; i < n; i++) {
+      if (!reqs[i].status.ok()) {
+        status = reqs[i].status;
+        break;
+      }
+    }
+  }
+  return status;
+}
+
+// Submit as many reads as the ring can hold at a time and keep it full until
+// all reads are done. A non-OK status is returned only if the ring fails, in
+// which case all reads not completed are failed with that status.
+Status IoUringRandomAccessFile::RingRead(IoUring* ring, ReadRequest* reqs,
+                                         size_t n) const {
+  Status status;
+  std::vector<struct iovec> iovs(n);
+  std::vector<char> completed(n, 0);
+  size_t next = 0;
+  size_t inflight = 0;
+  size_t done = 0;
+  while (done < n) {
+    while (next < n) {
+      struct io_uring_sqe* const sqe = ring->GetSqe();
+      if (sqe == NULL) {
+        break;
+      }
+      iovs[next].iov_base = reqs[next].scratch;
+      iovs[next].iov_len = reqs[next].n;
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = fd_;
+      sqe->off = reqs[next].offset;
+      sqe->addr = reinterpret_cast<uintptr_t>(&iovs[next]);
+      sqe->len = 1;
+      sqe->user_data = next;
+      next++;
+      inflight++;
+    }
+    status = ring->Submit(1);
+    if (!status.ok()) {
+      break;
+    }
+    uint64_t id;
+    int res;
+    while (ring->Reap(&id, &res)) {
+      Complete(&reqs[id], res);
+      completed[id] = 1;
+      inflight--;
+      done++;
+    }
+  }
+  if (!status.ok()) {
+    for (size_t i = 0; i < n; i++) {
+      if (!completed[i]) {
+        reqs[i].result = Slice();
+        reqs[i].status = status;
+      }
+    }
+  }
+  return status;
+}
+
+void IoUringRandomAccessFile::Complete(ReadRequest* req, int res) const {
+  if (res == -EAGAIN || res == -EINTR) {
+    req->status = base_.Read(req->offset, req->n, &req->result, req->scratch);
+  } else if (res < 0) {
+    req->result = Slice();
+    req->status = PosixError(filename_, -res);
+  } else {
+    size_t nr = static_cast<size_t>(res);
+    req->status = Status::OK();
+    // Short reads are finished using pread(). pread() returns 0 at eof.
+    while (nr < req->n && res > 0) {
+      Slice more;
+      req->status = base_.Read(req->offset + nr, req->n - nr, &more,
+                               req->scratch + nr);
+      if (!req->status.ok()) break;
+      res = static_cast<int>(more.size());
+      nr += more.size();
+    }
+    req->result = Slice(req->scratch, nr);
+  }
+}
+
+Status ParseIoUringOptions(const char* conf, IoUringOptions* options) {
+  std::vector<std::string> confs;
+  size_t n = SplitString(&confs, conf, ',');
+  for (size_t i = 0; i < n; i++) {
+    std::vector<std::string> pair;
+    SplitString(&pair, confs[i].c_str(), '=');
+    uint64_t val;
+    if (pair.size() != 2 || !ParsePrettyNumber(pair[1], &val)) {
+      return Status::InvalidArgument("Bad io_uring conf", confs[i]);
+    }
+    if (pair[0] == "queue_depth") {
+      options->queue_depth = static_cast<unsigned>(val);
+    } else if (pair[0] == "num_rings") {
+      options->num_rings = static_cast<int>(val);
+    } else if (pair[0] == "write_buffer") {
+      options->write_buffer = static_cast<size_t>(val);
+    } else {
+      return Status::InvalidArgument("Unknown io_uring conf", pair[0]);
+    }
+  }
+  if (options->queue_depth == 0 || options->write_buffer == 0) {
+    return Status::InvalidArgument("Bad io_uring conf", conf);
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+Env* Env::NewIoUringEnvWrapper(Env* const base, const char* conf) {
+  IoUringOptions options;
+  Status s = ParseIoUringOptions(conf != NULL ? conf : "", &options);
+  if (!s.ok()) {
+    fprintf(stderr, "Error: %s\n", s.ToString().c_str());
+    return NULL;
+  }
+  IoUringEnv* const env = new IoUringEnv(base, options);
+  s = env->Init();
+  if (!s.ok()) {  // io_uring is not supported by the running kernel
+    delete env;
+    return NULL;
+  }
+  return env;
+}
+
+#else
+
+Env* Env::NewIoUringEnvWrapper(Env* const base, const char* conf) {
+  return NULL;
+}
+
+#endif
+
+}  // namespace pdlfs
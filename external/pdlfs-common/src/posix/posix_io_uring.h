@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "posix_env.h"
+
+#if defined(PDLFS_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace pdlfs {
+
+struct IoUringOptions {
+  IoUringOptions();
+
+  // Max number of operations outstanding on each ring.
+  // Default: 64
+  unsigned queue_depth;
+
+  // Number of rings shared by all random access files. Readers finding all
+  // rings in use fall back to pread().
+  // Default: 4
+  int num_rings;
+
+  // Size of each of the two registered buffers of a writable file. Appends
+  // are copied into one buffer while the other one is being written out.
+  // Default: 1MB
+  size_t write_buffer;
+};
+
+// A minimal io_uring instance driven through raw system calls. Implementation
+// is not thread safe. Callers must provide external synchronization.
+class IoUring {
+ public:
+  IoUring();
+  ~IoUring();
+
+  // Set up a ring able to queue a given number of operations.
+  // Return OK on success, or a non-OK status on errors.
+  Status Open(unsigned entries);
+
+  // Register a set of buffers for fixed-buffer operations.
+  // Return OK on success, or a non-OK status on errors.
+  Status RegisterBuffers(const struct iovec* iovs, unsigned n);
+
+  // Return a zeroed submission queue entry, or NULL if the queue is full.
+  // The entry is submitted by the next call to Submit().
+  struct io_uring_sqe* GetSqe();
+
+  // Submit all queued entries and wait until at least "min_complete"
+  // completions are available. Return OK on success, or a non-OK status
+  // on errors.
+  Status Submit(unsigned min_complete);
+
+  // Retrieve a completion. Return false if none is available.
+  bool Reap(uint64_t* user_data, int* res);
+
+ private:
+  int fd_;
+  void* sq_ptr_;
+  size_t sq_size_;
+  void* cq_ptr_;
+  size_t cq_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_array_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  struct io_uring_cqe* cqes_;
+  unsigned cq_mask_;
+  unsigned sqe_tail_;  // Entries handed out by GetSqe()
+
+  // No copying allowed
+  void operator=(const IoUring&);
+  IoUring(const IoUring&);
+};
+
+}  // namespace pdlfs
+
+#endif
@@ -177,6 +177,16 @@ ssize_t deltafs_plfsdir_append(deltafs_plfsdir_t* __dir, const char* __fname,
 char* deltafs_plfsdir_get(deltafs_plfsdir_t* __dir, const char* __key,
                           size_t __keylen, int __epoch, size_t* __sz,
                           size_t* __table_seeks, size_t* __seeks);
+/* Retrieve data from a batch of __n keys at a specific epoch, or all
+   epochs if __epoch is -1. The i-th key is stored at __keys[i] and is
+   __keylens[i] bytes long. Returns NULL on errors. A malloc()ed array
+   otherwise, holding the data of all keys back to back, with the size
+   of the data of the i-th key stored in __sz[i]. A key that is not found
+   has a size of 0. The result should be deleted by free(). */
+char* deltafs_plfsdir_multiget(deltafs_plfsdir_t* __dir, const char** __keys,
+                               const size_t* __keylens, size_t __n,
+                               int __epoch, size_t* __sz,
+                               size_t* __table_seeks, size_t* __seeks);
 /* Retrieve data from a given filename at a specific epoch, or all
    epochs if __epoch is -1. Returns NULL if no such file is found.
    A malloc()ed array otherwise. Stores the length of the array in *__sz.
@@ -195,6 +205,15 @@ ssize_t deltafs_plfsdir_scan(deltafs_plfsdir_t* __dir, int __epoch,
 /* Count the number of keys at a specified epoch, or all epochs if
    __epoch is -1. Return the number of keys found. Return -1 on error. */
 ssize_t deltafs_plfsdir_count(deltafs_plfsdir_t* __dir, int __epoch);
+/* Report all entries of a RANGEDB directory whose float keys fall within
+   [rmin, rmax) at a specific epoch, or all epochs if __epoch is -1, in key
+   order. Report results to *saver. Return -1 on errors. Otherwise, return
+   the total number of entries reported. */
+ssize_t deltafs_plfsdir_range_query(
+    deltafs_plfsdir_t* __dir, float rmin, float rmax, int __epoch,
+    int (*saver)(void* arg, const char* __key, size_t __keylen,
+                 const char* __value, size_t sz),
+    void* arg);
 ssize_t deltafs_plfsdir_io_pread(deltafs_plfsdir_t* __dir, void* __buf,
                                  size_t __sz, off_t __off);
 int* deltafs_plfsdir_filter_get(deltafs_plfsdir_t* __dir, const char* __key,
@@ -17,6 +17,7 @@
 #include "plfsio/v1/bufio.h"
 #include "plfsio/v1/cuckoo.h"
 #include "plfsio/v1/pdb.h"
+#include "plfsio/v1/range_reader.h"
 #include "plfsio/v1/range_writer.h"
 #include "plfsio/v1/types.h"
 #include "plfsio/v1/v1.h"
@@ -40,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <vector>
 
 #ifndef EHOSTUNREACH
 #define EHOSTUNREACH ENODEV
@@ -1092,6 +1094,8 @@ struct deltafs_plfsdir {
   BufferedBlockWriter* blk_writer_;
   pdlfs::plfsio::RangeWriter* range_writer_;
   pdlfs::WritableFile* range_dst_;
+  pdlfs::plfsio::RangeReader* range_reader_;
+  pdlfs::RandomAccessFile* range_src_;
   pdlfs::RandomAccessFile* blk_src_;
   BufferedBlockReader* blk_reader_;
   pdlfs::WritableFile* cuckoo_dst_;
@@ -1392,8 +1396,21 @@ pdlfs::Status OpenAsRdb(deltafs_plfsdir_t* dir, const std::string& parent) {
                                          1 /*nsubpart*/, 2 /*nprev*/, bufsz);
       dir->range_dst_ = dstfile;
     }
+  } else if (dir->mode == O_RDONLY) {
+    dir->io_options->reader_pool = dir->pool;
+    pdlfs::RandomAccessFile* srcfile;
+    uint64_t srcsz;
+    s = env->GetFileSize(fname.c_str(), &srcsz);
+    if (s.ok()) {
+      s = env->NewRandomAccessFile(fname.c_str(), &srcfile);
+      if (s.ok()) {
+        dir->range_reader_ =
+            new pdlfs::plfsio::RangeReader(*dir->io_options, srcfile, srcsz);
+        dir->range_src_ = srcfile;
+      }
+    }
   } else {
-    s = BadArgs();   /* !O_WRONLY current not supported */
+    s = BadArgs();
   }
 
   return s;
@@ -2291,7 +2308,8 @@ char* deltafs_plfsdir_get(deltafs_plfsdir_t* __dir, const char* __key,
     } else if (__dir->io_engine == DELTAFS_PLFSDIR_PLAINDB) {
       s = __dir->blk_reader_->Get(pdlfs::Slice(__key, __keylen), &dst);
     } else if (__dir->io_engine == DELTAFS_PLFSDIR_RANGEDB) {
-      s = BadArgs(); // Read path not implemented
+      s = __dir->range_reader_->Get(pdlfs::Slice(__key, __keylen), __epoch,
+                                    &dst);
     } else {
       s = DbGet(__dir, pdlfs::Slice(__key, __keylen), &dst);
     }
@@ -2312,6 +2330,72 @@ char* deltafs_plfsdir_get(deltafs_plfsdir_t* __dir, const char* __key,
   }
 }
 
+char* deltafs_plfsdir_multiget(deltafs_plfsdir_t* __dir, const char** __keys,
+                               const size_t* __keylens, size_t __n,
+                               int __epoch, size_t* __sz,
+                               size_t* __table_seeks, size_t* __seeks) {
+  pdlfs::Status s;
+  std::vector<std::string> dsts;
+  char* result = NULL;
+
+  if (!IsDirOpened(__dir)) {
+    s = BadArgs();
+  } else if (__dir->mode != O_RDONLY) {
+    s = BadArgs();
+  } else if (!__keys || !__keylens || !__sz) {
+    s = BadArgs();
+  } else {
+    std::vector<pdlfs::Slice> keys;
+    for (size_t i = 0; i < __n && s.ok(); i++) {
+      if (!__keys[i] || __keylens[i] == 0) {
+        s = BadArgs();
+      } else {
+        keys.push_back(pdlfs::Slice(__keys[i], __keylens[i]));
+      }
+    }
+    if (!s.ok()) {
+      // Invalid keys
+    } else if (__dir->io_engine == DELTAFS_PLFSDIR_DEFAULT) {
+      DirReader::ReadOp op;
+      op.SetEpoch(__epoch);
+      op.table_seeks = __table_seeks;
+      op.seeks = __seeks;
+      s = __dir->reader->MultiRead(op, keys, &dsts);
+    } else {  // No batched reads. Fetch keys one by one.
+      dsts.resize(keys.size());
+      for (size_t i = 0; i < keys.size() && s.ok(); i++) {
+        if (__dir->io_engine == DELTAFS_PLFSDIR_RANGEDB) {
+          s = __dir->range_reader_->Get(keys[i], __epoch, &dsts[i]);
+        } else if (__dir->io_engine == DELTAFS_PLFSDIR_PLAINDB) {
+          s = __dir->blk_reader_->Get(keys[i], &dsts[i]);
+        } else {
+          s = DbGet(__dir, keys[i], &dsts[i]);
+        }
+      }
+    }
+    if (s.ok()) {
+      size_t total = 0;
+      for (size_t i = 0; i < dsts.size(); i++) {
+        total += dsts[i].size();
+      }
+      result = static_cast<char*>(malloc(total != 0 ? total : 1));
+      char* p = result;
+      for (size_t i = 0; i < dsts.size(); i++) {
+        memcpy(p, dsts[i].data(), dsts[i].size());
+        p += dsts[i].size();
+        __sz[i] = dsts[i].size();
+      }
+    }
+  }
+
+  if (!s.ok()) {
+    DirError(__dir, s);
+    return NULL;
+  } else {
+    return result;
+  }
+}
+
 void* deltafs_plfsdir_read(deltafs_plfsdir_t* __dir, const char* __fname,
                            int __epoch, size_t* __sz, size_t* __table_seeks,
                            size_t* __seeks) {
@@ -2327,6 +2411,9 @@ void* deltafs_plfsdir_read(deltafs_plfsdir_t* __dir, const char* __fname,
     s = BadArgs();
   } else if (__fname[0] == 0) {
     s = BadArgs();
+  } else if (__dir->io_engine == DELTAFS_PLFSDIR_RANGEDB) {
+    /* hashing __fname() does not make sense for RANGEDB, use get instead */
+    s = pdlfs::Status::NotSupported(pdlfs::Slice());
   } else {
     char tmp[16];
     DirReader::ReadOp op;
@@ -2343,8 +2430,6 @@ void* deltafs_plfsdir_read(deltafs_plfsdir_t* __dir, const char* __fname,
       s = __dir->reader->Read(op, k, &dst);
     } else if (__dir->io_engine == DELTAFS_PLFSDIR_PLAINDB) {
       s = __dir->blk_reader_->Get(k, &dst);
-    } else if (__dir->io_engine == DELTAFS_PLFSDIR_RANGEDB) {
-      s = BadArgs(); // Read path not implemented
     } else {
       s = DbGet(__dir, k, &dst);
     }
@@ -2401,6 +2486,8 @@ ssize_t deltafs_plfsdir_scan(deltafs_plfsdir_t* __dir, int __epoch,
     op.n = &n;
     if (__dir->io_engine == DELTAFS_PLFSDIR_DEFAULT) {
       s = __dir->reader->Scan(op, ScanSaver, &state);
+    } else if (__dir->io_engine == DELTAFS_PLFSDIR_RANGEDB) {
+      s = __dir->range_reader_->Scan(__epoch, ScanSaver, &state, &n);
     } else {
       // Not implemented
     }
@@ -2426,6 +2513,8 @@ ssize_t deltafs_plfsdir_count(deltafs_plfsdir_t* __dir, int __epoch) {
     op.SetEpoch(__epoch);
     if (__dir->io_engine == DELTAFS_PLFSDIR_DEFAULT) {
       s = __dir->reader->Count(op, &n);
+    } else if (__dir->io_engine == DELTAFS_PLFSDIR_RANGEDB) {
+      s = __dir->range_reader_->Count(__epoch, &n);
     } else {
       // Not implemented
     }
@@ -2438,6 +2527,37 @@ ssize_t deltafs_plfsdir_count(deltafs_plfsdir_t* __dir, int __epoch) {
   }
 }
 
+ssize_t deltafs_plfsdir_range_query(
+    deltafs_plfsdir_t* __dir, float rmin, float rmax, int __epoch,
+    int (*saver)(void* arg, const char* __key, size_t __keylen,
+                 const char* __value, size_t sz),
+    void* arg) {
+  pdlfs::Status s;
+  ScanState state;
+  state.saver = saver;
+  state.arg = arg;
+  size_t n = 0;
+
+  if (!IsDirOpened(__dir)) {
+    s = BadArgs();
+  } else if (__dir->mode != O_RDONLY) {
+    s = BadArgs();
+  } else if (__dir->io_engine != DELTAFS_PLFSDIR_RANGEDB) {
+    s = BadArgs();
+  } else if (!saver) {
+    s = BadArgs();
+  } else {
+    s = __dir->range_reader_->RangeQuery(rmin, rmax, __epoch, ScanSaver,
+                                         &state, &n);
+  }
+
+  if (!s.ok()) {
+    return DirError(__dir, s);
+  } else {
+    return n;
+  }
+}
+
 ssize_t deltafs_plfsdir_io_pread(deltafs_plfsdir_t* __dir, void* __buf,
                                  size_t __sz, off_t __off) {
   pdlfs::Status s;
@@ -2525,6 +2645,8 @@ int deltafs_plfsdir_free_handle(deltafs_plfsdir_t* __dir) {
   delete __dir->blk_dst_;
   delete __dir->blk_reader_;
   delete __dir->blk_src_;
+  delete __dir->range_reader_;
+  delete __dir->range_src_;
   delete __dir->cuckoo_;
   delete __dir->cuckoo_dst_;
   delete __dir->cuckoo_data_;
@@ -115,6 +115,29 @@ class PlfsDirTest {
     return tmp;
   }
 
+  std::vector<std::string> MultiGet(const std::vector<std::string>& keys) {
+    if (wdir_ != NULL) Finish();
+    if (rdir_ == NULL) OpenReader(kDefEngine);
+    std::vector<const char*> ks;
+    std::vector<size_t> lens;
+    for (size_t i = 0; i < keys.size(); i++) {
+      ks.push_back(keys[i].data());
+      lens.push_back(keys[i].size());
+    }
+    std::vector<size_t> sz(keys.size());
+    char* result = deltafs_plfsdir_multiget(rdir_, &ks[0], &lens[0],
+                                            keys.size(), -1, &sz[0], NULL, NULL);
+    ASSERT_TRUE(result != NULL);
+    std::vector<std::string> tmp;
+    const char* p = result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      tmp.push_back(std::string(p, sz[i]));
+      p += sz[i];
+    }
+    free(result);
+    return tmp;
+  }
+
   std::string IoRead(uint64_t off, size_t sz) {
     if (wdir_ != NULL) Finish();
     if (rdir_ == NULL) OpenReader(kDefEngine);
@@ -165,6 +188,26 @@ TEST(PlfsDirTest, SingleEpoch) {
   ASSERT_EQ(Get("k6"), "v6");
 }
 
+TEST(PlfsDirTest, MultiGet) {
+  Put("k1", "v1");
+  Put("k2", "v2");
+  FinishEpoch();
+  Put("k1", "v3");
+  Put("k3", "v4");
+  FinishEpoch();
+  std::vector<std::string> keys;
+  keys.push_back("k3");
+  keys.push_back("k0");
+  keys.push_back("k1");
+  keys.push_back("k2");
+  std::vector<std::string> vals = MultiGet(keys);
+  ASSERT_EQ(vals.size(), 4);
+  ASSERT_EQ(vals[0], "v4");
+  ASSERT_TRUE(vals[1].empty());
+  ASSERT_EQ(vals[2], "v1v3");
+  ASSERT_EQ(vals[3], "v2");
+}
+
 TEST(PlfsDirTest, PdbEmpty) {
   OpenWriter(DELTAFS_PLFSDIR_PLAINDB);
   FinishEpoch();
@@ -201,6 +244,51 @@ TEST(PlfsDirTest, PdbRw) {
   ASSERT_EQ(Get("k6"), "v6");
 }
 
+namespace {
+int SaveRangeKey(void* arg, const char* key, size_t keylen, const char* value,
+                 size_t sz) {
+  std::string* dst = reinterpret_cast<std::string*>(arg);
+  dst->append(value, sz);
+  return 0;
+}
+}  // namespace
+
+TEST(PlfsDirTest, RdbRw) {
+  const char* c = dirconf_.c_str();
+  wdir_ = deltafs_plfsdir_create_handle(c, O_WRONLY, DELTAFS_PLFSDIR_RANGEDB);
+  ASSERT_TRUE(wdir_ != NULL);
+  deltafs_plfsdir_set_key_size(wdir_, sizeof(float));
+  deltafs_plfsdir_set_val_size(wdir_, 2);
+  deltafs_plfsdir_destroy(wdir_, dirname_.c_str());
+  ASSERT_TRUE(deltafs_plfsdir_open(wdir_, dirname_.c_str()) == 0);
+  ASSERT_TRUE(deltafs_plfsdir_range_update(wdir_, 0, 10) == 0);
+  const float keys[] = {3, 1, 4, 1.5, 9, 2, 6};
+  const char* vals[] = {"v3", "v1", "v4", "v5", "v9", "v2", "v6"};
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    char tmp[sizeof(float)];
+    memcpy(tmp, &keys[i], sizeof(float));
+    ASSERT_TRUE(deltafs_plfsdir_put(wdir_, tmp, sizeof(tmp), 0, vals[i], 2) ==
+                2);
+  }
+  ASSERT_TRUE(deltafs_plfsdir_epoch_flush(wdir_, 0) == 0);
+  ASSERT_TRUE(deltafs_plfsdir_finish(wdir_) == 0);
+  deltafs_plfsdir_free_handle(wdir_);
+  wdir_ = NULL;
+  rdir_ = deltafs_plfsdir_create_handle(c, O_RDONLY, DELTAFS_PLFSDIR_RANGEDB);
+  ASSERT_TRUE(rdir_ != NULL);
+  ASSERT_TRUE(deltafs_plfsdir_open(rdir_, dirname_.c_str()) == 0);
+  ASSERT_EQ(deltafs_plfsdir_count(rdir_, -1), 7);
+  std::string tmp;
+  ASSERT_EQ(deltafs_plfsdir_range_query(rdir_, 1.5, 6, -1, SaveRangeKey, &tmp),
+            4);
+  ASSERT_EQ(tmp, "v5v2v3v4");
+  tmp.clear();
+  ASSERT_EQ(deltafs_plfsdir_scan(rdir_, 0, SaveRangeKey, &tmp), 7);
+  ASSERT_EQ(tmp, "v1v5v2v3v4v6v9");
+  float k = 9;
+  ASSERT_EQ(Get(Slice(reinterpret_cast<char*>(&k), sizeof(k))), "v9");
+}
+
 class PlfsWiscBench {
   static int FromEnv(const char* key, int def) {
     const char* env = getenv(key);
@@ -12,6 +12,8 @@
 #include "builder.h"
 #include "recov.h"
 
+#include "pdlfs-common/mutexlock.h"
+
 #include <math.h>
 
 namespace pdlfs {
@@ -56,12 +58,14 @@ void ArrayBlockBuilder::Reset() {
 }
 
 Slice ArrayBlockBuilder::Finish(CompressionType compression,
-                                bool force_compression) {
+                                bool force_compression, int compression_level,
+                                const Slice& compression_dict) {
   assert(!finished_);
   // Remember key value sizes for later retrieval
   PutFixed32(&buffer_, value_size_);
   PutFixed32(&buffer_, key_size_);
-  return AbstractBlockBuilder::Finish(compression, force_compression);
+  return AbstractBlockBuilder::Finish(compression, force_compression,
+                                      compression_level, compression_dict);
 }
 
 size_t ArrayBlockBuilder::CurrentSizeEstimate() const {
@@ -227,8 +231,14 @@ SeqDirBuilder<T>::SeqDirBuilder(const DirOptions& options,
                                 DirOutputStats* stats, LogSink* data,
                                 LogSink* indx)
     : DirBuilder(options, stats),
+      pipelined_(options.compression != kNoCompression &&
+                 options.compression_pool != NULL),
+      job_cv_(&job_mu_),
+      num_blocks_(1),
+      pending_bytes_(0),
       num_uncommitted_indx_(0),
       num_uncommitted_data_(0),
+      num_tabl_blocks_(0),
       pending_restart_(false),
       pending_commit_(false),
       data_block_(new T(options)),
@@ -262,14 +272,30 @@ SeqDirBuilder<T>::SeqDirBuilder(const DirOptions& options,
   block_threshold_ =
       static_cast<size_t>(floor(options_.block_size * options_.block_util));
   uncommitted_indexes_.reserve(1 << 10);
-  if (options_.block_batch_size != 0)
+  if (pipelined_) {  // Each block gets its own buffer
+    data_block_->buffer_store()->reserve(options_.block_size);
+    if (options_.block_batch_size != 0)
+      batch_.reserve(options_.block_batch_size);
+  } else if (options_.block_batch_size != 0) {
     data_block_->buffer_store()->reserve(options_.block_batch_size);
+  }
   data_block_->buffer_store()->clear();
   pending_restart_ = true;
 }
 
 template <typename T>
 SeqDirBuilder<T>::~SeqDirBuilder() {
+  if (pipelined_) {  // Wait for blocks left behind by an aborted commit
+    MutexLock ml(&job_mu_);
+    for (size_t i = 0; i < jobs_.size(); i++) {
+      while (!jobs_[i]->done) job_cv_.Wait();
+      delete jobs_[i]->block;
+      delete jobs_[i];
+    }
+  }
+  for (size_t i = 0; i < free_blocks_.size(); i++) {
+    delete free_blocks_[i];
+  }
   indx_sink_->Unref();
   data_sink_->Unref();
   delete indx_writter_;
@@ -277,7 +303,9 @@ SeqDirBuilder<T>::~SeqDirBuilder() {
 }
 
 template <typename T>
-void SeqDirBuilder<T>::FinishEpoch(uint32_t ep_seq) {
+void SeqDirBuilder<T>::FinishEpoch(uint32_t ep_seq,
+                                   const Slice& filter_contents,
+                                   ChunkType filter_type) {
   assert(!finished_);  // Finish() has not been called
   // Skip epochs already finished
   if (ep_seq < num_eps_) return;
@@ -304,11 +332,30 @@ void SeqDirBuilder<T>::FinishEpoch(uint32_t ep_seq) {
   compac_stats_->final_meta_index_size += final_meta_index_size;
   compac_stats_->meta_index_size += meta_index_size;
 
+  BlockHandle filter_handle;
+  if (!filter_contents.empty()) {
+    status_ =
+        indx_writter_->Write(filter_type, filter_contents, &filter_handle);
+    if (!ok()) {
+      return;
+    }
+
+    const uint64_t filter_size = filter_contents.size();
+    const uint64_t final_filter_size = filter_handle.size() + kBlockTrailerSize;
+    compac_stats_->final_filter_size += final_filter_size;
+    compac_stats_->filter_size += filter_size;
+  } else {
+    filter_handle.set_offset(0);  // No filter installed
+    filter_handle.set_size(0);
+  }
+
   epok_block_.Reset();
   last_epok_info_.set_index_offset(epok_block_handle.offset());
   last_epok_info_.set_index_size(epok_block_handle.size());
   last_epok_info_.set_num_tables(num_tabls_);
   last_epok_info_.set_num_ents(num_entries_);
+  last_epok_info_.set_filter_offset(filter_handle.offset());
+  last_epok_info_.set_filter_size(filter_handle.size());
   assert(!pending_root_entry_);
   pending_root_entry_ = true;
 
@@ -356,6 +403,7 @@ void SeqDirBuilder<T>::EndTable(const Slice& filter_contents,
     num_uncommitted_indx_++;
   }
 
+  num_tabl_blocks_ = 0;
   Commit();
   if (!ok()) {
     return;
@@ -421,11 +469,17 @@ template <typename T>
 void SeqDirBuilder<T>::Commit() {
   assert(!finished_);  // Finish() has not been called
   // Skip empty commit
-  if (data_block_->buffer_store()->empty()) return;
+  if (pipelined_) {
+    if (jobs_.empty() && batch_.empty()) return;
+  } else if (data_block_->buffer_store()->empty()) {
+    return;
+  }
   if (!ok()) return;  // Abort
 
   assert(num_uncommitted_data_ == num_uncommitted_indx_);
-  std::string* const buffer = data_block_->buffer_store();
+  if (pipelined_) CollectBlocks();
+  std::string* const buffer =
+      pipelined_ ? &batch_ : data_block_->buffer_store();
 
   Slice key;
   data_sink_->Lock();
@@ -443,6 +497,10 @@ void SeqDirBuilder<T>::Commit() {
   while (!input.empty()) {
     if (GetLengthPrefixedSlice(&input, &key)) {
       handle.DecodeFrom(&input);
+      if (pipelined_) {  // Replace the block's schedule order with its handle
+        assert(handle.offset() < job_handles_.size());
+        handle = job_handles_[handle.offset()];
+      }
       const uint64_t offset = handle.offset();
       handle.set_offset(base + offset);  // Finalize the block offset
       handle_encoding.clear();
@@ -477,51 +535,138 @@ void SeqDirBuilder<T>::Commit() {
   num_uncommitted_data_ = num_uncommitted_indx_ = 0;
   uncommitted_indexes_.clear();
   data_block_->buffer_store()->clear();
+  job_handles_.clear();
+  batch_.clear();
   pending_restart_ = true;
 }
 
 template <typename T>
-void SeqDirBuilder<T>::EndBlock() {
-  assert(!finished_);                // Finish() has not been called
-  if (pending_restart_) return;      // Empty block
-  if (data_block_->empty()) return;  // Empty block
-  if (!ok()) return;                 // Abort
-
+Slice SeqDirBuilder<T>::FinalizeBlock(T* block, size_t* block_size) const {
   // | <------------ options_.block_size (e.g. 32KB) ------------> |
   //   block handle   block contents  block trailer  block padding
   //                | <---------- final block contents ----------> |
   //                          (LevelDb compatible layout)
   Slice block_contents =
-      data_block_->Finish(options_.compression, options_.force_compression);
-  const size_t block_size = block_contents.size();
-  Slice final_block_contents;  // With the trailer and any inserted padding
+      block->Finish(options_.compression, options_.force_compression,
+                    options_.compression_level, options_.compression_dict);
+  *block_size = block_contents.size();
   if (options_.block_padding) {
     // Target size for the final block contents after padding
     size_t padding_target =
         options_.block_size - BlockHandle::kMaxEncodedLength;
-    while (padding_target < block_size + kBlockTrailerSize)
+    while (padding_target < *block_size + kBlockTrailerSize)
       padding_target += options_.block_size;
-    final_block_contents = data_block_->Finalize(
-        !options_.skip_checksums, static_cast<uint32_t>(padding_target),
-        static_cast<char>(0xff));
+    return block->Finalize(!options_.skip_checksums,
+                           static_cast<uint32_t>(padding_target),
+                           static_cast<char>(0xff));
   } else {
-    final_block_contents = data_block_->Finalize(!options_.skip_checksums);
+    return block->Finalize(!options_.skip_checksums);
   }
+}
+
+template <typename T>
+void SeqDirBuilder<T>::BGFinalizeBlock(void* arg) {
+  BlockJob* const job = reinterpret_cast<BlockJob*>(arg);
+  SeqDirBuilder* const builder = job->builder;
+  size_t block_size;
+  Slice final_block_contents = builder->FinalizeBlock(job->block, &block_size);
+  MutexLock ml(&builder->job_mu_);
+  job->block_size = block_size;
+  job->final_block_size = final_block_contents.size();
+  job->done = true;
+  builder->job_cv_.SignalAll();
+}
 
-  const size_t final_block_size = final_block_contents.size();
-  const uint64_t block_offset =
-      data_block_->buffer_store()->size() - final_block_size;
-  compac_stats_->final_data_size += final_block_size;
-  compac_stats_->data_size += block_size;
+template <typename T>
+void SeqDirBuilder<T>::CollectBlocks() {
+  MutexLock ml(&job_mu_);
+  for (size_t i = 0; i < jobs_.size(); i++) {
+    BlockJob* const job = jobs_[i];
+    while (!job->done) job_cv_.Wait();
+    const std::string* const buf = job->block->buffer_store();
+    assert(buf->size() ==
+           BlockHandle::kMaxEncodedLength + job->final_block_size);
+    BlockHandle handle;
+    handle.set_offset(batch_.size() + BlockHandle::kMaxEncodedLength);
+    handle.set_size(job->block_size);
+    job_handles_.push_back(handle);
+    batch_.append(*buf);
+    compac_stats_->final_data_size += job->final_block_size;
+    compac_stats_->data_size += job->block_size;
+    free_blocks_.push_back(job->block);
+    delete job;
+  }
+  jobs_.clear();
+  pending_bytes_ = 0;
+}
+
+template <typename T>
+T* SeqDirBuilder<T>::NewBlock() {
+  T* block;
+  if (!free_blocks_.empty()) {
+    block = free_blocks_.back();
+    free_blocks_.pop_back();
+  } else {
+    block = new T(options_);
+    block->buffer_store()->reserve(options_.block_size);
+    num_blocks_++;
+  }
+  block->buffer_store()->clear();
+  return block;
+}
+
+template <typename T>
+void SeqDirBuilder<T>::EndBlock() {
+  assert(!finished_);                // Finish() has not been called
+  if (pending_restart_) return;      // Empty block
+  if (data_block_->empty()) return;  // Empty block
+  if (!ok()) return;                 // Abort
+
+  if (pipelined_) {
+    // Estimate the final size of the block so that batches are committed
+    // at roughly the same sizes as they would be without the pipeline
+    size_t estimated_size = BlockHandle::kMaxEncodedLength +
+                            data_block_->CurrentSizeEstimate() +
+                            kBlockTrailerSize;
+    if (options_.block_padding) {
+      estimated_size = options_.block_size *
+                       ((estimated_size + options_.block_size - 1) /
+                        options_.block_size);
+    }
+    BlockJob* const job = new BlockJob;
+    job->builder = this;
+    job->block = data_block_;
+    job->block_size = 0;
+    job->final_block_size = 0;
+    job->done = false;
+    // Block handles are resolved when the block is collected by Commit().
+    // Until then, the offset records the block's schedule order within
+    // the current batch.
+    last_data_info_.set_offset(jobs_.size());
+    last_data_info_.set_size(0);
+    jobs_.push_back(job);
+    pending_bytes_ += estimated_size;
+    data_block_ = NewBlock();
+    options_.compression_pool->Schedule(BGFinalizeBlock, job);
+  } else {
+    size_t block_size;
+    Slice final_block_contents = FinalizeBlock(data_block_, &block_size);
+    const size_t final_block_size = final_block_contents.size();
+    const uint64_t block_offset =
+        data_block_->buffer_store()->size() - final_block_size;
+    compac_stats_->final_data_size += final_block_size;
+    compac_stats_->data_size += block_size;
+    last_data_info_.set_size(block_size);
+    last_data_info_.set_offset(block_offset);
+  }
 
   if (ok()) {
     compac_stats_->total_num_blocks_++;
     pending_restart_ = true;
-    last_data_info_.set_size(block_size);
-    last_data_info_.set_offset(block_offset);
     assert(!pending_indx_entry_);
     pending_indx_entry_ = true;
     num_uncommitted_data_++;
+    num_tabl_blocks_++;
   }
 }
 
@@ -603,9 +748,10 @@ void SeqDirBuilder<T>::Add(const Slice& key, const Slice& value) {
           BlockHandle::kMaxEncodedLength >=
       block_threshold_) {
     EndBlock();
+    const size_t buffered =
+        pipelined_ ? pending_bytes_ : data_block_->buffer_store()->size();
     // Schedule buffer commit if it is about to full
-    if (data_block_->buffer_store()->size() + options_.block_size >
-        options_.block_batch_size) {
+    if (buffered + options_.block_size > options_.block_batch_size) {
       pending_commit_ = true;
     }
   }
@@ -617,7 +763,9 @@ void SeqDirBuilder<T>::Finish(uint32_t ep_seq) {
   if (ep_seq < num_eps_) ep_seq = num_eps_;
   EndTable(Slice(), static_cast<ChunkType>(0) /*Invalid*/);
   // Only establish a new epoch if we have pending epoch contents
-  if (ok() && num_tabls_ != 0) FinishEpoch(ep_seq);
+  if (ok() && num_tabls_ != 0) {
+    FinishEpoch(ep_seq, Slice(), static_cast<ChunkType>(0) /*Invalid*/);
+  }
   finished_ = true;
   if (!ok()) {
     return;
@@ -652,6 +800,11 @@ void SeqDirBuilder<T>::Finish(uint32_t ep_seq) {
 template <typename T>
 size_t SeqDirBuilder<T>::memory_usage() const {
   size_t result = data_block_->memory_usage();
+  if (pipelined_) {
+    // Block builders owned by outstanding jobs or kept for reuse
+    result += (num_blocks_ - 1) * options_.block_size;
+    result += batch_.capacity();
+  }
   result += root_block_.memory_usage();
   result += epok_block_.memory_usage();
   result += indx_block_.memory_usage();
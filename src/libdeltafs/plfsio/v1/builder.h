@@ -16,6 +16,7 @@
 #include "types.h"
 
 #include <set>
+#include <vector>
 
 namespace pdlfs {
 namespace plfsio {
@@ -82,7 +83,8 @@ class ArrayBlockBuilder : public AbstractBlockBuilder {
   // Finish building the block and return a slice that refers to the block
   // contents.
   Slice Finish(CompressionType compression = kNoCompression,
-               bool force_compression = false);
+               bool force_compression = false, int compression_level = 0,
+               const Slice& compression_dict = Slice());
 
   // Return the number of entries inserted.
   size_t NumEntries() const { return n_; }
@@ -171,9 +173,11 @@ class DirBuilder {
   virtual void EndTable(const Slice& filter_contents,
                         ChunkType filter_type) = 0;
 
-  // Force the start of a new epoch.
+  // Force the start of a new epoch. Optionally, a filter can be specified
+  // that is associated with the epoch.
   // REQUIRES: Finish() has not been called.
-  virtual void FinishEpoch(uint32_t ep_seq) = 0;
+  virtual void FinishEpoch(uint32_t ep_seq, const Slice& filter_contents,
+                           ChunkType filter_type) = 0;
 
   // Finalize directory contents.
   // No further writes.
@@ -226,7 +230,8 @@ class SeqDirBuilder : public DirBuilder {
 
   // Force the start of a new epoch.
   // REQUIRES: Finish() has not been called.
-  virtual void FinishEpoch(uint32_t ep_seq);
+  virtual void FinishEpoch(uint32_t ep_seq, const Slice& filter_contents,
+                           ChunkType filter_type);
 
   // Finalize table contents.
   // No further writes.
@@ -235,6 +240,14 @@ class SeqDirBuilder : public DirBuilder {
   // Report memory usage.
   virtual size_t memory_usage() const;
 
+  // Return the index of the data block within the current table that the
+  // next key will be added to.
+  uint32_t CurrentBlock() const { return num_tabl_blocks_; }
+
+  // Return the index of the table within the current epoch that the
+  // next key will be added to.
+  uint32_t CurrentTable() const { return num_tabls_; }
+
  private:
   // End the current block and force the start of a new data block.
   // REQUIRES: Finish() has not been called.
@@ -243,6 +256,37 @@ class SeqDirBuilder : public DirBuilder {
   // Flush buffered data blocks and finalize their indexes.
   // REQUIRES: Finish() has not been called.
   void Commit();
+
+  // Compress, checksum, and pad a finished data block. Store the size of the
+  // block contents before compression in *block_size. Return the final block
+  // contents, which include the block trailer and any inserted padding.
+  Slice FinalizeBlock(T* block, size_t* block_size) const;
+
+  // A sealed data block handed to options_.compression_pool. Each job owns a
+  // block builder whose buffer starts with space for the leading block handle.
+  struct BlockJob {
+    SeqDirBuilder* builder;
+    T* block;
+    size_t block_size;  // Block size before compression
+    size_t final_block_size;  // With the trailer and any inserted padding
+    bool done;
+  };
+  static void BGFinalizeBlock(void* arg);
+  // Wait for all outstanding block jobs and append their results to the
+  // batch buffer in the order they were scheduled.
+  void CollectBlocks();
+  // Obtain an empty data block builder. Reuse a free one if available.
+  T* NewBlock();
+  const bool pipelined_;  // Data blocks are compressed by compression_pool
+  port::Mutex job_mu_;
+  port::CondVar job_cv_;
+  // Compaction thread only
+  std::vector<BlockJob*> jobs_;  // Outstanding blocks in schedule order
+  std::vector<BlockHandle> job_handles_;  // Handles of collected blocks
+  std::vector<T*> free_blocks_;
+  size_t num_blocks_;     // Total number of block builders allocated
+  size_t pending_bytes_;  // Estimated final size of all outstanding blocks
+  std::string batch_;     // Blocks collected and pending commit
 #ifndef NDEBUG
   // Used to verify the uniqueness of all input keys
   std::set<std::string> keys_;
@@ -253,6 +297,7 @@ class SeqDirBuilder : public DirBuilder {
   std::string last_key_;
   uint32_t num_uncommitted_indx_;  // Number of uncommitted index entries
   uint32_t num_uncommitted_data_;  // Number of uncommitted data blocks
+  uint32_t num_tabl_blocks_;  // Number of data blocks ended in current table
   bool pending_restart_;           // Request to restart the data block buffer
   bool pending_commit_;  // Request to commit buffered data and indexes
   size_t block_threshold_;
@@ -10,6 +10,7 @@
  */
 
 #include "cuckoo.h"
+#include "format.h"
 #include "types.h"
 
 #include <math.h>
@@ -372,6 +373,22 @@ size_t CuckooBlock<k, v>::num_victims() const {
   return key_sizes_.size();
 }
 
+template <size_t k, size_t v>
+size_t CuckooBlock<k, v>::memory_usage() const {
+  size_t result = rep_->space_.capacity();
+  size_t i = 0;
+  for (; i < morereps_.size(); i++) {
+    result += morereps_[i]->space_.capacity();
+  }
+  result += keys_.capacity();
+  return result;
+}
+
+template <size_t k, size_t v>
+int CuckooBlock<k, v>::chunk_type() {
+  return static_cast<int>(kCufChunk);
+}
+
 template <size_t k, size_t v>
 size_t CuckooBlock<k, v>::TEST_BytesPerCuckooBucket() const {
   return static_cast<size_t>(sizeof(CuckooBucket<k, v>));
@@ -522,6 +539,8 @@ TEMPLATE2(14);
 TEMPLATE2(12);
 TEMPLATE2(10);
 
+template class CuckooBlock<16, 16>;  // CuckooFilterBlock
+
 bool CuckooKeyMayMatch(const Slice& key, const Slice& input) {
   return CuckooValues(key, input, NULL);  // Test key existence only
 }
@@ -587,6 +606,8 @@ bool CuckooValues(const Slice& key, const Slice& input,
       default:
         return true;
     }
+  } else if (keybits == 16 && valbits == 16) {
+    return CuckooKeyTester<16, 16>()(key, input, values);
   } else if (keybits == 4) {
     switch (int(valbits)) {
 #define CASE(n) \
@@ -81,6 +81,10 @@ class CuckooBlock {
 
   size_t num_victims() const;  // #keys not inserted to the main table
 
+  // Report total filter memory usage.
+  size_t memory_usage() const;
+  static int chunk_type();  // Return the corresponding chunk type
+
   size_t TEST_BytesPerCuckooBucket() const;
   size_t TEST_NumCuckooTables() const;
   size_t TEST_NumBuckets() const;
@@ -105,5 +109,13 @@ class CuckooBlock {
   Rep* rep_;
 };
 
+// The cuckoo filter used by directories configured with kFtCuckooFilter.
+// Each key is stored as a 16-bit fingerprint paired with the index of the
+// data block holding the key within its table, so a point read may go
+// straight to the right data blocks. Block indexes that do not fit are
+// stored as kCuckooNoBlock, in which case readers search the whole table.
+typedef CuckooBlock<16, 16> CuckooFilterBlock;
+static const uint32_t kCuckooNoBlock = 0xFFFF;
+
 }  // namespace plfsio
 }  // namespace pdlfs
@@ -21,6 +21,12 @@ std::string DirInfoFileName(const std::string& dirname) {
   return dirname + "/DIR.info";
 }
 
+std::string TrajectoryIndexFileName(const std::string& dirname, int rank) {
+  char tmp[20];
+  snprintf(tmp, sizeof(tmp), "/L-%08x.tix", rank);
+  return dirname + tmp;
+}
+
 std::string DirModeName(DirMode mode) {
   switch (mode) {
     case kDmMultiMap:
@@ -109,6 +115,10 @@ void EpochHandle::EncodeTo(std::string* dst) const {
   PutVarint64(dst, index_size_);
   PutVarint32(dst, num_tables_);
   PutVarint32(dst, num_ents_);
+  if (filter_size_ != 0) {
+    PutVarint64(dst, filter_offset_);
+    PutVarint64(dst, filter_size_);
+  }
 }
 
 Status EpochHandle::DecodeFrom(Slice* input) {
@@ -116,6 +126,13 @@ Status EpochHandle::DecodeFrom(Slice* input) {
       !GetVarint64(input, &index_size_) || !GetVarint32(input, &num_tables_) ||
       !GetVarint32(input, &num_ents_)) {
     return Status::Corruption("Bad epoch handle");
+  } else if (input->empty()) {  // No epoch filter
+    filter_offset_ = 0;
+    filter_size_ = 0;
+    return Status::OK();
+  } else if (!GetVarint64(input, &filter_offset_) ||
+             !GetVarint64(input, &filter_size_)) {
+    return Status::Corruption("Bad epoch filter handle");
   } else {
     return Status::OK();
   }
@@ -43,6 +43,7 @@ enum ChunkType {
   kIdxChunk = 0x01,  // Standard SST indexes
   kSbfChunk = 0x02,  // Standard bloom filters
   kBmpChunk = 0x03,  // Bitmap filters (w/ different compression fmts)
+  kCufChunk = 0x04,  // Cuckoo filters
 
   // Meta indexing block types
   kMetaChunk = 0x71,  // Meta indexes for each epoch
@@ -115,6 +116,17 @@ class EpochHandle {
   uint32_t num_ents() const { return num_ents_; }
   void set_num_ents(uint32_t n) { num_ents_ = n; }
 
+  // The offset of the epoch filter block in a log object.
+  // Epochs without a filter have a zero-sized filter.
+  uint64_t filter_offset() const { return filter_offset_; }
+  void set_filter_offset(uint64_t offset) { filter_offset_ = offset; }
+
+  // The size of the epoch filter block.
+  uint64_t filter_size() const { return filter_size_; }
+  void set_filter_size(uint64_t size) { filter_size_ = size; }
+
+  // The filter handle is only encoded when the epoch has a filter and is
+  // optional when decoding, so handles without one keep the old format.
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
@@ -125,6 +137,9 @@ class EpochHandle {
   // Epoch stats
   uint32_t num_tables_;
   uint32_t num_ents_;
+  // Handle to the epoch filter block
+  uint64_t filter_offset_;
+  uint64_t filter_size_;
 };
 
 // A special marker representing the completion of an epoch.
@@ -218,6 +233,10 @@ extern Footer Mkfoot(const DirOptions& options);
 
 extern std::string DirInfoFileName(const std::string& dirname);
 
+// Name of the trajectory index of a given rank (see traj.h).
+extern std::string TrajectoryIndexFileName(const std::string& dirname,
+                                           int rank);
+
 extern std::string DirModeName(DirMode mode);
 
 inline TableHandle::TableHandle()
@@ -232,7 +251,9 @@ inline EpochHandle::EpochHandle()
     : index_offset_(~static_cast<uint64_t>(0) /* Invalid offset */),
       index_size_(~static_cast<uint64_t>(0) /* Invalid size */),
       num_tables_(~static_cast<uint32_t>(0) /* Invalid */),
-      num_ents_(~static_cast<uint32_t>(0) /* Invalid */) {
+      num_ents_(~static_cast<uint32_t>(0) /* Invalid */),
+      filter_offset_(0),
+      filter_size_(0 /* No filter */) {
   // Empty
 }
 
@@ -12,8 +12,10 @@
 #include "internal.h"
 
 #include "../../util/logging.h"
+#include "cuckoo.h"
 #include "events.h"
 #include "filter.h"
+#include "traj.h"
 
 #include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/strutil.h"
@@ -21,22 +23,39 @@
 #include <algorithm>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 namespace pdlfs {
 extern const char* GetLengthPrefixedSlice(const char* p, const char* limit,
                                           Slice* result);
 namespace plfsio {
 
+// Epoch objects are referenced both by the writer and by pending compactions
+// of different directory partitions, which are protected by different locks.
+// As such, reference counting must be done atomically.
 void Epoch::Unref() {
-  assert(refs_ > 0);
-  refs_--;
-  if (refs_ == 0) {
+#if __cplusplus >= 201103L
+  const int r = --refs_;
+#else
+  mu_.Lock();
+  const int r = --refs_;
+  mu_.Unlock();
+#endif
+  assert(r >= 0);
+  if (r == 0) {
     delete this;
   }
 }
 
-Epoch::Epoch(uint32_t seq, port::Mutex* mu)
-    : seq_(seq), cv_(mu), num_ongoing_ops_(0), committing_(false), refs_(0) {}
+void Epoch::Ref() {
+#if __cplusplus < 201103L
+  MutexLock ml(&mu_);
+#endif
+  refs_++;
+}
+
+Epoch::Epoch(uint32_t seq)
+    : seq_(seq), num_ongoing_ops_(0), committing_(false), refs_(0) {}
 
 Epoch::~Epoch() {}
 
@@ -75,7 +94,11 @@ Compaction::~Compaction() {
 // This overhead is necessary for supporting variable length
 // key-value pairs.
 WriteBuffer::WriteBuffer(const DirOptions& options)
-    : num_entries_(0), finished_(false) {
+    : sort_pool_(options.sort_helpers > 0 ? options.compaction_pool : NULL),
+      sort_helpers_(options.sort_helpers),
+      radix_sort_(options.radix_sort),
+      num_entries_(0),
+      finished_(false) {
   const size_t entry_size =  // Estimated, actual entry sizes may differ
       options.key_size + options.value_size;
   bytes_per_entry_ =  // Memory usage per entry
@@ -188,14 +211,249 @@ struct WriteBuffer::STLLessThan {
   }
 };
 
+namespace {
+// A fixed-width key prefix and the offset of its entry in the write buffer.
+// Prefixes are the first 8 bytes of a key as a big-endian integer, zero padded,
+// so integer order agrees with bytewise key order except on ties. The prefix
+// is stored as two 32-bit words to keep each entry at 12 bytes (a uint64_t
+// member would pad it to 16).
+struct PrefixEntry {
+  uint32_t hi;
+  uint32_t lo;
+  uint32_t offset;
+
+  void set_prefix(uint64_t prefix) {
+    hi = static_cast<uint32_t>(prefix >> 32);
+    lo = static_cast<uint32_t>(prefix);
+  }
+};
+
+inline unsigned PrefixByte(uint64_t prefix, int d) {
+  return static_cast<unsigned>(prefix >> (8 * d)) & 0xFFu;
+}
+
+inline unsigned PrefixByte(const PrefixEntry& e, int d) {
+  const uint32_t w = d < 4 ? e.lo : e.hi;
+  return (w >> (8 * (d & 3))) & 0xFFu;
+}
+
+// Return true iff all entries share the same byte at position d.
+bool IsTrivialDigit(const size_t* histo, size_t n) {
+  for (int i = 0; i < 256; i++) {
+    if (histo[i] != 0) return histo[i] == n;
+  }
+  return true;
+}
+}  // namespace
+
+// Sort write buffer entries by key using a radix sort over key prefixes.
+// Entries are first partitioned by the most significant prefix byte not
+// shared by all keys. Each partition is then independently sorted using an
+// LSD radix sort over the remaining bytes, after which entries with identical
+// prefixes are sorted using full key comparisons. Partitions may be sorted by
+// helper jobs running in a thread pool. Helpers may start after the sort has
+// completed, so the sorter is reference-counted and helpers never touch the
+// write buffer unless they have claimed a partition.
+class WriteBuffer::RadixSorter {
+ public:
+  explicit RadixSorter(WriteBuffer* wb)
+      : wb_(wb),
+        cv_(&mu_),
+        num_parts_(0),
+        next_part_(0),
+        num_parts_done_(0),
+        refs_(0) {}
+
+  void Sort(ThreadPool* pool, int helpers) {
+    PrepareEntries();
+    if (pool != NULL && num_parts_ > 1) {
+      const size_t n = std::min(num_parts_ - 1, static_cast<size_t>(helpers));
+      for (size_t i = 0; i < n; i++) {
+        Ref();
+        pool->Schedule(RadixSorter::BGWork, this);
+      }
+    }
+    SortPartitions();  // The caller also does work
+    MutexLock ml(&mu_);
+    while (num_parts_done_ < num_parts_) {
+      cv_.Wait();
+    }
+    // Release memory now since late helpers may keep us alive
+    std::vector<PrefixEntry>().swap(a_);
+    std::vector<PrefixEntry>().swap(b_);
+  }
+
+  void Ref() {
+    MutexLock ml(&mu_);
+    refs_++;
+  }
+
+  void Unref() {
+    mu_.Lock();
+    assert(refs_ > 0);
+    const int r = --refs_;
+    mu_.Unlock();
+    if (r == 0) {
+      delete this;
+    }
+  }
+
+  static void BGWork(void* arg) {
+    RadixSorter* const s = reinterpret_cast<RadixSorter*>(arg);
+    s->SortPartitions();
+    s->Unref();
+  }
+
+ private:
+  ~RadixSorter() {}
+
+  // Extract key prefixes and partition entries by the most significant
+  // non-trivial prefix byte. Partitioned entries are stored in b_.
+  void PrepareEntries() {
+    const std::vector<uint32_t>& offsets = wb_->offsets_;
+    const Slice buffer = wb_->buffer_;
+    const size_t n = offsets.size();
+    a_.resize(n);
+    size_t histo[8][256];
+    memset(histo, 0, sizeof(histo));
+    for (size_t i = 0; i < n; i++) {
+      Slice input = buffer;
+      input.remove_prefix(offsets[i]);
+      Slice key;
+      GetLengthPrefixedSlice(&input, &key);
+      uint64_t prefix = 0;
+      const size_t m = std::min(key.size(), sizeof(prefix));
+      for (size_t j = 0; j < m; j++) {
+        prefix |= static_cast<uint64_t>(static_cast<unsigned char>(key[j]))
+                  << (56 - 8 * j);
+      }
+      a_[i].set_prefix(prefix);
+      a_[i].offset = offsets[i];
+      for (int d = 0; d < 8; d++) {
+        histo[d][PrefixByte(prefix, d)]++;
+      }
+    }
+    top_ = 7;
+    while (top_ >= 0 && IsTrivialDigit(histo[top_], n)) {
+      top_--;
+    }
+    if (top_ < 0) {  // All prefixes are the same
+      a_.swap(b_);
+      starts_.push_back(0);
+      starts_.push_back(n);
+    } else {
+      b_.resize(n);
+      size_t pos[256];
+      size_t sum = 0;
+      for (int i = 0; i < 256; i++) {
+        pos[i] = sum;
+        if (histo[top_][i] != 0) starts_.push_back(sum);
+        sum += histo[top_][i];
+      }
+      starts_.push_back(n);
+      for (size_t i = 0; i < n; i++) {
+        b_[pos[PrefixByte(a_[i], top_)]++] = a_[i];
+      }
+    }
+    num_parts_ = starts_.size() - 1;
+  }
+
+  void SortPartitions() {
+    while (true) {
+      size_t part;
+      {
+        MutexLock ml(&mu_);
+        if (next_part_ >= num_parts_) break;
+        part = next_part_++;
+      }
+      SortPartition(starts_[part], starts_[part + 1]);
+      MutexLock ml(&mu_);
+      num_parts_done_++;
+      if (num_parts_done_ == num_parts_) {
+        cv_.SignalAll();
+      }
+    }
+  }
+
+  // Sort entries in [begin, end) of b_ and write the resulting
+  // offsets to the same range of the write buffer's offset array.
+  void SortPartition(size_t begin, size_t end) {
+    const size_t n = end - begin;
+    PrefixEntry* src = &b_[begin];
+    PrefixEntry* dst = &a_[begin];
+    size_t histo[8][256];
+    memset(histo, 0, sizeof(histo));
+    for (size_t i = 0; i < n; i++) {
+      for (int d = 0; d < top_; d++) {
+        histo[d][PrefixByte(src[i], d)]++;
+      }
+    }
+    for (int d = 0; d < top_; d++) {
+      if (IsTrivialDigit(histo[d], n)) continue;
+      size_t pos[256];
+      size_t sum = 0;
+      for (int i = 0; i < 256; i++) {
+        pos[i] = sum;
+        sum += histo[d][i];
+      }
+      for (size_t i = 0; i < n; i++) {
+        dst[pos[PrefixByte(src[i], d)]++] = src[i];
+      }
+      std::swap(src, dst);
+    }
+    uint32_t* const offsets = &wb_->offsets_[begin];
+    for (size_t i = 0; i < n; i++) {
+      offsets[i] = src[i].offset;
+    }
+    // Resolve prefix ties using full key comparisons.
+    // A stable sort keeps duplicated keys in their insertion order.
+    STLLessThan cmp(wb_->buffer_);
+    size_t i = 0;
+    while (i < n) {
+      size_t j = i + 1;
+      while (j < n && src[j].hi == src[i].hi && src[j].lo == src[i].lo) j++;
+      if (j - i > 1) {
+        std::stable_sort(offsets + i, offsets + j, cmp);
+      }
+      i = j;
+    }
+  }
+
+  // No copying allowed
+  void operator=(const RadixSorter&);
+  RadixSorter(const RadixSorter&);
+
+  WriteBuffer* const wb_;
+  std::vector<PrefixEntry> a_;
+  std::vector<PrefixEntry> b_;
+  std::vector<size_t> starts_;  // Starting position of each partition
+  int top_;  // The prefix byte used to partition entries, or -1
+  port::Mutex mu_;
+  port::CondVar cv_;
+  size_t num_parts_;
+  size_t next_part_;  // Next partition to claim
+  size_t num_parts_done_;
+  int refs_;
+};
+
 void WriteBuffer::Finish(bool skip_sort) {
   assert(!finished_);
   finished_ = true;
   // Sort entries if not skipped
   if (!skip_sort) {
-    std::vector<uint32_t>::iterator begin = offsets_.begin();
-    std::vector<uint32_t>::iterator end = offsets_.end();
-    std::sort(begin, end, STLLessThan(buffer_));
+    // Small buffers are not worth the extra memory of a radix sort
+    if (radix_sort_ && offsets_.size() >= 256) {
+      RadixSorter* const sorter = new RadixSorter(this);
+      sorter->Ref();
+      // Only large sorts are split
+      ThreadPool* pool = offsets_.size() >= (64 << 10) ? sort_pool_ : NULL;
+      sorter->Sort(pool, sort_helpers_);
+      sorter->Unref();
+    } else {
+      std::vector<uint32_t>::iterator begin = offsets_.begin();
+      std::vector<uint32_t>::iterator end = offsets_.end();
+      std::sort(begin, end, STLLessThan(buffer_));
+    }
   }
 }
 
@@ -239,7 +497,7 @@ DirCompactor::DirCompactor(const DirOptions& options, DirBuilder* bu)
 DirCompactor::~DirCompactor() { delete bu_; }
 
 Status DirCompactor::FinishEpoch(uint32_t ep_seq) {
-  bu_->FinishEpoch(ep_seq);
+  bu_->FinishEpoch(ep_seq, Slice(), static_cast<ChunkType>(0) /*Invalid*/);
   return bu_->status_;
 }
 
@@ -252,7 +510,15 @@ template <typename T, typename U>
 class FilteredDirCompactor : public DirCompactor {
  public:
   FilteredDirCompactor(const DirOptions& options, DirBuilder* bu, T* filter)
-      : DirCompactor(options, bu), filter_(filter) {}
+      : DirCompactor(options, bu),
+        filter_(filter),
+        ep_filter_(NULL),
+        ep_keys_(0),
+        ep_keys_hint_(0) {
+    if (options_.epoch_filter) {
+      ep_filter_ = new CuckooFilterBlock(options_, 0);
+    }
+  }
   virtual ~FilteredDirCompactor();
 
   virtual void Compact(WriteBuffer* buf);
@@ -265,20 +531,41 @@ class FilteredDirCompactor : public DirCompactor {
 
  private:
   T* filter_;
+  // Epoch-wide filter mapping keys to their tables. NULL if disabled
+  CuckooFilterBlock* ep_filter_;
+  uint32_t ep_keys_;  // Number of keys inserted to ep_filter_
+  // Expected number of keys per epoch. The main table of an epoch filter is
+  // sized using the previous epoch. Keys in excess go to auxiliary tables.
+  uint32_t ep_keys_hint_;
 };
 
 template <typename T, typename U>
 FilteredDirCompactor<T, U>::~FilteredDirCompactor() {
+  delete ep_filter_;
   delete filter_;
 }
 
 template <typename T, typename U>
 Status FilteredDirCompactor<T, U>::FinishEpoch(uint32_t ep_seq) {
-  return DirCompactor::FinishEpoch(ep_seq);
+  // Epochs already finished are skipped by the builder
+  if (ep_keys_ == 0 || ep_seq < num_epochs()) {
+    return DirCompactor::FinishEpoch(ep_seq);
+  }
+  U* const bu = static_cast<U*>(bu_);
+  Slice filter_contents = ep_filter_->Finish();
+  const ChunkType filter_type =
+      static_cast<ChunkType>(CuckooFilterBlock::chunk_type());
+  bu->U::FinishEpoch(ep_seq, filter_contents, filter_type);
+  ep_keys_hint_ = ep_keys_;
+  ep_keys_ = 0;
+  return status();
 }
 
 template <typename T, typename U>
 Status FilteredDirCompactor<T, U>::Finish(uint32_t ep_seq) {
+  if (ep_keys_ != 0) {  // Seal the last epoch along with its filter
+    FinishEpoch(std::max(ep_seq, num_epochs()));
+  }
   return DirCompactor::Finish(ep_seq);
 }
 
@@ -286,10 +573,25 @@ template <typename T, typename U>
 size_t FilteredDirCompactor<T, U>::memory_usage() const {
   size_t result = 0;
   if (filter_ != NULL) result += filter_->memory_usage();
+  if (ep_filter_ != NULL) result += ep_filter_->memory_usage();
   result += bu_->memory_usage();
   return result;
 }
 
+// Insert a key into a table's filter. The key is about to be added to the
+// table by a builder.
+template <typename T, typename U>
+inline void AddToFilter(T* ft, U* bu, const Slice& key) {
+  ft->AddKey(key);
+}
+
+// Cuckoo filters also remember the index of the key's data block.
+template <typename U>
+inline void AddToFilter(CuckooFilterBlock* ft, U* bu, const Slice& key) {
+  const uint32_t block = bu->U::CurrentBlock();
+  ft->AddKey(key, block < kCuckooNoBlock ? block : kCuckooNoBlock);
+}
+
 template <typename T, typename U>
 void FilteredDirCompactor<T, U>::Compact(WriteBuffer* buf) {
   U* const bu = static_cast<U*>(bu_);
@@ -299,10 +601,22 @@ void FilteredDirCompactor<T, U>::Compact(WriteBuffer* buf) {
   if (ft != NULL) {
     ft->Reset(buf->NumEntries());
   }
+  CuckooFilterBlock* const ep_ft = ep_filter_;
+  uint32_t table = 0;
+  if (ep_ft != NULL) {
+    if (ep_keys_ == 0) {  // First table of the epoch
+      ep_ft->Reset(std::max(ep_keys_hint_, buf->NumEntries()));
+    }
+    table = std::min(bu->U::CurrentTable(), kCuckooNoBlock);
+    ep_keys_ += buf->NumEntries();
+  }
   for (; iter->IterType::Valid(); iter->IterType::Next()) {
     Slice key(iter->IterType::key());
     if (ft != NULL) {
-      ft->AddKey(key);
+      AddToFilter(ft, bu, key);
+    }
+    if (ep_ft != NULL) {
+      ep_ft->AddKey(key, table);
     }
     bu->U::Add(key, iter->IterType::value());
     if (!ok()) {
@@ -323,11 +637,9 @@ void FilteredDirCompactor<T, U>::Compact(WriteBuffer* buf) {
   delete iter;
 }
 
-DirIndexer::DirIndexer(const DirOptions& options, size_t part, port::Mutex* mu,
-                       port::CondVar* cv)
+DirIndexer::DirIndexer(const DirOptions& options, size_t part)
     : options_(options),
-      bg_cv_(cv),
-      mu_(mu),
+      bg_cv_(&mu_),
       part_(part),
       num_flush_requested_(0),
       num_flush_completed_(0),
@@ -378,9 +690,11 @@ DirIndexer::DirIndexer(const DirOptions& options, size_t part, port::Mutex* mu,
 }
 
 DirIndexer::~DirIndexer() {
-  mu_->AssertHeld();
-  while (has_bg_compaction_) {
-    bg_cv_->Wait();
+  {
+    MutexLock ml(&mu_);
+    while (has_bg_compaction_) {
+      bg_cv_.Wait();
+    }
   }
   if (!compaction_list_.empty())
     Warn(__LOG_ARGS__, "Deleting dir with active compactions");
@@ -432,6 +746,7 @@ DirCompactor* DirIndexer::OpenCompactor(DirBuilder* bu) {
 #define T1 FilteredDirCompactor
 #define T2 BloomBlock
 #define T3 EmptyFilterBlock
+#define T4 CuckooFilterBlock
 #define OPEN0(T, t, a1, a2) new T1<T, U>(a1, a2, t)
 #define OPEN1(T, t) OPEN0(T, t, options_, bu)
 #ifndef NDEBUG
@@ -447,12 +762,16 @@ DirCompactor* DirIndexer::OpenCompactor(DirBuilder* bu) {
       return OPEN1(T2, bf);
       break;
     }
+    case kFtCuckooFilter:
+      return OPEN1(T4, new T4(options_, ft_bytes_));
+      break;
     default:
       return OPEN1(T3, NULL);
       break;
   }
 #undef OPEN1
 #undef OPEN0
+#undef T4
 #undef T3
 #undef T2
 #undef T1
@@ -490,13 +809,23 @@ Status DirIndexer::Open(LogSink* data, LogSink* indx) {
 
 // True iff there is an on-going background compaction.
 bool DirIndexer::has_bg_compaction() {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   return has_bg_compaction_;
 }
 
 // Report background compaction status.
 Status DirIndexer::bg_status() {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
+  return bg_status_;
+}
+
+// Wait until there is no on-going background compaction or until a background
+// error is encountered. Return the latest compaction status.
+Status DirIndexer::WaitForCompaction() {
+  mu_.AssertHeld();
+  while (bg_status_.ok() && has_bg_compaction_) {
+    bg_cv_.Wait();
+  }
   return bg_status_;
 }
 
@@ -505,7 +834,7 @@ Status DirIndexer::bg_status() {
 // de-referenced by the last opener. Optionally, a caller may force data
 // sync and pre-closing all log files.
 Status DirIndexer::SyncAndClose() {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   assert(!has_bg_compaction_);
   Status status;
   if (!opened_) return status;
@@ -523,14 +852,14 @@ Status DirIndexer::SyncAndClose() {
 // After a compaction is scheduled, will wait until it finishes when
 // flush_options.wait has been set. REQUIRES: Open() has been called.
 Status DirIndexer::Flush(const FlushOptions& flush_options, Epoch* epoch) {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   assert(opened_);
   // Wait for buffer space
   while (imm_buf_ != NULL) {
     if (flush_options.dry_run) {
       return Status::TryAgain(Slice());
     } else {
-      bg_cv_->Wait();
+      bg_cv_.Wait();
     }
   }
 
@@ -546,7 +875,7 @@ Status DirIndexer::Flush(const FlushOptions& flush_options, Epoch* epoch) {
     if (status.ok()) {
       if (flush_options.wait) {
         while (num_flush_completed_ < my) {
-          bg_cv_->Wait();
+          bg_cv_.Wait();
         }
       }
     }
@@ -556,7 +885,7 @@ Status DirIndexer::Flush(const FlushOptions& flush_options, Epoch* epoch) {
 }
 
 Status DirIndexer::Add(Epoch* epoch, const Slice& key, const Slice& value) {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   assert(opened_);
   Status status = Prepare(epoch);
   while (status.ok()) {
@@ -572,7 +901,7 @@ Status DirIndexer::Add(Epoch* epoch, const Slice& key, const Slice& value) {
 
 Status DirIndexer::Prepare(Epoch* epoch, bool force, bool epoch_flush,
                            bool finalize) {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   Status status;
   assert(mem_buf_ != NULL);
   while (true) {
@@ -584,7 +913,7 @@ Status DirIndexer::Prepare(Epoch* epoch, bool force, bool epoch_flush,
       // There is room in current write buffer
       break;
     } else if (imm_buf_ != NULL) {
-      bg_cv_->Wait();
+      bg_cv_.Wait();
     } else {
       // Attempt to switch to a new write buffer
       assert(imm_buf_ == NULL);
@@ -613,7 +942,7 @@ Status DirIndexer::Prepare(Epoch* epoch, bool force, bool epoch_flush,
 }
 
 void DirIndexer::MaybeScheduleCompaction() {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
 
   // Do not schedule more if we are in error status
   if (!bg_status_.ok()) {
@@ -641,12 +970,12 @@ void DirIndexer::MaybeScheduleCompaction() {
 
 void DirIndexer::BGWork(void* arg) {
   DirIndexer* ins = reinterpret_cast<DirIndexer*>(arg);
-  MutexLock ml(ins->mu_);
+  MutexLock ml(&ins->mu_);
   ins->DoCompaction();
 }
 
 void DirIndexer::DoCompaction() {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   assert(has_bg_compaction_);
   assert(imm_buf_ != NULL);
   assert(imm_compac_ != NULL);
@@ -657,11 +986,11 @@ void DirIndexer::DoCompaction() {
   imm_buf_ = NULL;
   has_bg_compaction_ = false;
   MaybeScheduleCompaction();
-  bg_cv_->SignalAll();
+  bg_cv_.SignalAll();
 }
 
 void DirIndexer::CompactMemtable() {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   WriteBuffer* const buffer = imm_buf_;
   assert(buffer != NULL);
   Compaction* const c = imm_compac_;
@@ -672,7 +1001,7 @@ void DirIndexer::CompactMemtable() {
   Epoch* const ep = c->parent_;
   assert(ep != NULL);
   DirCompactor* dir = compactor_;
-  mu_->Unlock();
+  mu_.Unlock();
   const uint64_t start = CurrentMicros();
   if (options_.listener != NULL) {
     CompactionEvent event;
@@ -730,7 +1059,7 @@ void DirIndexer::CompactMemtable() {
 #endif
 
   Status status = dir->status();
-  mu_->Lock();
+  mu_.Lock();
   bg_status_ = status;
   if (is_forced) {
     num_flush_completed_++;
@@ -738,7 +1067,7 @@ void DirIndexer::CompactMemtable() {
 }
 
 uint32_t DirIndexer::num_epochs() const {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   if (opened_) {
     assert(compactor_ != NULL);
     return compactor_->num_epochs();
@@ -748,7 +1077,7 @@ uint32_t DirIndexer::num_epochs() const {
 }
 
 size_t DirIndexer::memory_usage() const {
-  mu_->AssertHeld();
+  mu_.AssertHeld();
   if (opened_) {
     size_t result = 0;
     result += buf0_.memory_usage();
@@ -761,6 +1090,76 @@ size_t DirIndexer::memory_usage() const {
   }
 }
 
+// Verify and uncompress a block whose contents are immediately followed by
+// its trailer in memory. On success, result->data either points into
+// "raw" or points to a heap-allocated uncompressed copy of the block, in
+// which case result->heap_allocated is set to true.
+static Status ParseBlock(const DirOptions& options, const Slice& raw,
+                         BlockContents* result) {
+  result->data = Slice();
+  result->heap_allocated = false;
+  result->cachable = false;
+
+  assert(raw.size() >= kBlockTrailerSize);
+  const size_t n = raw.size() - kBlockTrailerSize;
+  const char* const data = raw.data();
+  // CRC checks
+  if (!options.skip_checksums && options.verify_checksums) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+    const uint32_t actual = crc32c::Value(data, n + 1);
+    if (actual != crc) {
+      return Status::Corruption("Block checksum mismatch");
+    }
+  }
+
+  size_t ulen = 0;
+  char* ubuf = NULL;
+  switch (data[n]) {
+    case kSnappyCompression:
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulen)) {
+        return Status::Corruption("Cannot compress");
+      }
+      ubuf = new char[ulen];
+      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("Cannot compress");
+      }
+      break;
+    case kZstdCompression:
+      if (!port::Zstd_GetUncompressedLength(data, n, &ulen)) {
+        return Status::Corruption("Cannot compress");
+      }
+      ubuf = new char[ulen];
+      if (!port::Zstd_Uncompress(options.compression_dict.data(),
+                                 options.compression_dict.size(), data, n,
+                                 ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("Cannot compress");
+      }
+      break;
+    case kLz4Compression:
+      if (!port::Lz4_GetUncompressedLength(data, n, &ulen)) {
+        return Status::Corruption("Cannot compress");
+      }
+      ubuf = new char[ulen];
+      if (!port::Lz4_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("Cannot compress");
+      }
+      break;
+  }
+
+  if (ubuf != NULL) {
+    result->data = Slice(ubuf, ulen);
+    result->heap_allocated = true;
+    result->cachable = true;
+  } else {
+    result->data = Slice(data, n);
+  }
+
+  return Status::OK();
+}
+
 static Status ReadBlock(LogSource* source, const DirOptions& options,
                         const BlockHandle& handle, BlockContents* result,
                         bool cached = false, uint32_t file_index = 0,
@@ -785,55 +1184,27 @@ static Status ReadBlock(LogSource* source, const DirOptions& options,
       status = Status::Corruption("Truncated block read");
     }
   }
+  if (status.ok()) {
+    status = ParseBlock(options, contents, result);
+  }
   if (!status.ok()) {
     if (buf != tmp) delete[] buf;
     return status;
   }
 
-  // CRC checks
-  const char* data = contents.data();  // Pointer to where read put the data
-  if (!options.skip_checksums && options.verify_checksums) {
-    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
-    const uint32_t actual = crc32c::Value(data, n + 1);
-    if (actual != crc) {
-      if (buf != tmp) delete[] buf;
-      status = Status::Corruption("Block checksum mismatch");
-      return status;
-    }
-  }
-
-  if (data[n] == kSnappyCompression) {
-    size_t ulen = 0;
-    if (!port::Snappy_GetUncompressedLength(data, n, &ulen)) {
-      if (buf != tmp) delete[] buf;
-      status = Status::Corruption("Cannot compress");
-      return status;
-    }
-    char* ubuf = new char[ulen];
-    if (!port::Snappy_Uncompress(data, n, ubuf)) {
-      if (buf != tmp) delete[] buf;
-      delete[] ubuf;
-      status = Status::Corruption("Cannot compress");
-      return status;
-    }
+  if (result->heap_allocated) {  // Uncompressed into a separate buffer
     if (buf != tmp) {
       delete[] buf;
     }
-    result->data = Slice(ubuf, ulen);
-    result->heap_allocated = true;
-    result->cachable = true;
-  } else if (data != buf) {
+  } else if (contents.data() != buf) {
     // File implementation has given us pointer to some other data.
     // Use it directly under the assumption that it will be live
     // while the file is open.
     if (buf != tmp) {
       delete[] buf;
     }
-    result->data = Slice(data, n);
-    result->heap_allocated = false;
     result->cachable = false;  // Avoid double cache
   } else {
-    result->data = Slice(buf, n);
     result->heap_allocated = (buf != tmp);
     result->cachable = true;
   }
@@ -841,6 +1212,112 @@ static Status ReadBlock(LogSource* source, const DirOptions& options,
   return status;
 }
 
+namespace {
+void DeleteCachedBlock(const Slice& key, void* value) {
+  Slice* const block = reinterpret_cast<Slice*>(value);
+  delete[] block->data();
+  delete block;
+}
+
+// Key format: partition (4 bytes), block type (1 byte),
+// log rotation # (4 bytes), block offset (8 bytes)
+const size_t kBlockCacheKeyLength = 17;
+
+Slice BlockCacheKey(char* scratch, uint32_t part, BlockCache::BlockType type,
+                    uint32_t file_index, uint64_t offset) {
+  EncodeFixed32(scratch, part);
+  scratch[4] = static_cast<char>(type);
+  EncodeFixed32(scratch + 5, file_index);
+  EncodeFixed64(scratch + 9, offset);
+  return Slice(scratch, kBlockCacheKeyLength);
+}
+}  // namespace
+
+BlockCache::BlockCache(size_t capacity)
+    : cache_(NewLRUCache(capacity)), hits_(0), misses_(0) {}
+
+BlockCache::~BlockCache() { delete cache_; }
+
+Cache::Handle* BlockCache::Lookup(uint32_t part, BlockType type,
+                                  uint32_t file_index, uint64_t offset,
+                                  Slice* result) {
+  char tmp[kBlockCacheKeyLength];
+  Slice key = BlockCacheKey(tmp, part, type, file_index, offset);
+  Cache::Handle* const h = cache_->Lookup(key);
+#if __cplusplus < 201103L
+  MutexLock ml(&mu_);
+#endif
+  if (h != NULL) {
+    *result = *reinterpret_cast<Slice*>(cache_->Value(h));
+    hits_++;
+  } else {
+    misses_++;
+  }
+  return h;
+}
+
+Cache::Handle* BlockCache::Insert(uint32_t part, BlockType type,
+                                  uint32_t file_index, uint64_t offset,
+                                  const Slice& contents) {
+  char tmp[kBlockCacheKeyLength];
+  Slice key = BlockCacheKey(tmp, part, type, file_index, offset);
+  Slice* const block = new Slice(contents);
+  return cache_->Insert(key, block, contents.size(), DeleteCachedBlock);
+}
+
+void Dir::ReleaseBlock(Cache::Handle* handle) {
+  if (handle != NULL) {
+    assert(cache_ != NULL);
+    cache_->Release(handle);
+  }
+}
+
+Status Dir::LoadBlock(LogSource* source, const BlockHandle& h,
+                      BlockContents* result, Cache::Handle** handle,
+                      bool cached, uint32_t file_index, char* tmp,
+                      size_t tmp_length) {
+  *handle = NULL;
+  const bool is_index = (source == indx_);
+  // Lazily loaded index logs have no in-memory copy to point into, so
+  // their blocks must be copied out.
+  const bool lazy = is_index && options_.index_cache_size != 0;
+  if (lazy) {
+    cached = false;
+  }
+  // Uncompressed index blocks are read directly from the in-memory
+  // copy of the index log so there is no need to cache them.
+  if (cache_ == NULL ||
+      (is_index && !lazy && options_.index_compression == kNoCompression)) {
+    return ReadBlock(source, options_, h, result, cached, file_index, tmp,
+                     tmp_length);
+  }
+  const BlockCache::BlockType type =
+      is_index ? BlockCache::kIndexBlock : BlockCache::kDataBlock;
+  *handle = cache_->Lookup(part_, type, file_index, h.offset(), &result->data);
+  if (*handle != NULL) {
+    result->heap_allocated = false;
+    result->cachable = false;
+    return Status::OK();
+  }
+
+  Status status = ReadBlock(source, options_, h, result, cached, file_index,
+                            tmp, tmp_length);
+  if (status.ok() && result->cachable) {
+    Slice contents = result->data;
+    if (!result->heap_allocated) {  // Contents are in the caller's buffer
+      char* const buf = new char[contents.size()];
+      memcpy(buf, contents.data(), contents.size());
+      contents = Slice(buf, contents.size());
+    }
+    *handle = cache_->Insert(part_, type, file_index, h.offset(), contents);
+    result->data = contents;
+    result->heap_allocated = false;  // Owned by the cache
+    result->cachable = false;
+  }
+
+  return status;
+}
+
 // Retrieve all keys from a given data block.
 Status Dir::Iter(const IterOptions& opts, Slice* input) {
   Status status;
@@ -850,8 +1327,9 @@ Status Dir::Iter(const IterOptions& opts, Slice* input) {
     return status;
   }
   BlockContents contents;
-  status = ReadBlock(data_, options_, handle, &contents, false, opts.file_index,
-                     opts.tmp, opts.tmp_length);
+  Cache::Handle* cache_handle;
+  status = LoadBlock(data_, handle, &contents, &cache_handle, false,
+                     opts.file_index, opts.tmp, opts.tmp_length);
   if (!status.ok()) {
     return status;
   } else {
@@ -872,6 +1350,7 @@ Status Dir::Iter(const IterOptions& opts, Slice* input) {
   }
 
   delete iter;
+  ReleaseBlock(cache_handle);
   return status;
 }
 
@@ -888,7 +1367,9 @@ Status Dir::Iter(const IterOptions& opts, const TableHandle& h) {
   // so there is no need to allocate an additional
   // buffer to store the block contents
   const bool cached = true;
-  status = ReadBlock(indx_, options_, index_handle, &index_contents, cached);
+  Cache::Handle* cache_handle;
+  status =
+      LoadBlock(indx_, index_handle, &index_contents, &cache_handle, cached);
   if (!status.ok()) {
     return status;
   } else {
@@ -911,6 +1392,7 @@ Status Dir::Iter(const IterOptions& opts, const TableHandle& h) {
 
   delete iter;
   delete index_block;
+  ReleaseBlock(cache_handle);
   return status;
 }
 
@@ -929,8 +1411,9 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key, Slice* input,
     return status;
   }
   BlockContents contents;
-  status = ReadBlock(data_, options_, handle, &contents, false, opts.file_index,
-                     opts.tmp, opts.tmp_length);
+  Cache::Handle* cache_handle;
+  status = LoadBlock(data_, handle, &contents, &cache_handle, false,
+                     opts.file_index, opts.tmp, opts.tmp_length);
   if (!status.ok()) {
     return status;
   } else {
@@ -991,33 +1474,83 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key, Slice* input,
   }
 
   delete iter;
+  ReleaseBlock(cache_handle);
   return status;
 }
 
+// Check a key against the contents of a filter block.
+static bool FilterMayMatch(const DirOptions& options, const Slice& key,
+                           const Slice& filter) {
+  if (options.filter == kFtBloomFilter) {
+    return BloomKeyMayMatch(key, filter);
+  } else if (options.filter == kFtBitmap) {
+    return BitmapKeyMustMatch(key, filter);
+  } else if (options.filter == kFtCuckooFilter) {
+    return CuckooKeyMayMatch(key, filter);
+  } else {  // Unknown filter type
+    return true;
+  }
+}
+
 // Check if a specific key may or must not exist in one or more blocks
-// indexed by the given filter.
-bool Dir::KeyMayMatch(const Slice& key, const BlockHandle& h) {
+// indexed by the given filter. If the filter is a cuckoo filter and *blocks
+// is not NULL, the indexes of the data blocks that may hold the key are
+// appended to *blocks. *blocks is left empty if they are unknown.
+bool Dir::KeyMayMatch(const Slice& key, const BlockHandle& h,
+                      std::vector<uint32_t>* blocks) {
   Status status;
   BlockContents contents;
   // We always prefetch and cache all filter blocks in memory
   // so there is no need to allocate an additional
   // buffer to store the block contents
   const bool cached = true;
-  status = ReadBlock(indx_, options_, h, &contents, cached);
+  Cache::Handle* cache_handle;
+  status = LoadBlock(indx_, h, &contents, &cache_handle, cached);
   if (status.ok()) {
-    bool r;  // False if key must not match so no need for further access
-    if (options_.filter == kFtBloomFilter) {
-      r = BloomKeyMayMatch(key, contents.data);
-    } else if (options_.filter == kFtBitmap) {
-      r = BitmapKeyMustMatch(key, contents.data);
-    } else {  // Unknown filter type
-      r = true;
+    // False if key must not match so no need for further access
+    const bool r = (blocks != NULL && options_.filter == kFtCuckooFilter)
+                       ? CuckooValues(key, contents.data, blocks)
+                       : FilterMayMatch(options_, key, contents.data);
+    if (contents.heap_allocated) {
+      delete[] contents.data.data();
     }
+    ReleaseBlock(cache_handle);
+    return r;
+  } else {
+    return true;
+  }
+}
+
+// Check a key against the filter block of an epoch. The filter is a cuckoo
+// filter whose values are the tables holding each key.
+bool Dir::EpochKeyMayMatch(const Slice& key, const EpochHandle& h,
+                           std::vector<uint32_t>* tables) {
+  Status status;
+  BlockHandle filter_handle;
+  filter_handle.set_offset(h.filter_offset());
+  filter_handle.set_size(h.filter_size());
+  BlockContents contents;
+  // Epoch filters are cached along with all other filter blocks
+  const bool cached = true;
+  Cache::Handle* cache_handle;
+  status = LoadBlock(indx_, filter_handle, &contents, &cache_handle, cached);
+  if (status.ok()) {
+    const bool r = CuckooValues(key, contents.data, tables);
     if (contents.heap_allocated) {
       delete[] contents.data.data();
     }
+    ReleaseBlock(cache_handle);
+    if (r && !tables->empty()) {
+      std::sort(tables->begin(), tables->end());
+      tables->erase(std::unique(tables->begin(), tables->end()),
+                    tables->end());
+      if (tables->back() == kCuckooNoBlock) {
+        tables->clear();  // Table unknown; all tables must be searched
+      }
+    }
     return r;
   } else {
+    tables->clear();
     return true;
   }
 }
@@ -1036,13 +1569,83 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
     filter_handle.set_offset(h.filter_offset());
     filter_handle.set_size(h.filter_size());
     if (filter_handle.size() != 0) {  // Filter detected
-      if (!KeyMayMatch(key, filter_handle)) {
+      std::vector<uint32_t> blocks;
+      if (!KeyMayMatch(key, filter_handle, &blocks)) {
         // Assuming no false negatives
         return status;
+      } else if (!blocks.empty()) {
+        return FetchFromBlocks(opts, key, h, &blocks);
       }
     }
   }
 
+  return FetchFromTable(opts, key, h);
+}
+
+// Retrieve value to a specific key from a given set of data blocks of a
+// table, as identified by the table's cuckoo filter. Blocks are identified
+// by their positions in the table's index block. Return OK on success and
+// a non-OK status on errors.
+Status Dir::FetchFromBlocks(const FetchOptions& opts, const Slice& key,
+                            const TableHandle& h,
+                            std::vector<uint32_t>* blocks) {
+  std::sort(blocks->begin(), blocks->end());
+  blocks->erase(std::unique(blocks->begin(), blocks->end()), blocks->end());
+  if (blocks->back() >= kCuckooNoBlock) {  // Block unknown
+    return FetchFromTable(opts, key, h);
+  }
+
+  Status status;
+  // Load the index block
+  BlockContents index_contents;
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  Cache::Handle* cache_handle;
+  status =
+      LoadBlock(indx_, index_handle, &index_contents, &cache_handle, true);
+  if (!status.ok()) {
+    return status;
+  } else {
+    opts.stats->table_seeks++;
+  }
+
+  Block* index_block = new Block(index_contents);
+  Iterator* const iter = index_block->NewIterator(BytewiseComparator());
+  iter->SeekToFirst();
+  size_t j = 0;
+  uint32_t i = 0;
+  for (; iter->Valid() && j < blocks->size(); iter->Next(), i++) {
+    if (i != (*blocks)[j]) {
+      continue;
+    }
+    j++;
+    bool found = false;
+    bool exhausted = false;
+    Slice input = iter->value();
+    status = Fetch(opts, key, &input, &found, &exhausted);
+    if (!status.ok()) {
+      break;
+    } else if (found && IsKeyUnique(options_.mode)) {
+      break;
+    }
+  }
+
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  delete index_block;
+  ReleaseBlock(cache_handle);
+  return status;
+}
+
+// Retrieve value to a specific key from a given table without consulting the
+// table's filter. Return OK on success and a non-OK status on errors.
+Status Dir::FetchFromTable(const FetchOptions& opts, const Slice& key,
+                           const TableHandle& h) {
+  Status status;
   // Load the index block
   BlockContents index_contents;
   BlockHandle index_handle;
@@ -1052,7 +1655,9 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
   // so there is no need to allocate an additional
   // buffer to store the block contents
   const bool cached = true;
-  status = ReadBlock(indx_, options_, index_handle, &index_contents, cached);
+  Cache::Handle* cache_handle;
+  status =
+      LoadBlock(indx_, index_handle, &index_contents, &cache_handle, cached);
   if (!status.ok()) {
     return status;
   } else {
@@ -1105,6 +1710,7 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
 
   delete iter;
   delete index_block;
+  ReleaseBlock(cache_handle);
   return status;
 }
 
@@ -1121,7 +1727,8 @@ Status Dir::DoList(const BlockHandle& h, uint32_t epoch, ListContext* ctx,
   // so there is no need to allocate an additional
   // buffer to store the block contents
   const bool cached = true;
-  status = ReadBlock(indx_, options_, h, &meta_index_contents, cached);
+  Cache::Handle* cache_handle;
+  status = LoadBlock(indx_, h, &meta_index_contents, &cache_handle, cached);
   if (!status.ok()) {
     return status;
   }
@@ -1169,6 +1776,7 @@ Status Dir::DoList(const BlockHandle& h, uint32_t epoch, ListContext* ctx,
 
   delete iter;
   delete epoch_index_block;
+  ReleaseBlock(cache_handle);
   return status;
 }
 
@@ -1208,16 +1816,30 @@ int ParaSaveValue(void* arg, const Slice& key, const Slice& value) {
 // GetContext *ctx may be shared among multiple concurrent getter threads.
 // GetStats *stats is dedicated to the current thread.
 // User callback is expected to be thread-safe.
-Status Dir::DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
+Status Dir::DoGet(const Slice& key, const EpochHandle& h, uint32_t epoch,
                   GetContext* ctx, GetStats* stats) {
   Status status;
+  // Consult the epoch filter first if there is one. Tables are otherwise
+  // checked one by one.
+  std::vector<uint32_t> tables;
+  if (h.filter_size() != 0 && !options_.ignore_filters) {
+    if (!EpochKeyMayMatch(key, h, &tables)) {
+      // Assuming no false negatives
+      return status;
+    }
+  }
   // Load the meta index for the epoch
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
   BlockContents meta_index_contents;
   // We always prefetch and cache all index blocks in memory
   // so there is no need to allocate an additional
   // buffer to store the block contents
   const bool cached = true;
-  status = ReadBlock(indx_, options_, h, &meta_index_contents, cached);
+  Cache::Handle* cache_handle;
+  status = LoadBlock(indx_, index_handle, &meta_index_contents, &cache_handle,
+                     cached);
   if (!status.ok()) {
     return status;
   }
@@ -1226,7 +1848,14 @@ Status Dir::DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
   iter->SeekToFirst();
   std::string epoch_table_key;
   uint32_t table = 0;
-  for (; status.ok(); table++) {
+  for (size_t i = 0; status.ok(); i++) {
+    if (tables.empty()) {
+      table = static_cast<uint32_t>(i);
+    } else if (i < tables.size()) {
+      table = tables[i];
+    } else {
+      break;  // All candidate tables checked
+    }
     epoch_table_key = EpochTableKey(epoch, table);
     // Try reusing current iterator position if possible
     if (!iter->Valid() || iter->key() != epoch_table_key) {
@@ -1241,7 +1870,7 @@ Status Dir::DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
     arg.epoch = epoch;
     arg.offsets = ctx->offsets;
     arg.buffer = ctx->buffer;
-    arg.mu = mu_;
+    arg.mu = ctx->mu;
     arg.dst = ctx->dst;
     arg.found = false;
     TableHandle table_handle;
@@ -1283,6 +1912,7 @@ Status Dir::DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
 
   delete iter;
   delete epoch_index_block;
+  ReleaseBlock(cache_handle);
   return status;
 }
 
@@ -1296,7 +1926,7 @@ static inline Iterator* NewRtIterator(Block* block) {
 // ListContext *ctx may be shared among multiple concurrent lister threads.
 // Return OK on success, or a non-OK status on errors.
 void Dir::List(uint32_t epoch, ListContext* ctx) {
-  mu_->AssertHeld();
+  ctx->mu->AssertHeld();
   if (!ctx->status->ok()) {
     return;
   }
@@ -1304,7 +1934,7 @@ void Dir::List(uint32_t epoch, ListContext* ctx) {
   if (rt_iter == NULL) {
     rt_iter = NewRtIterator(rt_);
   }
-  mu_->Unlock();
+  ctx->mu->Unlock();
   ListStats stats;
   stats.table_seeks = 0;  // Number of tables touched
   // Number of data blocks fetched
@@ -1338,7 +1968,7 @@ void Dir::List(uint32_t epoch, ListContext* ctx) {
     status = rt_iter->status();
   }
 
-  mu_->Lock();
+  ctx->mu->Lock();
   if (rt_iter != ctx->rt_iter) {
     delete rt_iter;
   }
@@ -1348,7 +1978,7 @@ void Dir::List(uint32_t epoch, ListContext* ctx) {
   ctx->n += stats.n;
   assert(ctx->num_open_lists > 0);
   ctx->num_open_lists--;
-  bg_cv_->SignalAll();
+  ctx->cv->SignalAll();
   if (ctx->status->ok()) {
     *ctx->status = status;
   }
@@ -1358,7 +1988,7 @@ void Dir::List(uint32_t epoch, ListContext* ctx) {
 // GetContext *ctx may be shared among multiple concurrent getter threads.
 // Return OK on success, or a non-OK status on errors.
 void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
-  mu_->AssertHeld();
+  ctx->mu->AssertHeld();
   if (!ctx->status->ok()) {
     return;
   }
@@ -1366,7 +1996,7 @@ void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
   if (rt_iter == NULL) {
     rt_iter = NewRtIterator(rt_);
   }
-  mu_->Unlock();
+  ctx->mu->Unlock();
   GetStats stats;
   stats.table_seeks = 0;  // Number of tables touched
   // Number of data blocks fetched
@@ -1383,7 +2013,7 @@ void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
         break;  // No such epoch
       }
     }
-    BlockHandle h;
+    EpochHandle h;
     Slice input = rt_iter->value();
     status = h.DecodeFrom(&input);
     rt_iter->Next();
@@ -1399,7 +2029,7 @@ void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
     status = rt_iter->status();
   }
 
-  mu_->Lock();
+  ctx->mu->Lock();
   if (rt_iter != ctx->rt_iter) {
     delete rt_iter;
   }
@@ -1408,7 +2038,7 @@ void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
   ctx->num_seeks += stats.seeks;
   assert(ctx->num_open_reads > 0);
   ctx->num_open_reads--;
-  bg_cv_->SignalAll();
+  ctx->cv->SignalAll();
   if (ctx->status->ok()) {
     *ctx->status = status;
   }
@@ -1466,7 +2096,6 @@ void Dir::Merge(GetContext* ctx) {
 // Count the total num of keys within a given epoch range.
 // Return OK on success, or a non-OK status on errors.
 Status Dir::Count(const CountOptions& opts, size_t* result) {
-  mu_->AssertHeld();
   Status status;
   assert(rt_ != NULL);
   std::string epoch_key;
@@ -1510,11 +2139,15 @@ Status Dir::Count(const CountOptions& opts, size_t* result) {
 // Iterate through all keys stored within a given epoch range.
 // Return OK on success, or a non-OK status on errors.
 Status Dir::Scan(const ScanOptions& opts, ScanStats* stats) {
-  mu_->AssertHeld();
   Status status;
   assert(rt_ != NULL);
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  MutexLock ml(&mu);
 
   ListContext ctx;
+  ctx.mu = &mu;
+  ctx.cv = &cv;
   ctx.tmp = opts.tmp;  // User-supplied buffer space
   ctx.tmp_length = opts.tmp_length;
   ctx.num_open_lists = 0;  // Number of outstanding list operations
@@ -1531,12 +2164,15 @@ Status Dir::Scan(const ScanOptions& opts, ScanStats* stats) {
   }
   ctx.usr_cb = opts.usr_cb;
   ctx.arg_cb = opts.arg_cb;
+  // Items must stay alive until background jobs are done with them
+  std::vector<BGListItem> items;
   if (num_eps_ != 0) {
     uint32_t epoch = opts.epoch_start;
     uint32_t epoch_end = std::min(num_eps_, opts.epoch_end);
-    for (; epoch < epoch_end; epoch++) {
+    if (epoch < epoch_end) items.resize(epoch_end - epoch);
+    for (size_t i = 0; epoch < epoch_end; epoch++, i++) {
       ctx.num_open_lists++;
-      BGListItem item;
+      BGListItem& item = items[i];
       item.epoch = epoch;
       item.dir = this;
       item.ctx = &ctx;
@@ -1557,7 +2193,7 @@ Status Dir::Scan(const ScanOptions& opts, ScanStats* stats) {
 
   // Wait for all outstanding list operations to conclude
   while (ctx.num_open_lists > 0) {
-    bg_cv_->Wait();
+    cv.Wait();
   }
 
   delete ctx.rt_iter;
@@ -1576,13 +2212,17 @@ Status Dir::Scan(const ScanOptions& opts, ScanStats* stats) {
 // Return OK on success, or a non-OK status on errors.
 Status Dir::Read(const ReadOptions& opts, const Slice& key, std::string* dst,
                  ReadStats* stats) {
-  mu_->AssertHeld();
   Status status;
   assert(rt_ != NULL);
   std::vector<uint32_t> offsets;
   std::string buffer;
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  MutexLock ml(&mu);
 
   GetContext ctx;
+  ctx.mu = &mu;
+  ctx.cv = &cv;
   ctx.tmp = opts.tmp;  // User-supplied buffer space
   ctx.tmp_length = opts.tmp_length;
   ctx.num_open_reads = 0;  // Number of outstanding epoch read operations
@@ -1599,12 +2239,15 @@ Status Dir::Read(const ReadOptions& opts, const Slice& key, std::string* dst,
     ctx.rt_iter = NULL;
   }
   ctx.dst = dst;
+  // Items must stay alive until background jobs are done with them
+  std::vector<BGGetItem> items;
   if (num_eps_ != 0) {
     uint32_t epoch = opts.epoch_start;
     uint32_t epoch_end = std::min(num_eps_, opts.epoch_end);
-    for (; epoch < epoch_end; epoch++) {
+    if (epoch < epoch_end) items.resize(epoch_end - epoch);
+    for (size_t i = 0; epoch < epoch_end; epoch++, i++) {
       ctx.num_open_reads++;
-      BGGetItem item;
+      BGGetItem& item = items[i];
       item.epoch = epoch;
       item.dir = this;
       item.ctx = &ctx;
@@ -1626,7 +2269,7 @@ Status Dir::Read(const ReadOptions& opts, const Slice& key, std::string* dst,
 
   // Wait for all outstanding read operations to conclude
   while (ctx.num_open_reads > 0) {
-    bg_cv_->Wait();
+    cv.Wait();
   }
 
   delete ctx.rt_iter;
@@ -1644,18 +2287,664 @@ Status Dir::Read(const ReadOptions& opts, const Slice& key, std::string* dst,
   return status;
 }
 
-void Dir::BGList(void* arg) {
-  BGListItem* item = reinterpret_cast<BGListItem*>(arg);
-  MutexLock ml(item->dir->mu_);
-  item->dir->List(item->epoch, item->ctx);
-}
-
-void Dir::BGGet(void* arg) {
+// Obtain the value to a specific key from a given list of data blocks.
+// Return OK on success, or a non-OK status on errors.
+Status Dir::ReadLocations(const ReadOptions& opts, const Slice& key,
+                          const std::vector<KeyLocation>& locs,
+                          std::string* dst, ReadStats* stats) {
+  Status status;
+  GetStats get_stats;
+  get_stats.table_seeks = 0;
+  get_stats.seeks = 0;
+  SaverState arg;
+  arg.dst = dst;
+  arg.found = false;
+  FetchOptions fetch_opts;
+  fetch_opts.stats = &get_stats;
+  fetch_opts.tmp_length = opts.tmp_length;
+  fetch_opts.tmp = opts.tmp;
+  fetch_opts.saver = SaveValue;
+  fetch_opts.arg = &arg;
+  const uint32_t epoch_end = std::min(num_eps_, opts.epoch_end);
+  std::string handle_encoding;
+  for (size_t i = 0; i < locs.size() && status.ok(); i++) {
+    const KeyLocation& loc = locs[i];
+    if (loc.epoch < opts.epoch_start || loc.epoch >= epoch_end) {
+      continue;
+    }
+    if (options_.epoch_log_rotation) {
+      fetch_opts.file_index = loc.epoch;
+    } else {
+      fetch_opts.file_index = 0;
+    }
+    handle_encoding.clear();
+    loc.block.EncodeTo(&handle_encoding);
+    Slice input = handle_encoding;
+    bool found = false;
+    bool exhausted = false;
+    status = Fetch(fetch_opts, key, &input, &found, &exhausted);
+  }
+
+  if (status.ok() && stats != NULL) {
+    stats->total_seeks += get_stats.seeks;
+  }
+
+  return status;
+}
+
+namespace {
+struct LocationSaverState {
+  Dir::LocationSaver saver;
+  void* arg;
+  uint32_t epoch;
+  BlockHandle block;  // The data block being iterated
+};
+
+int SaveLocation(void* arg, const Slice& key, const Slice& value) {
+  LocationSaverState* state = reinterpret_cast<LocationSaverState*>(arg);
+  state->saver(state->arg, key, state->epoch, state->block);
+  return 0;
+}
+}  // namespace
+
+// Iterate through all data blocks of a given table. Return OK on success, or
+// a non-OK status on errors.
+Status Dir::ListLocations(const IterOptions& opts, const TableHandle& h,
+                          BlockHandle* block) {
+  Status status;
+  // Load the index block
+  BlockContents index_contents;
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  const bool cached = true;
+  Cache::Handle* cache_handle;
+  status =
+      LoadBlock(indx_, index_handle, &index_contents, &cache_handle, cached);
+  if (!status.ok()) {
+    return status;
+  }
+
+  Block* index_block = new Block(index_contents);
+  Iterator* const iter = index_block->NewIterator(BytewiseComparator());
+  iter->SeekToFirst();
+  for (; iter->Valid(); iter->Next()) {
+    Slice input = iter->value();
+    Slice handle_input = input;
+    status = block->DecodeFrom(&handle_input);
+    if (status.ok()) {
+      status = Iter(opts, &input);
+    }
+    if (!status.ok()) {
+      break;
+    }
+  }
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  delete index_block;
+  ReleaseBlock(cache_handle);
+  return status;
+}
+
+// List the locations of all keys stored in the directory.
+// Return OK on success, or a non-OK status on errors.
+Status Dir::ListLocations(LocationSaver saver, void* arg) {
+  Status status;
+  assert(rt_ != NULL);
+  LocationSaverState state;
+  state.saver = saver;
+  state.arg = arg;
+  ListStats stats;
+  stats.table_seeks = 0;
+  stats.seeks = 0;
+  stats.n = 0;
+  IterOptions opts;
+  opts.stats = &stats;
+  opts.tmp = NULL;
+  opts.tmp_length = 0;
+  opts.saver = SaveLocation;
+  opts.arg = &state;
+  Iterator* const rt_iter = NewRtIterator(rt_);
+  std::string epoch_key;
+  for (uint32_t epoch = 0; epoch < num_eps_ && status.ok(); epoch++) {
+    epoch_key = EpochKey(epoch);
+    // Try reusing current iterator position if possible
+    if (!rt_iter->Valid() || rt_iter->key() != epoch_key) {
+      rt_iter->Seek(epoch_key);
+      if (!rt_iter->Valid()) {
+        break;  // EOF
+      } else if (rt_iter->key() != epoch_key) {
+        continue;  // Empty epoch
+      }
+    }
+    BlockHandle h;  // Handle to the epoch index block
+    Slice input = rt_iter->value();
+    status = h.DecodeFrom(&input);
+    rt_iter->Next();
+    if (!status.ok()) {
+      break;
+    }
+    // Load the meta index for the epoch
+    BlockContents meta_index_contents;
+    const bool cached = true;
+    Cache::Handle* cache_handle;
+    status = LoadBlock(indx_, h, &meta_index_contents, &cache_handle, cached);
+    if (!status.ok()) {
+      break;
+    }
+    state.epoch = epoch;
+    if (options_.epoch_log_rotation) {
+      opts.file_index = epoch;
+    } else {
+      opts.file_index = 0;
+    }
+    Block* epoch_index_block = new Block(meta_index_contents);
+    Iterator* const iter =
+        epoch_index_block->NewIterator(BytewiseComparator());
+    iter->SeekToFirst();
+    for (; iter->Valid() && status.ok(); iter->Next()) {
+      TableHandle table_handle;
+      Slice table_input = iter->value();
+      status = table_handle.DecodeFrom(&table_input);
+      if (status.ok()) {
+        status = ListLocations(opts, table_handle, &state.block);
+      }
+    }
+    if (status.ok()) {
+      status = iter->status();
+    }
+
+    delete iter;
+    delete epoch_index_block;
+    ReleaseBlock(cache_handle);
+  }
+
+  if (status.ok()) {
+    status = rt_iter->status();
+  }
+
+  delete rt_iter;
+  return status;
+}
+
+void Dir::BGList(void* arg) {
+  BGListItem* item = reinterpret_cast<BGListItem*>(arg);
+  MutexLock ml(item->ctx->mu);
+  item->dir->List(item->epoch, item->ctx);
+}
+
+void Dir::BGGet(void* arg) {
   BGGetItem* item = reinterpret_cast<BGGetItem*>(arg);
-  MutexLock ml(item->dir->mu_);
+  MutexLock ml(item->ctx->mu);
   item->dir->Get(item->key, item->epoch, item->ctx);
 }
 
+// A data block to be fetched along with the candidate keys, identified by
+// [begin, end) in the candidate array, to be looked up in the block.
+struct Dir::BlockRequest {
+  BlockHandle handle;
+  size_t begin;
+  size_t end;
+};
+
+// Look up a set of keys in a given data block. Values found are appended to
+// the keys' value buffers. Return OK on success, or a non-OK status on errors.
+Status Dir::SearchBlock(const MultiFetchOptions& opts,
+                        const std::vector<size_t>& cands,
+                        const BlockRequest& req,
+                        const BlockContents& contents) {
+  const std::vector<Slice>& keys = *opts.keys;
+  opts.stats->seeks++;
+  Iterator* const iter = OpenDirBlock(options_, contents);
+  for (size_t i = req.begin; i < req.end; i++) {
+    const size_t k = cands[i];
+    iter->Seek(keys[k]);  // Binary search
+    if (iter->Valid() && iter->key() == keys[k]) {
+      (*opts.values)[k].append(iter->value().data(), iter->value().size());
+      (*opts.found)[k] = 1;
+    }
+  }
+  Status status = iter->status();
+  delete iter;
+  return status;
+}
+
+Status Dir::MultiFetchBlocks(const MultiFetchOptions& opts,
+                             const std::vector<size_t>& cands,
+                             const BlockRequest* reqs, size_t n) {
+  Status status;
+  // Pin blocks that are already cached
+  std::vector<Cache::Handle*> handles(n, static_cast<Cache::Handle*>(NULL));
+  std::vector<Slice> cached(n);
+  if (cache_ != NULL) {
+    for (size_t i = 0; i < n; i++) {
+      handles[i] = cache_->Lookup(part_, BlockCache::kDataBlock,
+                                  opts.file_index, reqs[i].handle.offset(),
+                                  &cached[i]);
+    }
+  }
+
+  // Coalesce reads of adjacent blocks that are not cached up to
+  // options_.read_size. Blocks separated by no more than their padding are
+  // considered adjacent. All reads are then issued as a single batch.
+  static const size_t kCached = ~static_cast<size_t>(0);
+  std::vector<size_t> read_of(n, kCached);  // Read serving each block
+  std::vector<RandomAccessFile::ReadRequest> reads;
+  size_t total = 0;
+  size_t i = 0;
+  while (i < n) {
+    if (handles[i] != NULL) {
+      i++;
+      continue;
+    }
+    const uint64_t start = reqs[i].handle.offset();
+    uint64_t end = start + reqs[i].handle.size() + kBlockTrailerSize;
+    read_of[i] = reads.size();
+    size_t j = i + 1;
+    while (j < n && handles[j] == NULL && reqs[j].handle.offset() >= end &&
+           reqs[j].handle.offset() - end < options_.block_size) {
+      const uint64_t next_end = reqs[j].handle.offset() +
+                                reqs[j].handle.size() + kBlockTrailerSize;
+      if (next_end - start > options_.read_size) {
+        break;
+      }
+      end = next_end;
+      read_of[j] = reads.size();
+      j++;
+    }
+    RandomAccessFile::ReadRequest read;
+    read.offset = start;
+    read.n = static_cast<size_t>(end - start);
+    read.scratch = NULL;
+    reads.push_back(read);
+    total += read.n;
+    i = j;
+  }
+  char* const buf = new char[total];
+  total = 0;
+  for (size_t r = 0; r < reads.size(); r++) {
+    reads[r].scratch = buf + total;
+    total += reads[r].n;
+  }
+  if (!reads.empty()) {
+    status = data_->ReadMulti(&reads[0], reads.size(), opts.file_index);
+  }
+  for (size_t r = 0; status.ok() && r < reads.size(); r++) {
+    if (reads[r].result.size() != reads[r].n) {
+      status = Status::Corruption("Truncated block read");
+    }
+  }
+
+  for (i = 0; status.ok() && i < n; i++) {
+    BlockContents contents;
+    if (read_of[i] == kCached) {
+      contents.data = cached[i];
+      contents.heap_allocated = false;
+      contents.cachable = false;
+      status = SearchBlock(opts, cands, reqs[i], contents);
+      continue;
+    }
+    const RandomAccessFile::ReadRequest& read = reads[read_of[i]];
+    const Slice& raw = read.result;
+    const size_t k = static_cast<size_t>(reqs[i].handle.offset() - read.offset);
+    const size_t bytes =
+        static_cast<size_t>(reqs[i].handle.size()) + kBlockTrailerSize;
+    status = ParseBlock(options_, Slice(raw.data() + k, bytes), &contents);
+    if (!status.ok()) {
+      break;
+    }
+    // Blocks that are not uncompressed into a separate buffer point to our
+    // read buffer and must be copied before they can be cached. Blocks
+    // served from memory owned by the file are not cached.
+    if (cache_ != NULL &&
+        (contents.heap_allocated || raw.data() == read.scratch)) {
+      Slice block = contents.data;
+      if (!contents.heap_allocated) {
+        char* const copy = new char[block.size()];
+        memcpy(copy, block.data(), block.size());
+        block = Slice(copy, block.size());
+      }
+      handles[i] = cache_->Insert(part_, BlockCache::kDataBlock,
+                                  opts.file_index, reqs[i].handle.offset(),
+                                  block);
+      contents.data = block;
+      contents.heap_allocated = false;  // Owned by the cache
+    }
+    status = SearchBlock(opts, cands, reqs[i], contents);
+  }
+  delete[] buf;
+
+  for (size_t h = 0; h < n; h++) {
+    ReleaseBlock(handles[h]);
+  }
+  return status;
+}
+
+// Retrieve the values to a batch of keys from a given table. The table's
+// filter and index block are loaded once for all keys. Keys are then mapped to
+// data blocks, which are fetched using a single batch of reads. Blocks adjacent
+// in the data log share a read. Return OK on success and a non-OK status on
+// errors.
+Status Dir::MultiFetch(const MultiFetchOptions& opts, const TableHandle& h) {
+  Status status;
+  const std::vector<Slice>& keys = *opts.keys;
+  // Keys are sorted so those within the table's key range are consecutive
+  const size_t lo = static_cast<size_t>(
+      std::lower_bound(keys.begin(), keys.end(), h.smallest_key()) -
+      keys.begin());
+  const size_t hi = static_cast<size_t>(
+      std::upper_bound(keys.begin(), keys.end(), h.largest_key()) -
+      keys.begin());
+  std::vector<size_t> cands;
+  for (size_t i = lo; i < hi; i++) {
+    if (!(*opts.found)[i] || !IsKeyUnique(options_.mode)) {
+      cands.push_back(i);
+    }
+  }
+  if (!cands.empty() && !options_.ignore_filters && h.filter_size() != 0) {
+    BlockHandle filter_handle;
+    filter_handle.set_offset(h.filter_offset());
+    filter_handle.set_size(h.filter_size());
+    BlockContents contents;
+    Cache::Handle* cache_handle;
+    // Filter read errors are ignored as in KeyMayMatch()
+    if (LoadBlock(indx_, filter_handle, &contents, &cache_handle, true).ok()) {
+      size_t j = 0;
+      for (size_t i = 0; i < cands.size(); i++) {
+        if (FilterMayMatch(options_, keys[cands[i]], contents.data)) {
+          cands[j++] = cands[i];
+        }
+      }
+      cands.resize(j);
+      if (contents.heap_allocated) {
+        delete[] contents.data.data();
+      }
+      ReleaseBlock(cache_handle);
+    }
+  }
+  if (cands.empty()) {
+    return status;
+  }
+
+  // Keys may span multiple blocks. Look them up one at a time.
+  if (!IsKeyUniqueAndOrdered(options_.mode)) {
+    for (size_t i = 0; i < cands.size(); i++) {
+      const size_t k = cands[i];
+      SaverState state;
+      state.dst = &(*opts.values)[k];
+      state.found = false;
+      FetchOptions fetch_opts;
+      fetch_opts.stats = opts.stats;
+      fetch_opts.file_index = opts.file_index;
+      fetch_opts.tmp = NULL;
+      fetch_opts.tmp_length = 0;
+      fetch_opts.saver = SaveValue;
+      fetch_opts.arg = &state;
+      status = FetchFromTable(fetch_opts, keys[k], h);
+      if (!status.ok()) {
+        break;
+      } else if (state.found) {
+        (*opts.found)[k] = 1;
+      }
+    }
+    return status;
+  }
+
+  // Load the index block
+  BlockContents index_contents;
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  Cache::Handle* cache_handle;
+  status =
+      LoadBlock(indx_, index_handle, &index_contents, &cache_handle, true);
+  if (!status.ok()) {
+    return status;
+  } else {
+    opts.stats->table_seeks++;
+  }
+
+  // Map each key to the data block that may contain it
+  std::vector<BlockRequest> reqs;
+  Block* index_block = new Block(index_contents);
+  Iterator* const iter = index_block->NewIterator(BytewiseComparator());
+  for (size_t i = 0; i < cands.size(); i++) {
+    iter->Seek(keys[cands[i]]);
+    if (!iter->Valid()) {
+      break;  // All remaining keys are larger than the table's keys
+    }
+    BlockHandle handle;
+    Slice input = iter->value();
+    status = handle.DecodeFrom(&input);
+    if (!status.ok()) {
+      break;
+    }
+    if (!reqs.empty() && reqs.back().handle.offset() == handle.offset()) {
+      reqs.back().end = i + 1;
+    } else {
+      BlockRequest req;
+      req.handle = handle;
+      req.begin = i;
+      req.end = i + 1;
+      reqs.push_back(req);
+    }
+  }
+  if (status.ok()) {
+    status = iter->status();
+  }
+  delete iter;
+  delete index_block;
+  ReleaseBlock(cache_handle);
+
+  if (status.ok() && !reqs.empty()) {
+    status = MultiFetchBlocks(opts, cands, &reqs[0], reqs.size());
+  }
+
+  return status;
+}
+
+// Obtain the values to a batch of keys within a given directory epoch.
+// MultiGetContext *ctx may be shared among multiple concurrent getter threads.
+// GetStats *stats is dedicated to the current thread.
+Status Dir::DoMultiGet(const BlockHandle& h, uint32_t epoch,
+                       MultiGetContext* ctx, std::vector<std::string>* values,
+                       GetStats* stats) {
+  Status status;
+  // Load the meta index for the epoch
+  BlockContents meta_index_contents;
+  Cache::Handle* cache_handle;
+  status = LoadBlock(indx_, h, &meta_index_contents, &cache_handle, true);
+  if (!status.ok()) {
+    return status;
+  }
+  const size_t num_keys = ctx->keys->size();
+  std::vector<char> found(num_keys, 0);
+  size_t num_found = 0;
+  Block* epoch_index_block = new Block(meta_index_contents);
+  Iterator* const iter = epoch_index_block->NewIterator(BytewiseComparator());
+  iter->SeekToFirst();
+  std::string epoch_table_key;
+  uint32_t table = 0;
+  for (; status.ok(); table++) {
+    epoch_table_key = EpochTableKey(epoch, table);
+    // Try reusing current iterator position if possible
+    if (!iter->Valid() || iter->key() != epoch_table_key) {
+      iter->Seek(epoch_table_key);
+      if (!iter->Valid()) {
+        break;  // EOF
+      } else if (iter->key() != epoch_table_key) {
+        break;  // No such table
+      }
+    }
+    TableHandle table_handle;
+    Slice input = iter->value();
+    status = table_handle.DecodeFrom(&input);
+    iter->Next();
+    if (status.ok()) {
+      MultiFetchOptions opts;
+      if (options_.epoch_log_rotation) {
+        opts.file_index = epoch;
+      } else {
+        opts.file_index = 0;
+      }
+      opts.stats = stats;
+      opts.keys = ctx->keys;
+      opts.values = values;
+      opts.found = &found;
+      status = MultiFetch(opts, table_handle);
+      // Each epoch is stored as a set of tables. Once all keys are
+      // found and we know keys are unique, we are done.
+      if (status.ok() && IsKeyUnique(options_.mode)) {
+        num_found = static_cast<size_t>(
+            std::count(found.begin(), found.end(), static_cast<char>(1)));
+        if (num_found == num_keys) {
+          break;
+        }
+      }
+    }
+  }
+
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  delete epoch_index_block;
+  ReleaseBlock(cache_handle);
+  return status;
+}
+
+void Dir::MultiGet(uint32_t epoch, MultiGetContext* ctx,
+                   std::vector<std::string>* values) {
+  ctx->mu->AssertHeld();
+  if (!ctx->status->ok()) {
+    return;
+  }
+  Iterator* const rt_iter = NewRtIterator(rt_);
+  ctx->mu->Unlock();
+  GetStats stats;
+  stats.table_seeks = 0;  // Number of tables touched
+  // Number of data blocks fetched
+  stats.seeks = 0;
+  Status status;
+  std::string epoch_key = EpochKey(epoch);
+  rt_iter->Seek(epoch_key);
+  if (rt_iter->Valid() && rt_iter->key() == epoch_key) {
+    BlockHandle h;
+    Slice input = rt_iter->value();
+    status = h.DecodeFrom(&input);
+    if (status.ok()) {
+      status = DoMultiGet(h, epoch, ctx, values, &stats);
+    }
+  }
+
+  if (status.ok()) {
+    status = rt_iter->status();
+  }
+
+  delete rt_iter;
+  ctx->mu->Lock();
+  // Increase the total seek count
+  ctx->num_table_seeks += stats.table_seeks;
+  ctx->num_seeks += stats.seeks;
+  assert(ctx->num_open_reads > 0);
+  ctx->num_open_reads--;
+  ctx->cv->SignalAll();
+  if (ctx->status->ok()) {
+    *ctx->status = status;
+  }
+}
+
+void Dir::BGMultiGet(void* arg) {
+  BGMultiGetItem* item = reinterpret_cast<BGMultiGetItem*>(arg);
+  MutexLock ml(item->ctx->mu);
+  item->dir->MultiGet(item->epoch, item->ctx, &item->values);
+}
+
+namespace {
+struct KeyLessThan {
+  const std::vector<Slice>* keys;
+  explicit KeyLessThan(const std::vector<Slice>* k) : keys(k) {}
+  bool operator()(size_t a, size_t b) const { return (*keys)[a] < (*keys)[b]; }
+};
+}  // namespace
+
+// Obtain values to a batch of keys within a given epoch range.
+// Return OK on success, or a non-OK status on errors.
+Status Dir::MultiRead(const ReadOptions& opts, const std::vector<Slice>& keys,
+                      std::string** dsts, ReadStats* stats) {
+  Status status;
+  assert(rt_ != NULL);
+  // Sort keys so that keys sharing a table or a data block are adjacent
+  std::vector<size_t> order(keys.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), KeyLessThan(&keys));
+  std::vector<Slice> sorted_keys(keys.size());
+  for (size_t i = 0; i < order.size(); i++) sorted_keys[i] = keys[order[i]];
+
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  MutexLock ml(&mu);
+
+  MultiGetContext ctx;
+  ctx.mu = &mu;
+  ctx.cv = &cv;
+  ctx.keys = &sorted_keys;
+  ctx.num_open_reads = 0;  // Number of outstanding epoch read operations
+  ctx.status = &status;
+  ctx.num_table_seeks = 0;  // Total number of tables touched
+  // Total number of data blocks fetched
+  ctx.num_seeks = 0;
+  uint32_t epoch = opts.epoch_start;
+  uint32_t epoch_end = std::min(num_eps_, opts.epoch_end);
+  // Each epoch gets its own result buffers so that results
+  // can be merged in epoch order
+  std::vector<BGMultiGetItem> items(epoch < epoch_end ? epoch_end - epoch : 0);
+  for (size_t i = 0; i < items.size(); i++, epoch++) {
+    BGMultiGetItem* const item = &items[i];
+    item->epoch = epoch;
+    item->dir = this;
+    item->ctx = &ctx;
+    item->values.resize(sorted_keys.size());
+    ctx.num_open_reads++;
+    if (opts.force_serial_reads || !options_.parallel_reads) {
+      MultiGet(item->epoch, item->ctx, &item->values);
+    } else if (options_.reader_pool != NULL) {
+      options_.reader_pool->Schedule(Dir::BGMultiGet, item);
+    } else if (options_.allow_env_threads) {
+      Env::Default()->Schedule(Dir::BGMultiGet, item);
+    } else {
+      MultiGet(item->epoch, item->ctx, &item->values);
+    }
+    if (!status.ok()) {
+      break;
+    }
+  }
+
+  // Wait for all outstanding read operations to conclude
+  while (ctx.num_open_reads > 0) {
+    cv.Wait();
+  }
+
+  if (status.ok()) {
+    if (stats != NULL) {
+      stats->total_table_seeks += ctx.num_table_seeks;
+      stats->total_seeks += ctx.num_seeks;
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+      const std::vector<std::string>& values = items[i].values;
+      for (size_t j = 0; j < values.size(); j++) {
+        dsts[order[j]]->append(values[j]);
+      }
+    }
+  }
+
+  return status;
+}
+
 Dir::ScanOptions::ScanOptions()
     : force_serial_reads(false),
       epoch_start(0),
@@ -1675,13 +2964,14 @@ Dir::ReadOptions::ReadOptions()
 Dir::CountOptions::CountOptions()
     : epoch_start(0), epoch_end(~static_cast<uint32_t>(0)) {}
 
-Dir::Dir(const DirOptions& options, port::Mutex* mu, port::CondVar* bg_cv)
+Dir::Dir(const DirOptions& options, port::Mutex* mu)
     : options_(options),
       num_eps_(0),
       data_(NULL),
       indx_(NULL),
+      cache_(NULL),
+      part_(0),
       mu_(mu),
-      bg_cv_(bg_cv),
       rt_(NULL),
       refs_(0) {}
 
@@ -1692,6 +2982,19 @@ Dir::~Dir() {
   delete rt_;
 }
 
+uint64_t Dir::index_memory() const {
+  if (indx_ == NULL || options_.index_cache_size != 0) {
+    return 0;
+  } else {
+    return indx_->TotalSize();
+  }
+}
+
+void Dir::InstallBlockCache(BlockCache* cache, uint32_t part) {
+  cache_ = cache;
+  part_ = part;
+}
+
 void Dir::InstallDataSource(LogSource* data) {
   if (data != data_) {
     if (data_ != NULL) data_->Unref();
@@ -1752,7 +3055,8 @@ Status Dir::Open(LogSource* indx) {
 
   BlockContents contents;
   const BlockHandle& handle = footer.epoch_index_handle();
-  status = ReadBlock(indx, options_, handle, &contents, true);
+  const bool cached = options_.index_cache_size == 0;
+  status = ReadBlock(indx, options_, handle, &contents, cached);
   if (!status.ok()) {
     return status;
   }
@@ -17,29 +17,42 @@
 #include "recov.h"
 #include "types.h"
 
+#include "pdlfs-common/cache.h"
 #include "pdlfs-common/env_files.h"
 #include "pdlfs-common/port.h"
 
 #include <set>
 #include <string>
 #include <vector>
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
 
 namespace pdlfs {
 namespace plfsio {
 
 class BloomBlock;
 class CompactionList;
+struct KeyLocation;
 
 // Status for each epoch.
 class Epoch {
  public:
-  Epoch(uint32_t seq, port::Mutex*);
+  explicit Epoch(uint32_t seq);
   const uint32_t seq_;
-  port::CondVar cv_;
-  // Num of active Add(), Write(), or Flush() operations
+  // Num of active Add(), Write(), or Flush() operations. With C++11, writers
+  // register and retire without the writer's mutex by first updating the
+  // counter and then checking committing_, while committers set committing_
+  // before checking the counter. Otherwise, both are protected by the
+  // writer's mutex.
+#if __cplusplus >= 201103L
+  std::atomic<uint32_t> num_ongoing_ops_;
+  std::atomic<bool> committing_;  // No more writes
+#else
   uint32_t num_ongoing_ops_;
   bool committing_;  // No more writes
-  void Ref() { refs_++; }
+#endif
+  void Ref();
   void Unref();
 
  private:
@@ -49,7 +62,12 @@ class Epoch {
   void operator=(const Epoch&);
   Epoch(const Epoch&);
 
+#if __cplusplus >= 201103L
+  std::atomic<int> refs_;
+#else
+  port::Mutex mu_;
   int refs_;
+#endif
 };
 
 // Status for each compaction (memtable flush).
@@ -135,9 +153,14 @@ class WriteBuffer {
  private:
   friend class DirCompactor;
   struct STLLessThan;
+  class RadixSorter;
   // Estimated memory usage per entry (including overhead due to varint
   // encoding)
   size_t bytes_per_entry_;
+  // Pool for splitting large sorts. NULL if sorts are not split
+  ThreadPool* sort_pool_;
+  int sort_helpers_;
+  bool radix_sort_;
 
   // Starting offsets of inserted entries
   std::vector<uint32_t> offsets_;
@@ -179,11 +202,11 @@ class DirCompactor {
 
 // Write directory data as multiple runs of indexed tables.
 // Implementation is thread-safe and
-// uses background threads.
+// uses background threads. Each indexer is protected by its own
+// mutex so that different directory partitions can be written concurrently.
 class DirIndexer {
  public:
-  DirIndexer(const DirOptions& options, size_t part, port::Mutex* mu,
-             port::CondVar* cv);
+  DirIndexer(const DirOptions& options, size_t part);
 
   Status Open(LogSink* data, LogSink* indx);
   size_t memory_usage() const;  // Report actual memory usage
@@ -191,6 +214,7 @@ class DirIndexer {
   // REQUIRES: mutex_ has been locked
   bool has_bg_compaction();
   Status bg_status();  // Return latest compaction status
+  Status WaitForCompaction();
   // May trigger a new compaction
   Status Add(Epoch* epoch, const Slice& key, const Slice& value);
 
@@ -215,7 +239,7 @@ class DirIndexer {
   Status Flush(const FlushOptions& options, Epoch* epoch);
 
   // Sync and close all associated log sinks.
-  // REQUIRES: *mu_ has been locked and no on-going compactions.
+  // REQUIRES: mu_ has been locked and no on-going compactions.
   Status SyncAndClose();
 
   void Ref() { refs_++; }
@@ -265,8 +289,8 @@ class DirIndexer {
 
   // Constant after construction
   const DirOptions& options_;
-  port::CondVar* const bg_cv_;
-  port::Mutex* const mu_;
+  mutable port::Mutex mu_;
+  port::CondVar bg_cv_;
   size_t ft_bits_;
   size_t ft_bytes_;       // Target bloom filter size
   size_t buf_threshold_;  // Threshold for write buffer flush
@@ -293,9 +317,55 @@ class DirIndexer {
 };
 
 // Retrieve indexed data from log files.
+// A cache of fetched directory blocks shared by all partitions of a directory
+// reader. Blocks are keyed by (partition, block type, log rotation #, block
+// offset) and are always stored uncompressed. Implementation is thread-safe.
+class BlockCache {
+ public:
+  explicit BlockCache(size_t capacity);
+  ~BlockCache();
+
+  enum BlockType { kDataBlock = 0, kIndexBlock = 1 };
+
+  // Return a handle pinning the cached contents of a given block and store the
+  // contents in *result. Return NULL if the block is not in cache.
+  Cache::Handle* Lookup(uint32_t part, BlockType type, uint32_t file_index,
+                        uint64_t offset, Slice* result);
+
+  // Insert a heap-allocated block into the cache. The cache takes ownership of
+  // the block memory and returns a handle pinning it.
+  Cache::Handle* Insert(uint32_t part, BlockType type, uint32_t file_index,
+                        uint64_t offset, const Slice& contents);
+
+  // Release a handle returned by a previous Lookup() or Insert().
+  void Release(Cache::Handle* handle) { cache_->Release(handle); }
+
+  uint64_t hits() const { return static_cast<uint64_t>(hits_); }
+  uint64_t misses() const { return static_cast<uint64_t>(misses_); }
+
+ private:
+  // No copying allowed
+  void operator=(const BlockCache& cache);
+  BlockCache(const BlockCache&);
+
+  Cache* const cache_;
+#if __cplusplus >= 201103L
+  std::atomic_uint_fast64_t hits_;
+  std::atomic_uint_fast64_t misses_;
+#else
+  port::Mutex mu_;  // Protects the following counters
+  uint64_t hits_;
+  uint64_t misses_;
+#endif
+};
+
 class Dir {
  public:
-  Dir(const DirOptions& options, port::Mutex*, port::CondVar*);
+  // The given mutex only protects the reference count of the directory.
+  // Once opened, a directory is immutable and reads against it need no
+  // external synchronization: each read operation uses its own mutex to
+  // coordinate the background jobs it spawns.
+  Dir(const DirOptions& options, port::Mutex* mu);
 
   // Open a directory reader on top of a given directory index partition.
   // Return OK on success, or a non-OK status on errors.
@@ -334,6 +404,16 @@ class Dir {
   Status Read(const ReadOptions& opts, const Slice& key, std::string* dst,
               ReadStats* stats);
 
+  // Obtain the values to a batch of keys within a given epoch range. Values
+  // found for keys[i] are appended to *dsts[i] in epoch order. Keys are looked
+  // up together so that each epoch index, table index, and filter is loaded
+  // only once per batch, and data blocks needed by multiple keys are fetched
+  // only once. Adjacent data blocks are fetched using a single read. Read
+  // stats will be accumulated to "*stats". Return OK on success, or a non-OK
+  // status on errors.
+  Status MultiRead(const ReadOptions& opts, const std::vector<Slice>& keys,
+                   std::string** dsts, ReadStats* stats);
+
   // Iterate through all keys within a given epoch range. A caller may
   // optionally provide a temporary buffer for storing fetched block contents.
   // Read stats will be accumulated to "*stats". Return OK on success, or a
@@ -361,11 +441,41 @@ class Dir {
 
   Status Scan(const ScanOptions& opts, ScanStats* stats);
 
+  // Call "saver" for every key stored in the directory along with the epoch
+  // and the handle of the data block holding it. Epochs are visited in order.
+  // Used to build trajectory indexes (see traj.h).
+  // Return OK on success, or a non-OK status on errors.
+  typedef void (*LocationSaver)(void* arg, const Slice& key, uint32_t epoch,
+                                const BlockHandle& block);
+  Status ListLocations(LocationSaver saver, void* arg);
+
+  // Obtain the value to a key from a given list of data blocks as found by a
+  // trajectory index. Only blocks within the requested epoch range are
+  // read. No indexes or filters are consulted. Return OK on success, or a
+  // non-OK status on errors.
+  Status ReadLocations(const ReadOptions& opts, const Slice& key,
+                       const std::vector<KeyLocation>& locs, std::string* dst,
+                       ReadStats* stats);
+
   void InstallDataSource(LogSource* data);
 
-  void Ref() { refs_++; }
+  // Use a given block cache for subsequent reads. The cache is keyed by
+  // "part", which must be unique among all directories sharing it.
+  void InstallBlockCache(BlockCache* cache, uint32_t part);
+
+  // Return the size of the index log copy held in memory. Lazily loaded
+  // index logs are not held in memory and report 0.
+  uint64_t index_memory() const;
+
+  // REQUIRES: *mu_ has been locked.
+  void Ref() {
+    mu_->AssertHeld();
+    refs_++;
+  }
 
+  // REQUIRES: *mu_ has been locked.
   void Unref() {
+    mu_->AssertHeld();
     assert(refs_ > 0);
     refs_--;
     if (refs_ == 0) {
@@ -375,6 +485,7 @@ class Dir {
 
  private:
   SequentialFileStats io_stats_;
+  RandomAccessFileStats lazy_io_stats_;  // For lazily loaded index logs
   friend class DirReaderImpl;
   friend class DirReader;
   ~Dir();
@@ -396,6 +507,17 @@ class Dir {
     void* arg;
   };
 
+  // Read a block from a given log, consulting the block cache first if one is
+  // installed. If *handle is set to non-NULL on return, the block contents are
+  // pinned by the cache and the handle must be released via ReleaseBlock()
+  // once the contents are no longer needed. Otherwise, the caller owns the
+  // contents as indicated by result->heap_allocated.
+  Status LoadBlock(LogSource* source, const BlockHandle& h,
+                   BlockContents* result, Cache::Handle** handle,
+                   bool cached = false, uint32_t file_index = 0,
+                   char* tmp = NULL, size_t tmp_length = 0);
+  void ReleaseBlock(Cache::Handle* handle);
+
   // Obtain the value to a specific key from a given table data block.
   // If key is found, "opts.saver" will be called and *found is set to true. In
   // addition, *exhausted is set to true if any key larger than the given one is
@@ -405,7 +527,14 @@ class Dir {
                bool* found, bool* exhausted);
 
   // Return true if the given key matches a specific filter block.
-  bool KeyMayMatch(const Slice& key, const BlockHandle& h);
+  bool KeyMayMatch(const Slice& key, const BlockHandle& h,
+                   std::vector<uint32_t>* blocks = NULL);
+
+  // Return true if the given key may exist within an epoch according to
+  // the epoch's filter block. The tables that may hold the key are stored
+  // in *tables, which is left empty if they are unknown.
+  bool EpochKeyMayMatch(const Slice& key, const EpochHandle& h,
+                        std::vector<uint32_t>* tables);
 
   // Obtain the value to a specific key from a given table.
   // If key is found, "opts.saver" will be called.
@@ -413,6 +542,10 @@ class Dir {
   // Return OK on success, or a non-OK status on errors.
   Status Fetch(const FetchOptions& opts, const Slice& key,
                const TableHandle& h);
+  Status FetchFromTable(const FetchOptions& opts, const Slice& key,
+                        const TableHandle& h);
+  Status FetchFromBlocks(const FetchOptions& opts, const Slice& key,
+                         const TableHandle& h, std::vector<uint32_t>* blocks);
 
   // Obtain the value to a specific key within a given directory epoch.
   // GetContext may be shared among multiple concurrent getters.
@@ -421,6 +554,8 @@ class Dir {
   // Store an OK status in *ctx->status on success, or a non-OK status on
   // errors.
   struct GetContext {
+    port::Mutex* mu;    // Protects the context
+    port::CondVar* cv;  // Signaled when a getter finishes
     Iterator* rt_iter;  // Only used in serial reads
     std::string* dst;
     int num_open_reads;
@@ -440,7 +575,7 @@ class Dir {
     // Total data blocks fetched for a certain epoch
     size_t seeks;
   };
-  Status DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
+  Status DoGet(const Slice& key, const EpochHandle& h, uint32_t epoch,
                GetContext* ctx, GetStats* stats);
 
   // Merge results from concurrent getters.
@@ -454,6 +589,57 @@ class Dir {
   };
   static void BGGet(void*);
 
+  // Obtain the values to a batch of keys within a given directory epoch.
+  // MultiGetContext may be shared among multiple concurrent getters, each
+  // working on a different epoch. Values found for keys[i] are appended to
+  // values[i], which is dedicated to the epoch.
+  struct MultiGetContext {
+    port::Mutex* mu;    // Protects the context
+    port::CondVar* cv;  // Signaled when a getter finishes
+    const std::vector<Slice>* keys;  // Sorted
+    int num_open_reads;
+    Status* status;
+    size_t num_table_seeks;  // Total number of tables touched
+    // Total number of data blocks fetched
+    size_t num_seeks;
+  };
+  void MultiGet(uint32_t epoch, MultiGetContext* ctx,
+                std::vector<std::string>* values);
+  Status DoMultiGet(const BlockHandle& h, uint32_t epoch, MultiGetContext* ctx,
+                    std::vector<std::string>* values, GetStats* stats);
+
+  struct MultiFetchOptions {
+    GetStats* stats;
+    // Log rotation #
+    uint32_t file_index;  // For data log only
+    const std::vector<Slice>* keys;  // Sorted
+    std::vector<std::string>* values;
+    // Non-zero for keys that have been found in the current epoch
+    std::vector<char>* found;
+  };
+
+  // Obtain the values to a batch of keys from a given table. Each table filter
+  // and index block is loaded only once for all keys.
+  Status MultiFetch(const MultiFetchOptions& opts, const TableHandle& h);
+
+  // Fetch a set of data blocks using a single batch of reads and search each
+  // block for its keys. Blocks adjacent in the data log share a read.
+  struct BlockRequest;
+  Status MultiFetchBlocks(const MultiFetchOptions& opts,
+                          const std::vector<size_t>& cands,
+                          const BlockRequest* reqs, size_t n);
+  Status SearchBlock(const MultiFetchOptions& opts,
+                     const std::vector<size_t>& cands, const BlockRequest& req,
+                     const BlockContents& contents);
+
+  struct BGMultiGetItem {
+    MultiGetContext* ctx;
+    uint32_t epoch;
+    Dir* dir;
+    std::vector<std::string> values;
+  };
+  static void BGMultiGet(void*);
+
   struct ListStats;
   struct IterOptions {
     ListStats* stats;
@@ -473,12 +659,20 @@ class Dir {
   // is encoded as *input. Return OK on success, or a non-OK status on errors.
   Status Iter(const IterOptions& opts, Slice* input);
 
+  // Iterate through all keys within a given table. The handle of each data
+  // block is stored in *block before the block is iterated.
+  // Return OK on success, or a non-OK status on errors.
+  Status ListLocations(const IterOptions& opts, const TableHandle& h,
+                       BlockHandle* block);
+
   // Iterate through all keys within a given table.
   // For each key obtained, "opts.saver" will be called to save the results.
   // Return OK on success, or a non-OK status on errors.
   Status Iter(const IterOptions& opts, const TableHandle& h);
 
   struct ListContext {
+    port::Mutex* mu;    // Protects the context
+    port::CondVar* cv;  // Signaled when a lister finishes
     Iterator* rt_iter;  // Only used in serial reads
     void* usr_cb;
     void* arg_cb;
@@ -521,9 +715,10 @@ class Dir {
   uint32_t num_eps_;
   LogSource* data_;
   LogSource* indx_;
+  BlockCache* cache_;  // NULL if no cache is used
+  uint32_t part_;
 
-  port::Mutex* mu_;
-  port::CondVar* bg_cv_;
+  port::Mutex* mu_;  // Protects refs_
   Block* rt_;
   int refs_;
 };
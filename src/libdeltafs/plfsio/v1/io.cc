@@ -15,9 +15,12 @@
 #include "format.h"
 #include "types.h"
 
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/strutil.h"
 
 #include <algorithm>
+#include <string.h>
 #include <vector>
 
 namespace pdlfs {
@@ -357,11 +360,447 @@ LogSource::LogOptions::LogOptions()
       sub_partition(-1),
       num_rotas(-1),
       type(kDefIoType),
+      page_cache(NULL),
       seq_stats(NULL),
       stats(NULL),
       io_size(4096),
+      readahead_size(0),
+      readahead_depth(4),
+      readahead_buffer(32 << 20),
+      readahead_pool(NULL),
       env(Env::Default()) {}
 
+// A cached log page.
+struct LogPageCache::Page {
+  LogPageCache* owner;
+  Slice contents;  // Heap-allocated
+};
+
+LogPageCache::LogPageCache(size_t capacity, size_t page_size)
+    : cache_(NewLRUCache(capacity)), page_size_(page_size), usage_(0) {
+  assert(page_size_ != 0);
+}
+
+LogPageCache::~LogPageCache() { delete cache_; }
+
+size_t LogPageCache::memory_usage() const {
+  MutexLock ml(&mu_);
+  return usage_;
+}
+
+void LogPageCache::DeletePage(const Slice& key, void* value) {
+  Page* const page = reinterpret_cast<Page*>(value);
+  {
+    MutexLock ml(&page->owner->mu_);
+    page->owner->usage_ -= page->contents.size();
+  }
+  delete[] page->contents.data();
+  delete page;
+}
+
+// Read a file in fixed-size pages kept in a shared LogPageCache. Data is
+// always copied into the caller's scratch buffer so that pages may be evicted
+// at any time.
+class PagedRandomAccessFile : public RandomAccessFile {
+ public:
+  // Takes ownership of *base.
+  PagedRandomAccessFile(RandomAccessFile* base, uint64_t size,
+                        LogPageCache* cache)
+      : base_(base),
+        size_(size),
+        cache_(cache),
+        id_(cache->cache_->NewId()) {}
+
+  virtual ~PagedRandomAccessFile() { delete base_; }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    assert(scratch != NULL);
+    Status status;
+    const size_t page_size = cache_->page_size_;
+    if (offset >= size_) {
+      n = 0;
+    } else if (n > size_ - offset) {
+      n = static_cast<size_t>(size_ - offset);
+    }
+    size_t done = 0;
+    while (done < n && status.ok()) {
+      const uint64_t off = offset + done;
+      const uint64_t page_no = off / page_size;
+      Cache::Handle* h = NULL;
+      status = LoadPage(page_no, &h);
+      if (status.ok()) {
+        const Slice& page =
+            reinterpret_cast<LogPageCache::Page*>(cache_->cache_->Value(h))
+                ->contents;
+        const size_t start = static_cast<size_t>(off - page_no * page_size);
+        const size_t len = std::min(n - done, page.size() - start);
+        memcpy(scratch + done, page.data() + start, len);
+        done += len;
+        cache_->cache_->Release(h);
+      }
+    }
+    if (status.ok()) {
+      *result = Slice(scratch, done);
+    }
+    return status;
+  }
+
+ private:
+  Status LoadPage(uint64_t page_no, Cache::Handle** h) const {
+    char tmp[16];
+    EncodeFixed64(tmp, id_);
+    EncodeFixed64(tmp + 8, page_no);
+    const Slice key(tmp, sizeof(tmp));
+    *h = cache_->cache_->Lookup(key);
+    if (*h != NULL) {
+      return Status::OK();
+    }
+    const uint64_t off = page_no * cache_->page_size_;
+    const size_t len = static_cast<size_t>(
+        std::min<uint64_t>(cache_->page_size_, size_ - off));
+    char* const buf = new char[len];
+    Slice contents;
+    Status status = base_->Read(off, len, &contents, buf);
+    if (status.ok() && contents.size() != len) {
+      status = Status::Corruption("Truncated page read");
+    }
+    if (!status.ok()) {
+      delete[] buf;
+      return status;
+    }
+    if (contents.data() != buf) {
+      memcpy(buf, contents.data(), len);
+    }
+    LogPageCache::Page* const page = new LogPageCache::Page;
+    page->owner = cache_;
+    page->contents = Slice(buf, len);
+    {
+      MutexLock ml(&cache_->mu_);
+      cache_->usage_ += len;
+    }
+    *h = cache_->cache_->Insert(key, page, len, LogPageCache::DeletePage);
+    return status;
+  }
+
+  RandomAccessFile* const base_;
+  const uint64_t size_;
+  LogPageCache* const cache_;
+  const uint64_t id_;
+};
+
+// Serve sequential reads from a bounded ring of fixed-size windows read ahead
+// of the reader. A read is considered sequential if it starts shortly after
+// the end of a recent read (blocks may be padded) or falls into a window
+// already held in memory. Other reads are
+// passed to the base file directly. Windows are read by a background pool if
+// one is given, or by the first reader that needs them otherwise. Data is
+// always copied into the caller's scratch buffer. Thread-safe.
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+ public:
+  // Takes ownership of *base.
+  ReadaheadRandomAccessFile(RandomAccessFile* base, uint64_t size,
+                            const LogSource::LogOptions& opts)
+      : base_(base),
+        size_(size),
+        window_size_(opts.readahead_size),
+        depth_(std::max(opts.readahead_depth, 0)),
+        pool_(opts.readahead_pool),
+        cv_(&mu_),
+        slots_(std::max<size_t>(opts.readahead_buffer / window_size_, 1)),
+        clock_(0),
+        num_pending_(0) {
+    assert(window_size_ != 0);
+    memset(ends_, 0, sizeof(ends_));
+  }
+
+  virtual ~ReadaheadRandomAccessFile() {
+    {
+      MutexLock ml(&mu_);
+      while (num_pending_ != 0) {
+        cv_.Wait();
+      }
+    }
+    for (size_t i = 0; i < slots_.size(); i++) {
+      delete[] slots_[i].buf;
+    }
+    delete base_;
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (offset >= size_) {
+      n = 0;
+    } else if (n > size_ - offset) {
+      n = static_cast<size_t>(size_ - offset);
+    }
+    if (n == 0 || scratch == NULL) {
+      return base_->Read(offset, n, result, scratch);
+    }
+    MutexLock ml(&mu_);
+    const bool sequential = IsSequential(offset);
+    RecordEnd(offset, offset + n);
+    if (!sequential) {
+      mu_.Unlock();
+      Status status = base_->Read(offset, n, result, scratch);
+      mu_.Lock();
+      return status;
+    }
+    Status status;
+    size_t done = 0;
+    while (done < n && status.ok()) {
+      const uint64_t off = offset + done;
+      const uint64_t window = off / window_size_;
+      Slot* const slot = Acquire(window);
+      for (int i = 1; i <= depth_ && pool_ != NULL; i++) {
+        Prefetch(window + i);
+      }
+      if (slot == NULL) {  // No free slots
+        mu_.Unlock();
+        Slice contents;
+        status = base_->Read(off, n - done, &contents, scratch + done);
+        mu_.Lock();
+        if (status.ok()) {
+          if (contents.data() != scratch + done) {
+            memcpy(scratch + done, contents.data(), contents.size());
+          }
+          done += contents.size();
+        }
+        break;
+      }
+      while (slot->pending) {
+        cv_.Wait();
+      }
+      status = slot->status;
+      if (status.ok()) {
+        const size_t start = static_cast<size_t>(off - window * window_size_);
+        const size_t len =
+            std::min(n - done, slot->len > start ? slot->len - start : 0);
+        mu_.Unlock();
+        memcpy(scratch + done, slot->buf + start, len);
+        mu_.Lock();
+        done += len;
+        if (len == 0) {
+          status = Status::Corruption("Truncated read-ahead");
+        }
+      }
+      Release(slot);
+    }
+    if (status.ok()) {
+      *result = Slice(scratch, done);
+    }
+    return status;
+  }
+
+ private:
+  struct Slot {
+    Slot()
+        : window(0), buf(NULL), len(0), valid(false), pending(false),
+          used(false), refs(0), last_use(0) {}
+    uint64_t window;
+    char* buf;  // Lazily allocated
+    size_t len;
+    bool valid;    // True if the slot has been assigned a window
+    bool pending;  // True if the window is being read
+    bool used;     // True if a reader has used the window
+    int refs;      // Readers copying data out of the slot
+    uint64_t last_use;
+    Status status;
+  };
+
+  struct PrefetchItem {
+    const ReadaheadRandomAccessFile* file;
+    Slot* slot;
+  };
+
+  enum { kNumStreams = 8 };  // Number of recent reads tracked
+
+  // Return true if a read at a given offset continues a recent read.
+  bool Continues(int i, uint64_t offset) const {
+    return ends_[i] != 0 && offset >= ends_[i] &&
+           offset - ends_[i] < window_size_;
+  }
+
+  // REQUIRES: mu_ has been locked.
+  bool IsSequential(uint64_t offset) const {
+    mu_.AssertHeld();
+    for (int i = 0; i < kNumStreams; i++) {
+      if (Continues(i, offset)) {
+        return true;
+      }
+    }
+    return Find(offset / window_size_) != NULL;
+  }
+
+  // Remember the end of a read. The read continues the stream it follows if
+  // there is one, or replaces the least recently continued stream.
+  // REQUIRES: mu_ has been locked.
+  void RecordEnd(uint64_t offset, uint64_t end) const {
+    mu_.AssertHeld();
+    int i = 0;
+    while (i < kNumStreams - 1 && !Continues(i, offset)) {
+      i++;
+    }
+    memmove(ends_ + 1, ends_, i * sizeof(ends_[0]));
+    ends_[0] = end;
+  }
+
+  // REQUIRES: mu_ has been locked.
+  Slot* Find(uint64_t window) const {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (slots_[i].valid && slots_[i].window == window) {
+        return &slots_[i];
+      }
+    }
+    return NULL;
+  }
+
+  // Return true if slot a is a better victim than slot b. Empty slots go
+  // first, followed by windows already used, followed by windows read ahead
+  // but not yet used. Ties are broken by recency.
+  static bool Better(const Slot* a, const Slot* b) {
+    if (a->valid != b->valid) return !a->valid;
+    if (a->used != b->used) return a->used;
+    return a->last_use < b->last_use;
+  }
+
+  // Pick a slot that is not in use. Windows read ahead but not yet used are
+  // only picked for demand reads. Return NULL if no slot can be picked.
+  // REQUIRES: mu_ has been locked.
+  Slot* Victim(bool demand) const {
+    Slot* result = NULL;
+    for (size_t i = 0; i < slots_.size(); i++) {
+      Slot* const s = &slots_[i];
+      if (s->pending || s->refs != 0) continue;
+      if (!demand && s->valid && !s->used) continue;
+      if (result == NULL || Better(s, result)) {
+        result = s;
+      }
+    }
+    return result;
+  }
+
+  // Assign a window to a free slot and mark it pending. Return NULL if no
+  // slot is free. REQUIRES: mu_ has been locked.
+  Slot* Assign(uint64_t window, bool demand) const {
+    Slot* const s = Victim(demand);
+    if (s != NULL) {
+      s->window = window;
+      s->valid = true;
+      s->pending = true;
+      s->used = false;
+      s->status = Status::OK();
+      s->len = 0;
+      s->last_use = ++clock_;
+      if (s->buf == NULL) {
+        s->buf = new char[window_size_];
+      }
+      num_pending_++;
+    }
+    return s;
+  }
+
+  // Obtain a referenced slot holding a given window, reading the window
+  // if necessary. Return NULL if no slot is free.
+  // REQUIRES: mu_ has been locked.
+  Slot* Acquire(uint64_t window) const {
+    Slot* s = Find(window);
+    if (s == NULL) {
+      s = Assign(window, true);
+      if (s != NULL && pool_ == NULL) {
+        s->refs++;
+        s->used = true;
+        Fill(s);
+        return s;
+      } else if (s != NULL) {
+        Schedule(s);
+      }
+    }
+    if (s != NULL) {
+      s->refs++;
+      s->used = true;
+      s->last_use = ++clock_;
+    }
+    return s;
+  }
+
+  // REQUIRES: mu_ has been locked.
+  void Release(Slot* s) const {
+    assert(s->refs > 0);
+    s->refs--;
+    // Failed windows are not kept so that later reads retry them
+    if (s->refs == 0 && !s->pending && !s->status.ok()) {
+      s->valid = false;
+    }
+  }
+
+  // Start reading a window in the background unless it is already held in
+  // memory or beyond the end of the file. REQUIRES: mu_ has been locked.
+  void Prefetch(uint64_t window) const {
+    if (window * window_size_ >= size_ || Find(window) != NULL) {
+      return;
+    }
+    Slot* const s = Assign(window, false);
+    if (s != NULL) {
+      Schedule(s);
+    }
+  }
+
+  // REQUIRES: mu_ has been locked.
+  void Schedule(Slot* s) const {
+    PrefetchItem* const item = new PrefetchItem;
+    item->file = this;
+    item->slot = s;
+    pool_->Schedule(BGFill, item);
+  }
+
+  static void BGFill(void* arg) {
+    PrefetchItem* const item = reinterpret_cast<PrefetchItem*>(arg);
+    const ReadaheadRandomAccessFile* const f = item->file;
+    MutexLock ml(&f->mu_);
+    f->Fill(item->slot);
+    delete item;
+  }
+
+  // Read the window assigned to a given slot. Unlocks mu_ during the read.
+  // REQUIRES: mu_ has been locked.
+  void Fill(Slot* s) const {
+    mu_.AssertHeld();
+    assert(s->pending);
+    const uint64_t off = s->window * window_size_;
+    const size_t len = static_cast<size_t>(
+        std::min<uint64_t>(window_size_, size_ - off));
+    mu_.Unlock();
+    Slice contents;
+    Status status = base_->Read(off, len, &contents, s->buf);
+    if (status.ok() && contents.data() != s->buf) {
+      memcpy(s->buf, contents.data(), contents.size());
+    }
+    mu_.Lock();
+    s->status = status;
+    s->len = status.ok() ? contents.size() : 0;
+    s->pending = false;
+    if (s->refs == 0 && !status.ok()) {
+      s->valid = false;
+    }
+    assert(num_pending_ > 0);
+    num_pending_--;
+    cv_.SignalAll();
+  }
+
+  RandomAccessFile* const base_;
+  const uint64_t size_;
+  const size_t window_size_;
+  const int depth_;
+  ThreadPool* const pool_;
+  mutable port::Mutex mu_;
+  mutable port::CondVar cv_;  // Signaled when a window has been read
+  mutable std::vector<Slot> slots_;
+  mutable uint64_t ends_[kNumStreams];  // Ends of recent reads
+  mutable uint64_t clock_;
+  mutable int num_pending_;
+};
+
 static Status OpenWithEagerSeqReads(
     const std::string& filename, size_t io_size, Env* env,
     SequentialFileStats* stats,
@@ -427,14 +866,25 @@ static Status RandomAccessOpen(
   return status;
 }
 
-// Eagerly pre-fetch the entire file data in case of index logs.
-// Return OK on success, or a non-OK status on errors.
+// Index logs are read on demand through a page cache if one is given.
+// Otherwise, the entire file data is eagerly pre-fetched in case of index
+// logs. Return OK on success, or a non-OK status on errors.
 static Status TryOpenIt(
     const std::string& f, const LogSource::LogOptions& opts,
     std::vector<std::pair<RandomAccessFile*, uint64_t> >* r) {
-  if (opts.type == kIdxIoType)
+  if (opts.type == kIdxIoType && opts.page_cache == NULL)
     return OpenWithEagerSeqReads(f, opts.io_size, opts.env, opts.seq_stats, r);
-  return RandomAccessOpen(f, opts.env, opts.stats, r);
+  Status status = RandomAccessOpen(f, opts.env, opts.stats, r);
+  if (status.ok() && opts.type == kIdxIoType) {
+    std::pair<RandomAccessFile*, uint64_t>* const last = &r->back();
+    last->first =
+        new PagedRandomAccessFile(last->first, last->second, opts.page_cache);
+  } else if (status.ok() && opts.readahead_size != 0) {
+    std::pair<RandomAccessFile*, uint64_t>* const last = &r->back();
+    last->first =
+        new ReadaheadRandomAccessFile(last->first, last->second, opts);
+  }
+  return status;
 }
 
 Status LogSource::Open(const LogOptions& opts, const std::string& prefix,
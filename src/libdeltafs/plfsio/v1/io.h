@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include "pdlfs-common/cache.h"
 #include "pdlfs-common/env.h"
 #include "pdlfs-common/env_files.h"
 #include "pdlfs-common/port.h"
@@ -214,6 +215,33 @@ class LogSink {
   uint32_t refs_;
 };
 
+// A bounded cache of fixed-size log pages. Shared by all index logs that are
+// read on demand so that their total memory usage is capped. Thread-safe.
+class LogPageCache {
+ public:
+  LogPageCache(size_t capacity, size_t page_size);
+  ~LogPageCache();
+
+  size_t page_size() const { return page_size_; }
+
+  // Return the total size of all pages currently held in memory.
+  size_t memory_usage() const;
+
+ private:
+  friend class PagedRandomAccessFile;
+  static void DeletePage(const Slice& key, void* value);
+  struct Page;
+
+  // No copying allowed
+  void operator=(const LogPageCache& cache);
+  LogPageCache(const LogPageCache&);
+
+  Cache* const cache_;
+  const size_t page_size_;
+  mutable port::Mutex mu_;
+  size_t usage_;  // Protected by mu_
+};
+
 // Abstraction for reading data from a log file, which may
 // consist of several pieces due to log rotation.
 class LogSource {
@@ -235,9 +263,14 @@ class LogSource {
 
     // Type of the log.
     // For index logs, the entire log data will be eagerly fetched
-    // and cached in memory
+    // and cached in memory unless a page cache is specified
     LogType type;
 
+    // If not NULL, index logs are read on demand through this cache instead
+    // of being fetched in full. Callers must then always supply a scratch
+    // buffer to Read().
+    LogPageCache* page_cache;
+
     // For i/o stats monitoring (sequential reads)
     SequentialFileStats* seq_stats;
 
@@ -247,6 +280,21 @@ class LogSource {
     // Bulk read size
     size_t io_size;
 
+    // If not 0, sequential reads against data logs are served from windows
+    // of this size prefetched ahead of the reader. Windows are aligned to
+    // their size. Set to 0 to disable read-ahead.
+    size_t readahead_size;
+
+    // Max number of windows prefetched ahead of a sequential reader
+    int readahead_depth;
+
+    // Total memory for prefetched windows of each log file
+    size_t readahead_buffer;
+
+    // Thread pool for issuing prefetch reads. If NULL, each window is read
+    // by the reader that first needs it
+    ThreadPool* readahead_pool;
+
     // Low-level storage abstraction
     Env* env;
   };
@@ -268,6 +316,24 @@ class LogSource {
     return status;
   }
 
+  // Perform a batch of reads against a given file. The result and the status
+  // of each read are stored in its request. Return OK if all reads succeeded,
+  // or the status of the first failed read otherwise.
+  Status ReadMulti(RandomAccessFile::ReadRequest* reqs, size_t n,
+                   size_t index = 0) {
+    Status status;
+    if (index < num_files_) {
+      RandomAccessFile* const f = files_[index].first;
+      status = f->ReadMulti(reqs, n);
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        reqs[i].result = Slice();  // Return empty data
+        reqs[i].status = Status::OK();
+      }
+    }
+    return status;
+  }
+
   // Return the size of a given file
   uint64_t Size(size_t index = 0) const {
     if (index < num_files_) {
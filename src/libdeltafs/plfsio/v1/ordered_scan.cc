@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2020 Carnegie Mellon University,
+ * Copyright (c) 2020 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "ordered_scan.h"
+#include "coding_float.h"
+
+#include "pdlfs-common/port.h"
+
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define PLFSIO_SCAN_SSE2
+#include <emmintrin.h>
+#if __GNUC__ >= 5 || defined(__clang__)
+#define PLFSIO_SCAN_AVX
+#include <immintrin.h>
+#endif
+#endif
+
+namespace pdlfs {
+namespace plfsio {
+
+namespace {
+
+inline float KeyAt(const char* keys, size_t i) {
+  return DecodeFloat32(keys + i * sizeof(float));
+}
+
+//
+// binary search keys[lo..hi-1] until at most "window" keys remain.
+// the bound is then within [*lo, *hi].
+//
+inline void Narrow(const char* keys, size_t* lo, size_t* hi, float target,
+                   bool upper, size_t window) {
+  while (*hi - *lo > window) {
+    size_t mid = *lo + (*hi - *lo) / 2;
+    float key = KeyAt(keys, mid);
+    if (key < target || (upper && key == target)) {
+      *lo = mid + 1;
+    } else {
+      *hi = mid;
+    }
+  }
+}
+
+inline bool Match(float key, float lo, float hi, bool hi_inclusive) {
+  return key >= lo && (key < hi || (hi_inclusive && key == hi));
+}
+
+bool SortedSW(const char* keys, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    if (KeyAt(keys, i - 1) > KeyAt(keys, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t BoundSW(const char* keys, size_t n, float target, bool upper) {
+  size_t lo = 0;
+  size_t hi = n;
+  Narrow(keys, &lo, &hi, target, upper, 0);
+  return lo;
+}
+
+size_t FilterSW(const char* keys, size_t n, float lo, float hi,
+                bool hi_inclusive, uint32_t* result) {
+  size_t r = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (Match(KeyAt(keys, i), lo, hi, hi_inclusive)) {
+      result[r++] = static_cast<uint32_t>(i);
+    }
+  }
+  return r;
+}
+
+const KeyColumnOps kScalarOps = {"scalar", SortedSW, BoundSW, FilterSW};
+
+#if defined(PLFSIO_SCAN_SSE2)
+// keys are little-endian encoded, so on x86 they can be loaded as is.
+// binary search stops at this many keys and finishes with a vector count.
+const size_t kLinearWindow = 64;
+
+inline __m128 Load4(const char* keys, size_t i) {
+  return _mm_loadu_ps(reinterpret_cast<const float*>(keys) + i);
+}
+
+bool SortedSSE2(const char* keys, size_t n) {
+  size_t i = 0;
+  for (; i + 5 <= n; i += 4) {
+    __m128 gt = _mm_cmpgt_ps(Load4(keys, i), Load4(keys, i + 1));
+    if (_mm_movemask_ps(gt) != 0) {
+      return false;
+    }
+  }
+  for (i = (i != 0 ? i : 1); i < n; i++) {
+    if (KeyAt(keys, i - 1) > KeyAt(keys, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// within a sorted window, the number of keys before the bound is the
+// offset of the bound
+size_t BoundSSE2(const char* keys, size_t n, float target, bool upper) {
+  size_t lo = 0;
+  size_t hi = n;
+  Narrow(keys, &lo, &hi, target, upper, kLinearWindow);
+  const __m128 t = _mm_set1_ps(target);
+  size_t count = 0;
+  size_t i = lo;
+  for (; i + 4 <= hi; i += 4) {
+    __m128 k = Load4(keys, i);
+    __m128 m = upper ? _mm_cmple_ps(k, t) : _mm_cmplt_ps(k, t);
+    count += __builtin_popcount(_mm_movemask_ps(m));
+  }
+  for (; i < hi; i++) {
+    float key = KeyAt(keys, i);
+    count += key < target || (upper && key == target);
+  }
+  return lo + count;
+}
+
+size_t FilterSSE2(const char* keys, size_t n, float lo, float hi,
+                  bool hi_inclusive, uint32_t* result) {
+  const __m128 l = _mm_set1_ps(lo);
+  const __m128 h = _mm_set1_ps(hi);
+  size_t r = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 k = Load4(keys, i);
+    __m128 m = _mm_and_ps(_mm_cmpge_ps(k, l), hi_inclusive
+                                                  ? _mm_cmple_ps(k, h)
+                                                  : _mm_cmplt_ps(k, h));
+    int bits = _mm_movemask_ps(m);
+    while (bits != 0) {
+      result[r++] = static_cast<uint32_t>(i + __builtin_ctz(bits));
+      bits &= bits - 1;
+    }
+  }
+  for (; i < n; i++) {
+    if (Match(KeyAt(keys, i), lo, hi, hi_inclusive)) {
+      result[r++] = static_cast<uint32_t>(i);
+    }
+  }
+  return r;
+}
+
+const KeyColumnOps kSSE2Ops = {"sse2", SortedSSE2, BoundSSE2, FilterSSE2};
+#endif
+
+#if defined(PLFSIO_SCAN_AVX)
+#define PLFSIO_AVX __attribute__((target("avx")))
+
+PLFSIO_AVX inline __m256 Load8(const char* keys, size_t i) {
+  return _mm256_loadu_ps(reinterpret_cast<const float*>(keys) + i);
+}
+
+PLFSIO_AVX bool SortedAVX(const char* keys, size_t n) {
+  size_t i = 0;
+  for (; i + 9 <= n; i += 8) {
+    __m256 gt = _mm256_cmp_ps(Load8(keys, i), Load8(keys, i + 1), _CMP_GT_OQ);
+    if (_mm256_movemask_ps(gt) != 0) {
+      return false;
+    }
+  }
+  for (i = (i != 0 ? i : 1); i < n; i++) {
+    if (KeyAt(keys, i - 1) > KeyAt(keys, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+PLFSIO_AVX size_t BoundAVX(const char* keys, size_t n, float target,
+                           bool upper) {
+  size_t lo = 0;
+  size_t hi = n;
+  Narrow(keys, &lo, &hi, target, upper, kLinearWindow);
+  const __m256 t = _mm256_set1_ps(target);
+  size_t count = 0;
+  size_t i = lo;
+  for (; i + 8 <= hi; i += 8) {
+    __m256 k = Load8(keys, i);
+    __m256 m = upper ? _mm256_cmp_ps(k, t, _CMP_LE_OQ)
+                     : _mm256_cmp_ps(k, t, _CMP_LT_OQ);
+    count += __builtin_popcount(_mm256_movemask_ps(m));
+  }
+  for (; i < hi; i++) {
+    float key = KeyAt(keys, i);
+    count += key < target || (upper && key == target);
+  }
+  return lo + count;
+}
+
+PLFSIO_AVX size_t FilterAVX(const char* keys, size_t n, float lo, float hi,
+                            bool hi_inclusive, uint32_t* result) {
+  const __m256 l = _mm256_set1_ps(lo);
+  const __m256 h = _mm256_set1_ps(hi);
+  size_t r = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 k = Load8(keys, i);
+    __m256 m = _mm256_and_ps(_mm256_cmp_ps(k, l, _CMP_GE_OQ),
+                             hi_inclusive ? _mm256_cmp_ps(k, h, _CMP_LE_OQ)
+                                          : _mm256_cmp_ps(k, h, _CMP_LT_OQ));
+    int bits = _mm256_movemask_ps(m);
+    while (bits != 0) {
+      result[r++] = static_cast<uint32_t>(i + __builtin_ctz(bits));
+      bits &= bits - 1;
+    }
+  }
+  for (; i < n; i++) {
+    if (Match(KeyAt(keys, i), lo, hi, hi_inclusive)) {
+      result[r++] = static_cast<uint32_t>(i);
+    }
+  }
+  return r;
+}
+
+#undef PLFSIO_AVX
+
+const KeyColumnOps kAVXOps = {"avx", SortedAVX, BoundAVX, FilterAVX};
+#endif
+
+const KeyColumnOps* ChooseOps() {
+  if (!port::kLittleEndian) {
+    return &kScalarOps;
+  }
+#if defined(PLFSIO_SCAN_AVX)
+  if (__builtin_cpu_supports("avx")) {
+    return &kAVXOps;
+  }
+#endif
+#if defined(PLFSIO_SCAN_SSE2)
+  return &kSSE2Ops;
+#else
+  return &kScalarOps;
+#endif
+}
+
+}  // namespace
+
+const KeyColumnOps* KeyColumnOps::Default() {
+  static const KeyColumnOps* const ops = ChooseOps();
+  return ops;
+}
+
+const KeyColumnOps* KeyColumnOps::Scalar() { return &kScalarOps; }
+
+}  // namespace plfsio
+}  // namespace pdlfs
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2020 Carnegie Mellon University,
+ * Copyright (c) 2020 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace pdlfs {
+namespace plfsio {
+
+//
+// kernels for searching and filtering the key column of a block written
+// by an OrderedBlockBuilder.  such a block stores all its keys as a
+// contiguous column of 4-byte encoded floats (see coding_float.h)
+// followed by the column of values, so keys can be compared several at
+// a time without touching the values.  Default() picks the widest
+// vector implementation the cpu supports at runtime (AVX, then SSE2)
+// and falls back to a scalar implementation elsewhere.  all
+// implementations return identical results.
+//
+struct KeyColumnOps {
+  const char* name;  // "avx", "sse2", or "scalar"
+
+  //
+  // return true iff keys[0..n-1] are in non-descending order.
+  //
+  bool (*sorted)(const char* keys, size_t n);
+
+  //
+  // return the index of the first key >= target, or > target if
+  // upper is true.  return n if there is no such key.
+  // REQUIRES: keys are sorted.
+  //
+  size_t (*bound)(const char* keys, size_t n, float target, bool upper);
+
+  //
+  // store the indexes of all keys within [lo, hi), or [lo, hi] if
+  // hi_inclusive is true, in result[] in ascending order.  return
+  // the number of indexes stored.  result[] must have room for n.
+  //
+  size_t (*filter)(const char* keys, size_t n, float lo, float hi,
+                   bool hi_inclusive, uint32_t* result);
+
+  static const KeyColumnOps* Default();
+  static const KeyColumnOps* Scalar();
+};
+
+}  // namespace plfsio
+}  // namespace pdlfs
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2020 Carnegie Mellon University,
+ * Copyright (c) 2020 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "range_reader.h"
+#include "coding_float.h"
+#include "ordered_scan.h"
+
+#include "pdlfs-common/mutexlock.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace pdlfs {
+namespace plfsio {
+
+namespace {
+
+//
+// on-disk sizes.  see PartitionManifestWriter and RangeWriter::Finish()
+// in range_writer.cc for the format.
+//
+const size_t kFileFooterSize = 16;      // key size + value size
+const size_t kManifestFooterSize = 12;  // num epochs + manifest size
+const size_t kEpochHeaderSize = 12;     // epoch number + epoch data size
+const size_t kManifestItemSize = 44;    // per block
+
+//
+// a cursor over the matching entries of a fetched block.  "order" is
+// only used for blocks that were written unsorted (skip_sort), in which
+// case it lists the matching entries in key order.
+//
+struct Run {
+  const char* keys;
+  const char* vals;
+  size_t pos;
+  size_t end;
+  std::vector<uint32_t> order;
+  uint32_t seq;                 // block sequence in write order
+
+  size_t index() const { return order.empty() ? pos : order[pos]; }
+  float key() const { return DecodeFloat32(keys + index() * sizeof(float)); }
+};
+
+// orders runs for a min-heap.  ties are broken by write order.
+struct RunGreater {
+  bool operator()(const Run* a, const Run* b) const {
+    float ka = a->key();
+    float kb = b->key();
+    if (ka != kb) return ka > kb;
+    return a->seq > b->seq;
+  }
+};
+
+// orders the entries of an unsorted block by key, stable in write order.
+struct EntryLess {
+  explicit EntryLess(const char* k) : keys(k) {}
+  bool operator()(uint32_t a, uint32_t b) const {
+    return DecodeFloat32(keys + a * sizeof(float)) <
+           DecodeFloat32(keys + b * sizeof(float));
+  }
+  const char* keys;
+};
+
+int SaveValue(void* arg, const Slice& key, const Slice& value) {
+  std::string* dst = reinterpret_cast<std::string*>(arg);
+  dst->append(value.data(), value.size());
+  return 0;
+}
+
+}  // namespace
+
+struct RangeReader::QueryContext {
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int num_open_reads;
+  Status* status;
+};
+
+struct RangeReader::BlockRead {
+  RangeReader* reader;
+  QueryContext* ctx;
+  const BlockInfo* info;
+  std::string buf;
+  Slice contents;
+};
+
+RangeReader::RangeReader(const DirOptions& options, RandomAccessFile* src,
+                         uint64_t src_sz)
+    : options_(options),
+      src_(src),
+      src_sz_(src_sz),
+      manifest_loaded_(false),
+      num_blocks_fetched_(0),
+      value_size_(0) {}
+
+RangeReader::~RangeReader() {}
+
+//
+// load the manifest once.  a failed load is remembered and returned
+// to all later calls.
+//
+Status RangeReader::MaybeLoadManifest() {
+  MutexLock ml(&mu_);
+  if (!manifest_loaded_) {
+    manifest_status_ = LoadManifest();
+    manifest_loaded_ = true;
+  }
+  return manifest_status_;
+}
+
+//
+// read the footers and the manifest at the end of src_.  lock held.
+//
+Status RangeReader::LoadManifest() {
+  mu_.AssertHeld();
+  const size_t tail_sz = kManifestFooterSize + kFileFooterSize;
+  if (src_sz_ < tail_sz) {
+    return Status::Corruption("Input file too short for a footer");
+  }
+
+  std::string tail_stor;
+  tail_stor.resize(tail_sz);
+  Slice tail;
+  Status status = src_->Read(src_sz_ - tail_sz, tail_sz, &tail, &tail_stor[0]);
+  if (status.ok() && tail.size() != tail_sz) {
+    status = Status::IOError("Read ret partial data");
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  const uint32_t num_epochs = DecodeFixed32(tail.data());
+  const uint64_t manifest_sz = DecodeFixed64(tail.data() + 4);
+  const uint64_t key_size = DecodeFixed64(tail.data() + 12);
+  const uint64_t value_size = DecodeFixed64(tail.data() + 20);
+  if (key_size != sizeof(float)) {
+    return Status::Corruption("Keys are not floats");
+  } else if (manifest_sz > src_sz_ - tail_sz) {
+    return Status::Corruption("Bad manifest size");
+  }
+  const uint64_t manifest_off = src_sz_ - tail_sz - manifest_sz;
+
+  std::string manifest_stor;
+  manifest_stor.resize(manifest_sz);
+  Slice input;
+  status = src_->Read(manifest_off, manifest_sz, &input, &manifest_stor[0]);
+  if (status.ok() && input.size() != manifest_sz) {
+    status = Status::IOError("Read ret partial data");
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  const size_t entry_sz = sizeof(float) + value_size;
+  std::vector<std::vector<BlockInfo> > epochs;
+  while (input.size() >= kEpochHeaderSize) {
+    const uint64_t epoch_sz = DecodeFixed64(input.data() + 4);
+    input.remove_prefix(kEpochHeaderSize);
+    if (epoch_sz > input.size() || epoch_sz % kManifestItemSize != 0) {
+      return Status::Corruption("Bad manifest epoch size");
+    }
+    epochs.resize(epochs.size() + 1);
+    std::vector<BlockInfo>* const blocks = &epochs.back();
+    for (uint64_t i = 0; i < epoch_sz; i += kManifestItemSize) {
+      const char* p = input.data() + i;
+      BlockInfo info;
+      info.offset = DecodeFixed64(p + 8);
+      // skip the expected range (p + 16, p + 20) and the update count
+      info.smallest = DecodeFloat32(p + 24);
+      info.largest = DecodeFloat32(p + 28);
+      info.num_items = DecodeFixed32(p + 36);
+      if (info.offset + info.num_items * entry_sz > manifest_off) {
+        return Status::Corruption("Block out of bounds");
+      }
+      blocks->push_back(info);
+    }
+    input.remove_prefix(epoch_sz);
+  }
+
+  if (!input.empty() || epochs.size() != num_epochs) {
+    return Status::Corruption("Bad manifest");
+  }
+
+  value_size_ = value_size;
+  epochs_.swap(epochs);
+  return status;
+}
+
+void RangeReader::BGRead(void* arg) {
+  BlockRead* item = reinterpret_cast<BlockRead*>(arg);
+  item->reader->Read(item);
+}
+
+//
+// fetch a block into item->contents.  lock not held.
+//
+void RangeReader::Read(BlockRead* item) {
+  const size_t n = item->info->num_items * (sizeof(float) + value_size_);
+  item->buf.resize(n);
+  Status s = src_->Read(item->info->offset, n, &item->contents, &item->buf[0]);
+  if (s.ok() && item->contents.size() != n) {
+    s = Status::IOError("Read ret partial data");
+  }
+
+  QueryContext* const ctx = item->ctx;
+  MutexLock ml(ctx->mu);
+  if (ctx->status->ok() && !s.ok()) {
+    *ctx->status = s;
+  }
+  assert(ctx->num_open_reads > 0);
+  ctx->num_open_reads--;
+  ctx->cv->SignalAll();
+}
+
+Status RangeReader::Query(int type, float rmin, float rmax, int epoch,
+                          Saver saver, void* arg, size_t* n) {
+  *n = 0;
+  Status status = MaybeLoadManifest();
+  if (!status.ok()) {
+    return status;
+  }
+
+  // prune blocks using their observed ranges.  observed ranges are
+  // inclusive at both ends.
+  std::vector<const BlockInfo*> blocks;
+  for (size_t e = 0; e < epochs_.size(); e++) {
+    if (epoch >= 0 && size_t(epoch) != e) continue;
+    for (size_t i = 0; i < epochs_[e].size(); i++) {
+      const BlockInfo* const info = &epochs_[e][i];
+      if (info->num_items == 0) continue;
+      if (type == kQueryRange &&
+          (info->smallest >= rmax || info->largest < rmin)) {
+        continue;
+      } else if (type == kQueryPoint &&
+                 (info->smallest > rmin || info->largest < rmin)) {
+        continue;
+      }
+      blocks.push_back(info);
+    }
+  }
+
+  if (blocks.empty()) {
+    return status;
+  }
+
+  // fetch all candidate blocks, in parallel if permitted.  items must
+  // stay alive until background reads are done with them.
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  QueryContext ctx;
+  ctx.mu = &mu;
+  ctx.cv = &cv;
+  ctx.num_open_reads = static_cast<int>(blocks.size());
+  ctx.status = &status;
+  std::vector<BlockRead> items(blocks.size());
+  for (size_t i = 0; i < blocks.size(); i++) {
+    BlockRead* const item = &items[i];
+    item->reader = this;
+    item->ctx = &ctx;
+    item->info = blocks[i];
+    if (!options_.parallel_reads || blocks.size() == 1) {
+      Read(item);
+    } else if (options_.reader_pool != NULL) {
+      options_.reader_pool->Schedule(RangeReader::BGRead, item);
+    } else if (options_.allow_env_threads) {
+      Env::Default()->Schedule(RangeReader::BGRead, item);
+    } else {
+      Read(item);
+    }
+  }
+
+  {
+    MutexLock ml(&mu);
+    while (ctx.num_open_reads > 0) {
+      cv.Wait();
+    }
+  }
+
+  {
+    MutexLock ml(&mu_);
+    num_blocks_fetched_ += blocks.size();
+  }
+
+  if (!status.ok()) {
+    return status;
+  }
+
+  // locate the matching entries of each block
+  std::vector<Run> runs(items.size());
+  std::priority_queue<Run*, std::vector<Run*>, RunGreater> heap;
+  const KeyColumnOps* const ops = KeyColumnOps::Default();
+  for (size_t i = 0; i < items.size(); i++) {
+    Run* const run = &runs[i];
+    const size_t cnt = items[i].info->num_items;
+    run->keys = items[i].contents.data();
+    run->vals = run->keys + cnt * sizeof(float);
+    run->seq = static_cast<uint32_t>(i);
+    if (ops->sorted(run->keys, cnt)) {
+      run->pos = 0;
+      run->end = cnt;
+      if (type == kQueryRange) {
+        run->pos = ops->bound(run->keys, cnt, rmin, false);
+        run->end = ops->bound(run->keys, cnt, rmax, false);
+      } else if (type == kQueryPoint) {
+        run->pos = ops->bound(run->keys, cnt, rmin, false);
+        run->end = ops->bound(run->keys, cnt, rmin, true);
+      }
+    } else {
+      run->order.resize(cnt);
+      size_t m = cnt;
+      if (type == kQueryAll) {
+        for (size_t j = 0; j < cnt; j++) {
+          run->order[j] = static_cast<uint32_t>(j);
+        }
+      } else if (cnt != 0) {
+        m = ops->filter(run->keys, cnt, rmin, type == kQueryPoint ? rmin : rmax,
+                        type == kQueryPoint, &run->order[0]);
+      }
+      run->order.resize(m);
+      std::stable_sort(run->order.begin(), run->order.end(),
+                       EntryLess(run->keys));
+      run->pos = 0;
+      run->end = run->order.size();
+    }
+    if (run->pos < run->end) {
+      heap.push(run);
+    }
+  }
+
+  // k-way merge
+  while (!heap.empty()) {
+    Run* const run = heap.top();
+    heap.pop();
+    const size_t idx = run->index();
+    (*n)++;
+    if (saver(arg, Slice(run->keys + idx * sizeof(float), sizeof(float)),
+              Slice(run->vals + idx * value_size_, value_size_)) == -1) {
+      break;
+    }
+    run->pos++;
+    if (run->pos < run->end) {
+      heap.push(run);
+    }
+  }
+
+  return status;
+}
+
+Status RangeReader::RangeQuery(float rmin, float rmax, int epoch, Saver saver,
+                               void* arg, size_t* n) {
+  return Query(kQueryRange, rmin, rmax, epoch, saver, arg, n);
+}
+
+Status RangeReader::Scan(int epoch, Saver saver, void* arg, size_t* n) {
+  return Query(kQueryAll, 0, 0, epoch, saver, arg, n);
+}
+
+Status RangeReader::Get(const Slice& key, int epoch, std::string* dst) {
+  if (key.size() != sizeof(float)) {
+    return Status::InvalidArgument("Keys must be floats");
+  }
+  size_t n;
+  return Query(kQueryPoint, DecodeFloat32(key.data()), 0, epoch, SaveValue,
+               dst, &n);
+}
+
+Status RangeReader::Count(int epoch, size_t* n) {
+  *n = 0;
+  Status status = MaybeLoadManifest();
+  if (status.ok()) {
+    for (size_t e = 0; e < epochs_.size(); e++) {
+      if (epoch >= 0 && size_t(epoch) != e) continue;
+      for (size_t i = 0; i < epochs_[e].size(); i++) {
+        *n += epochs_[e][i].num_items;
+      }
+    }
+  }
+  return status;
+}
+
+uint64_t RangeReader::TEST_num_blocks_fetched() {
+  MutexLock ml(&mu_);
+  return num_blocks_fetched_;
+}
+
+}  // namespace plfsio
+}  // namespace pdlfs
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020 Carnegie Mellon University,
+ * Copyright (c) 2020 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "types.h"
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/port.h"
+
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+namespace plfsio {
+
+//
+// a range reader reads back the contents of a file written by a
+// RangeWriter.  such a file is a sequence of sorted float-keyed blocks
+// (each block holds all its keys followed by all its values) followed
+// by a per-epoch manifest of the blocks and a footer.  the manifest
+// is loaded on first use.  range queries only fetch blocks whose
+// observed key range overlaps the query range.  blocks are fetched
+// in parallel when parallel_reads is set and then k-way merged so
+// that results are reported in key order.  a range reader may be
+// shared by multiple threads.
+//
+class RangeReader {
+ public:
+  //
+  // the dir options carry the reader thread pool.  key and value
+  // sizes are taken from the file's footer.  we don't own src.
+  //
+  RangeReader(const DirOptions& options, RandomAccessFile* src,
+              uint64_t src_sz);
+  ~RangeReader();
+
+  //
+  // callback for query results.  the key is the 4-byte encoded float.
+  // the callback may return -1 to stop the query early.
+  //
+  typedef int (*Saver)(void* arg, const Slice& key, const Slice& value);
+
+  //
+  // report all k/v pairs with rmin <= key < rmax at a given epoch,
+  // or all epochs if epoch is -1, in key order.  entries with equal
+  // keys are reported in the order they were written.  store the
+  // number of entries reported in *n.
+  //
+  Status RangeQuery(float rmin, float rmax, int epoch, Saver saver, void* arg,
+                    size_t* n);
+
+  //
+  // report all k/v pairs at a given epoch, or all epochs if epoch is -1,
+  // in key order.  store the number of entries reported in *n.
+  //
+  Status Scan(int epoch, Saver saver, void* arg, size_t* n);
+
+  //
+  // append the values of all entries matching a 4-byte float key
+  // at a given epoch, or all epochs if epoch is -1, to *dst.
+  //
+  Status Get(const Slice& key, int epoch, std::string* dst);
+
+  //
+  // count the number of entries at a given epoch, or all epochs if
+  // epoch is -1.  only needs the manifest.
+  //
+  Status Count(int epoch, size_t* n);
+
+  //
+  // number of data blocks fetched so far.  for testing.
+  //
+  uint64_t TEST_num_blocks_fetched();
+
+ private:
+  struct BlockInfo {            // a manifest entry
+    uint64_t offset;            // byte offset of the block in src_
+    float smallest;             // observed min key
+    float largest;              // observed max key
+    uint32_t num_items;         // number of entries in the block
+  };
+
+  struct QueryContext;
+  struct BlockRead;
+
+  const DirOptions& options_;
+  RandomAccessFile* const src_;
+  const uint64_t src_sz_;
+
+  port::Mutex mu_;                             // protects fields below
+  Status manifest_status_;                     // OK if manifest is ready
+  bool manifest_loaded_;
+  uint64_t num_blocks_fetched_;
+  // immutable once the manifest is loaded
+  size_t value_size_;                          // from the file footer
+  std::vector<std::vector<BlockInfo> > epochs_;  // blocks of each epoch
+
+  Status MaybeLoadManifest();
+  Status LoadManifest();
+
+  //
+  // query blocks at a given epoch (or all epochs).  type is one of
+  // kQueryAll (rmin and rmax are ignored), kQueryRange (rmin <= key < rmax),
+  // and kQueryPoint (key == rmin, rmax is ignored).
+  //
+  enum { kQueryAll, kQueryRange, kQueryPoint };
+  Status Query(int type, float rmin, float rmax, int epoch, Saver saver,
+               void* arg, size_t* n);
+
+  static void BGRead(void* arg);
+  void Read(BlockRead* item);
+
+  // No copying allowed
+  void operator=(const RangeReader& other);
+  RangeReader(const RangeReader&);
+};
+
+}  // namespace plfsio
+}  // namespace pdlfs
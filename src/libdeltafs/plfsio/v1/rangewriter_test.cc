@@ -9,6 +9,9 @@
  * found in the LICENSE file. See the AUTHORS file for names of contributors.
  */
 
+#include "coding_float.h"
+#include "ordered_scan.h"
+#include "range_reader.h"
 #include "range_writer.h"
 #include "types.h"
 
@@ -17,6 +20,9 @@
 #include "pdlfs-common/testutil.h"
 #include "pdlfs-common/xxhash.h"
 
+#include <algorithm>
+#include <vector>
+
 #if __cplusplus >= 201103
 #define OVERRIDE override
 #else
@@ -67,6 +73,252 @@ class EmulatedEnv : public EnvWrapper {
 
 }  // namespace
 
+class RangeReaderTest {
+ public:
+  RangeReaderTest() {
+    fname_ = test::TmpDir() + "/rangereader_test.tbl";
+    options_.key_size = 4;
+    options_.value_size = 8;
+    options_.allow_env_threads = false;
+    options_.env = Env::Default();
+    writer_ = NULL;
+    dst_ = NULL;
+    reader_ = NULL;
+    src_ = NULL;
+  }
+
+  ~RangeReaderTest() {
+    delete writer_;
+    delete dst_;
+    delete reader_;
+    delete src_;
+  }
+
+  void OpenWriter(size_t compact_threshold) {
+    ASSERT_OK(options_.env->NewWritableFile(fname_.c_str(), &dst_));
+    writer_ = new RangeWriter(options_, dst_, 2, 2, compact_threshold);
+  }
+
+  static std::string Value(int i, int epoch) {
+    char tmp[20];
+    snprintf(tmp, sizeof(tmp), "%06d-%d", i, epoch);
+    return std::string(tmp, 8);
+  }
+
+  void Add(float key, const std::string& value) {
+    char tmp[4];
+    EncodeFloat32(tmp, key);
+    ASSERT_OK(writer_->Add(Slice(tmp, sizeof(tmp)), value));
+  }
+
+  void Finish() {
+    ASSERT_OK(writer_->Finish());
+    delete writer_;
+    writer_ = NULL;
+    delete dst_;
+    dst_ = NULL;
+  }
+
+  void OpenReader() {
+    delete reader_;
+    delete src_;
+    uint64_t src_sz;
+    ASSERT_OK(options_.env->GetFileSize(fname_.c_str(), &src_sz));
+    ASSERT_OK(options_.env->NewRandomAccessFile(fname_.c_str(), &src_));
+    reader_ = new RangeReader(options_, src_, src_sz);
+  }
+
+  struct Result {
+    std::vector<float> keys;
+    std::string values;
+  };
+
+  static int SaveResult(void* arg, const Slice& key, const Slice& value) {
+    Result* r = reinterpret_cast<Result*>(arg);
+    r->keys.push_back(DecodeFloat32(key.data()));
+    r->values.append(value.data(), value.size());
+    return 0;
+  }
+
+  Result RangeQuery(float rmin, float rmax, int epoch) {
+    Result r;
+    size_t n;
+    ASSERT_OK(reader_->RangeQuery(rmin, rmax, epoch, SaveResult, &r, &n));
+    ASSERT_EQ(n, r.keys.size());
+    for (size_t i = 0; i < r.keys.size(); i++) {
+      ASSERT_TRUE(r.keys[i] >= rmin && r.keys[i] < rmax);
+      if (i != 0) ASSERT_TRUE(r.keys[i - 1] <= r.keys[i]);
+    }
+    return r;
+  }
+
+  std::string Get(float key, int epoch) {
+    char tmp[4];
+    EncodeFloat32(tmp, key);
+    std::string dst;
+    ASSERT_OK(reader_->Get(Slice(tmp, sizeof(tmp)), epoch, &dst));
+    return dst;
+  }
+
+  size_t Count(int epoch) {
+    size_t n;
+    ASSERT_OK(reader_->Count(epoch, &n));
+    return n;
+  }
+
+  // epoch 0 holds keys 0, 0.5, ..., 99.5 and an out of bounds key
+  // 150.  epoch 1 holds keys 50, 51, ..., 149.  small blocks are used so
+  // that keys spread over many blocks.
+  void Populate() {
+    OpenWriter(16 * (options_.key_size + options_.value_size));
+    ASSERT_OK(writer_->UpdateBounds(0, 100));
+    for (int i = 199; i >= 0; i--) {
+      Add(i * 0.5f, Value(i, 0));
+    }
+    Add(150, Value(300, 0));
+    ASSERT_OK(writer_->EpochFlush());
+    ASSERT_OK(writer_->UpdateBounds(50, 150));
+    for (int i = 50; i < 150; i++) {
+      Add(float(i), Value(i, 1));
+    }
+    Finish();
+  }
+
+  // run all checks against the data written by Populate()
+  void CheckAll() {
+    ASSERT_EQ(Count(0), 201);
+    ASSERT_EQ(Count(1), 100);
+    ASSERT_EQ(Count(-1), 301);
+    ASSERT_EQ(Count(2), 0);
+    Result r = RangeQuery(10, 20, -1);
+    ASSERT_EQ(r.keys.size(), 20);
+    ASSERT_EQ(r.values.substr(0, 8), Value(20, 0));
+    const uint64_t before = reader_->TEST_num_blocks_fetched();
+    r = RangeQuery(60, 70, -1);
+    ASSERT_EQ(r.keys.size(), 30);
+    // equal keys are reported in write order
+    ASSERT_EQ(r.values.substr(0, 24), Value(120, 0) + Value(60, 1) +
+                                          Value(121, 0));
+    ASSERT_TRUE(reader_->TEST_num_blocks_fetched() - before < 301 / 16);
+    ASSERT_EQ(RangeQuery(60, 70, 1).keys.size(), 10);
+    ASSERT_EQ(RangeQuery(100, 200, 0).keys.size(), 1);
+    ASSERT_EQ(RangeQuery(1000, 2000, -1).keys.size(), 0);
+    ASSERT_EQ(Get(60, -1), Value(120, 0) + Value(60, 1));
+    ASSERT_EQ(Get(60, 1), Value(60, 1));
+    ASSERT_EQ(Get(150, -1), Value(300, 0));
+    ASSERT_TRUE(Get(60.25f, -1).empty());
+    Result all;
+    size_t n;
+    ASSERT_OK(reader_->Scan(-1, SaveResult, &all, &n));
+    ASSERT_EQ(n, 301);
+    for (size_t i = 1; i < all.keys.size(); i++) {
+      ASSERT_TRUE(all.keys[i - 1] <= all.keys[i]);
+    }
+  }
+
+  std::string fname_;
+  DirOptions options_;
+  RangeWriter* writer_;
+  WritableFile* dst_;
+  RangeReader* reader_;
+  RandomAccessFile* src_;
+};
+
+TEST(RangeReaderTest, Empty) {
+  OpenWriter(1 << 10);
+  Finish();
+  OpenReader();
+  ASSERT_EQ(Count(-1), 0);
+  ASSERT_EQ(RangeQuery(0, 100, -1).keys.size(), 0);
+}
+
+TEST(RangeReaderTest, RangeQuery) {
+  Populate();
+  OpenReader();
+  CheckAll();
+}
+
+TEST(RangeReaderTest, ParallelReads) {
+  Populate();
+  options_.parallel_reads = true;
+  options_.reader_pool = ThreadPool::NewFixed(4);
+  OpenReader();
+  CheckAll();
+  delete reader_;
+  reader_ = NULL;
+  delete options_.reader_pool;
+}
+
+TEST(RangeReaderTest, Unsorted) {
+  options_.skip_sort = true;
+  Populate();
+  OpenReader();
+  CheckAll();
+}
+
+// Checks the default key column kernels against the scalar ones.
+class KeyColumnTest {
+ public:
+  KeyColumnTest() : ops_(KeyColumnOps::Default()), rnd_(301) {}
+
+  // Fill n keys drawn from a small domain so there are many duplicates.
+  void Fill(size_t n, bool sorted) {
+    std::vector<float> keys;
+    for (size_t i = 0; i < n; i++) {
+      keys.push_back(static_cast<float>(rnd_.Uniform(n / 2 + 1)));
+    }
+    if (sorted) std::sort(keys.begin(), keys.end());
+    keys_.resize(n * sizeof(float));
+    for (size_t i = 0; i < n; i++) {
+      EncodeFloat32(&keys_[i * sizeof(float)], keys[i]);
+    }
+  }
+
+  void Check(size_t n, bool sorted) {
+    const KeyColumnOps* const sw = KeyColumnOps::Scalar();
+    const char* const k = keys_.data();
+    ASSERT_EQ(ops_->sorted(k, n), sw->sorted(k, n));
+    if (sorted) ASSERT_TRUE(ops_->sorted(k, n));
+    std::vector<uint32_t> r1(n + 1), r2(n + 1);
+    for (int t = -1; t <= static_cast<int>(n / 2) + 1; t++) {
+      const float target = t + (t % 3 == 0 ? 0.5f : 0.0f);
+      if (sorted) {
+        ASSERT_EQ(ops_->bound(k, n, target, false),
+                  sw->bound(k, n, target, false));
+        ASSERT_EQ(ops_->bound(k, n, target, true),
+                  sw->bound(k, n, target, true));
+      }
+      for (int incl = 0; incl < 2; incl++) {
+        size_t c1 = ops_->filter(k, n, target, target + 2, incl, &r1[0]);
+        size_t c2 = sw->filter(k, n, target, target + 2, incl, &r2[0]);
+        ASSERT_EQ(c1, c2);
+        for (size_t i = 0; i < c1; i++) {
+          ASSERT_EQ(r1[i], r2[i]);
+        }
+      }
+    }
+  }
+
+  const KeyColumnOps* ops_;
+  std::string keys_;
+  Random rnd_;
+};
+
+TEST(KeyColumnTest, SortedKeys) {
+  fprintf(stderr, "Using %s kernels\n", ops_->name);
+  for (size_t n = 0; n < 200; n += (n < 20 ? 1 : 13)) {
+    Fill(n, true);
+    Check(n, true);
+  }
+}
+
+TEST(KeyColumnTest, UnsortedKeys) {
+  for (size_t n = 2; n < 200; n += (n < 20 ? 1 : 13)) {
+    Fill(n, false);
+    Check(n, false);
+  }
+}
+
 // Measure implementation's bandwidth utilization under
 // different configurations.
 class RangeWriterBench {
@@ -196,6 +448,209 @@ class RangeWriterBench {
   int skip_sort_;
 };
 
+// Measure range query latency against a file written by a RangeWriter.
+class RangeQueryBench {
+  static int FromEnv(const char* key, int def) {
+    const char* env = getenv(key);
+    if (env && env[0]) {
+      return atoi(env);
+    } else {
+      return def;
+    }
+  }
+
+  static inline int GetOption(const char* key, int def) {
+    int opt = FromEnv(key, def);
+    fprintf(stderr, "%s=%d\n", key, opt);
+    return opt;
+  }
+
+  static inline float randf(float scale) { return rand() * scale / RAND_MAX; }
+
+  static int Discard(void* arg, const Slice& key, const Slice& value) {
+    return 0;
+  }
+
+ public:
+  RangeQueryBench() {
+    mkeys_ = GetOption("MI_KEYS", 1);
+    num_epochs_ = GetOption("NUM_EPOCHS", 4);
+    num_queries_ = GetOption("NUM_QUERIES", 1000);
+    width_ = GetOption("QUERY_WIDTH", 10);  // Per mille of the key space
+    buf_size_ = GetOption("BUF_SIZE", 1 << 20);
+    num_threads_ = GetOption("READ_THREADS", 4);  // 0 for serial reads
+    thread_pool_ =
+        num_threads_ ? ThreadPool::NewFixed(num_threads_, true) : NULL;
+
+    options_.key_size = 4;
+    options_.value_size = 56;
+    options_.allow_env_threads = false;
+    options_.env = Env::Default();
+    options_.reader_pool = thread_pool_;
+    options_.parallel_reads = thread_pool_ != NULL;
+  }
+
+  ~RangeQueryBench() {  //
+    if (thread_pool_) delete thread_pool_;
+  }
+
+  void LogAndApply() {
+    const std::string fname = test::TmpDir() + "/rangequery_bench.tbl";
+    Env* const env = options_.env;
+    WritableFile* dst = NULL;
+    ASSERT_OK(env->NewWritableFile(fname.c_str(), &dst));
+    RangeWriter* rdb = new RangeWriter(options_, dst, 4, 2, buf_size_);
+    char tmp[4];
+    Slice key(tmp, sizeof(tmp));
+    std::string val(options_.value_size, '\0');
+    const size_t num_keys = static_cast<size_t>(mkeys_) << 20;
+    srand(301);
+    for (int e = 0; e < num_epochs_; e++) {
+      ASSERT_OK(rdb->UpdateBounds(0, 1000));
+      for (size_t i = 0; i < num_keys / num_epochs_; i++) {
+        EncodeFloat32(tmp, randf(1000));
+        ASSERT_OK(rdb->Add(key, val));
+      }
+      ASSERT_OK(rdb->EpochFlush());
+    }
+    ASSERT_OK(rdb->Finish());
+    delete rdb;
+    delete dst;
+
+    uint64_t src_sz;
+    RandomAccessFile* src = NULL;
+    ASSERT_OK(env->GetFileSize(fname.c_str(), &src_sz));
+    ASSERT_OK(env->NewRandomAccessFile(fname.c_str(), &src));
+    RangeReader* reader = new RangeReader(options_, src, src_sz);
+    size_t n;
+    ASSERT_OK(reader->Count(-1, &n));  // Preload the manifest
+    std::vector<uint64_t> latencies;
+    size_t total_entries = 0;
+    const float width = 1000.0f * width_ / 1000;
+    for (int i = 0; i < num_queries_; i++) {
+      const float rmin = randf(1000 - width);
+      const uint64_t start = CurrentMicros();
+      ASSERT_OK(reader->RangeQuery(rmin, rmin + width, -1, Discard, NULL, &n));
+      latencies.push_back(CurrentMicros() - start);
+      total_entries += n;
+    }
+    Report(&latencies, total_entries, reader->TEST_num_blocks_fetched(),
+           src_sz);
+
+    delete reader;
+    delete src;
+    env->DeleteFile(fname.c_str());
+  }
+
+  void Report(std::vector<uint64_t>* latencies, size_t total_entries,
+              uint64_t total_blocks, uint64_t src_sz) {
+    std::sort(latencies->begin(), latencies->end());
+    uint64_t sum = 0;
+    for (size_t i = 0; i < latencies->size(); i++) sum += (*latencies)[i];
+    const size_t q = latencies->size();
+    const double ki = 1024.0;
+    fprintf(stderr, "-----------------------------------------\n");
+    fprintf(stderr, "      File size: %.3f MiB\n", src_sz / ki / ki);
+    fprintf(stderr, " Reader threads: %d\n", num_threads_);
+    fprintf(stderr, "    Avg latency: %.3f ms\n", 1.0 * sum / q / 1000);
+    fprintf(stderr, "    P50 latency: %.3f ms\n",
+            (*latencies)[q / 2] / 1000.0);
+    fprintf(stderr, "    P99 latency: %.3f ms\n",
+            (*latencies)[q * 99 / 100] / 1000.0);
+    fprintf(stderr, "    Max latency: %.3f ms\n", latencies->back() / 1000.0);
+    fprintf(stderr, "  Entries/query: %.1f\n", 1.0 * total_entries / q);
+    fprintf(stderr, "   Blocks/query: %.1f\n", 1.0 * total_blocks / q);
+  }
+
+ private:
+  ThreadPool* thread_pool_;
+  DirOptions options_;
+  size_t buf_size_;
+  int mkeys_;
+  int num_epochs_;
+  int num_queries_;
+  int width_;
+  int num_threads_;
+};
+
+// Measure the throughput of the key column kernels on in-memory blocks.
+class KeyScanBench {
+  static int FromEnv(const char* key, int def) {
+    const char* env = getenv(key);
+    if (env && env[0]) {
+      return atoi(env);
+    } else {
+      return def;
+    }
+  }
+
+  static inline int GetOption(const char* key, int def) {
+    int opt = FromEnv(key, def);
+    fprintf(stderr, "%s=%d\n", key, opt);
+    return opt;
+  }
+
+ public:
+  KeyScanBench() {
+    block_keys_ = GetOption("BLOCK_KEYS", 4096);
+    num_rounds_ = GetOption("NUM_ROUNDS", 20000);
+    width_ = GetOption("QUERY_WIDTH", 10);  // Per mille of the key space
+  }
+
+  void LogAndApply() {
+    std::vector<float> tmp;
+    Random rnd(301);
+    for (int i = 0; i < block_keys_; i++) {
+      tmp.push_back(rnd.Uniform(1000 * 1000) / 1000.0f);
+    }
+    std::string unsorted(block_keys_ * sizeof(float), 0);
+    for (int i = 0; i < block_keys_; i++) {
+      EncodeFloat32(&unsorted[i * sizeof(float)], tmp[i]);
+    }
+    std::sort(tmp.begin(), tmp.end());
+    std::string sorted(block_keys_ * sizeof(float), 0);
+    for (int i = 0; i < block_keys_; i++) {
+      EncodeFloat32(&sorted[i * sizeof(float)], tmp[i]);
+    }
+    const KeyColumnOps* ops[2];
+    ops[0] = KeyColumnOps::Scalar();
+    ops[1] = KeyColumnOps::Default();
+    const float width = 1000.0f * width_ / 1000;
+    std::vector<uint32_t> result(block_keys_);
+    fprintf(stderr, "-----------------------------------------\n");
+    for (int o = 0; o < 2; o++) {
+      size_t total = 0;
+      srand(301);
+      uint64_t start = CurrentMicros();
+      for (int i = 0; i < num_rounds_; i++) {
+        const float lo = rand() * (1000 - width) / RAND_MAX;
+        total += ops[o]->sorted(sorted.data(), block_keys_);
+        total += ops[o]->bound(sorted.data(), block_keys_, lo, false);
+        total += ops[o]->bound(sorted.data(), block_keys_, lo + width, false);
+      }
+      const uint64_t search = CurrentMicros() - start;
+      srand(301);
+      start = CurrentMicros();
+      for (int i = 0; i < num_rounds_; i++) {
+        const float lo = rand() * (1000 - width) / RAND_MAX;
+        total += ops[o]->filter(unsorted.data(), block_keys_, lo, lo + width,
+                                false, &result[0]);
+      }
+      const uint64_t filter = CurrentMicros() - start;
+      const double keys = 1.0 * block_keys_ * num_rounds_;
+      fprintf(stderr, "%8s search: %.3f us/block\n", ops[o]->name,
+              1.0 * search / num_rounds_);
+      fprintf(stderr, "%8s filter: %.3f Mkeys/s (%zu)\n", ops[o]->name,
+              keys / filter, total);
+    }
+  }
+
+ private:
+  int block_keys_;
+  int num_rounds_;
+  int width_;
+};
+
 }  // namespace plfsio
 }  // namespace pdlfs
 
@@ -208,7 +663,8 @@ class RangeWriterBench {
 
 namespace {
 void BM_Usage() {
-  fprintf(stderr, "Use --bench=rdb to run benchmark.\n");
+  fprintf(stderr, "Use --bench=rdb, --bench=rdb-query, or --bench=rdb-scan"
+                  " to run benchmark.\n");
   fprintf(stderr, "\n");
 }
 
@@ -229,6 +685,12 @@ void BM_Main(int* argc, char*** argv) {
   if (bench_name == "--bench=rdb") {
     pdlfs::plfsio::RangeWriterBench bench;
     bench.LogAndApply();
+  } else if (bench_name == "--bench=rdb-query") {
+    pdlfs::plfsio::RangeQueryBench bench;
+    bench.LogAndApply();
+  } else if (bench_name == "--bench=rdb-scan") {
+    pdlfs::plfsio::KeyScanBench bench;
+    bench.LogAndApply();
   } else {
     BM_Usage();
   }
@@ -47,6 +47,35 @@ Status LogWriter::Write(ChunkType chunk_type, const Slice& block_contents,
         compre_type = kNoCompression;
       }
       break;
+
+    case kZstdCompression:
+      if (port::Zstd_Compress(options_.compression_level,
+                              options_.compression_dict.data(),
+                              options_.compression_dict.size(),
+                              block_contents.data(), block_contents.size(),
+                              &compressed_) &&
+          (options_.force_compression ||
+           compressed_.size() <
+               block_contents.size() - (block_contents.size() / 8u))) {
+        raw_contents = compressed_;
+      } else {
+        raw_contents = block_contents;
+        compre_type = kNoCompression;
+      }
+      break;
+
+    case kLz4Compression:
+      if (port::Lz4_Compress(block_contents.data(), block_contents.size(),
+                             &compressed_) &&
+          (options_.force_compression ||
+           compressed_.size() <
+               block_contents.size() - (block_contents.size() / 8u))) {
+        raw_contents = compressed_;
+      } else {
+        raw_contents = block_contents;
+        compre_type = kNoCompression;
+      }
+      break;
   }
   status = LogRaw(chunk_type, compre_type, raw_contents, handle);
   compressed_.clear();
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020 Carnegie Mellon University,
+ * Copyright (c) 2020 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "traj.h"
+
+#include "pdlfs-common/leveldb/options.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace pdlfs {
+namespace plfsio {
+
+// A trajectory index file consists of a sequence of partitions followed by
+// the partition handles and a fixed-sized footer. Each partition is a
+// sequence of key blocks followed by an index block that maps the last key of
+// each key block to the block. All blocks carry a standard block trailer. Each
+// key is mapped to a list of (epoch, data block offset, data block size)
+// tuples, each encoded as 3 varints. The partition handles are a varint32
+// count followed by one encoded handle per partition and a masked crc32c.
+// The footer is the encoded handle to the partition handles, padded to
+// BlockHandle::kMaxEncodedLength, followed by a magic number.
+static const uint64_t kTrajectoryIndexMagic = 0x54524a4944583031ull;
+static const size_t kFooterLength = BlockHandle::kMaxEncodedLength + 8;
+
+TrajectoryIndexBuilder::TrajectoryIndexBuilder(const DirOptions& options,
+                                               WritableFile* dst)
+    : options_(options),
+      dst_(dst),
+      offset_(0),
+      data_block_(16),
+      index_block_(1),
+      finished_(false) {}
+
+TrajectoryIndexBuilder::~TrajectoryIndexBuilder() {}
+
+void TrajectoryIndexBuilder::Add(const Slice& key, uint32_t epoch,
+                                 const BlockHandle& block) {
+  assert(!finished_);
+  Locations* const locs = &keys_[key.ToString()];
+  // A key may appear multiple times within the same block
+  if (locs->epoch == epoch && locs->offset == block.offset()) {
+    return;
+  }
+  PutVarint32(&locs->encoding, epoch);
+  PutVarint64(&locs->encoding, block.offset());
+  PutVarint64(&locs->encoding, block.size());
+  locs->epoch = epoch;
+  locs->offset = block.offset();
+}
+
+// Finalize a block and append it to the destination file. Store the handle
+// of the block in *handle.
+Status TrajectoryIndexBuilder::WriteBlock(BlockBuilder* block,
+                                          BlockHandle* handle) {
+  block->Finish();
+  Slice contents = block->Finalize();
+  Status status = dst_->Append(contents);
+  if (status.ok()) {
+    handle->set_offset(offset_);
+    handle->set_size(contents.size() - kBlockTrailerSize);
+    offset_ += contents.size();
+  }
+  block->Reset();
+  return status;
+}
+
+Status TrajectoryIndexBuilder::EndPartition() {
+  assert(!finished_);
+  Status status;
+  std::string handle_encoding;
+  BlockHandle handle;
+  std::map<std::string, Locations>::iterator it = keys_.begin();
+  while (it != keys_.end() && status.ok()) {
+    data_block_.Add(it->first, it->second.encoding);
+    const std::string& last_key = it->first;
+    ++it;
+    if (it == keys_.end() ||
+        data_block_.CurrentSizeEstimate() >= options_.block_size) {
+      status = WriteBlock(&data_block_, &handle);
+      if (status.ok()) {
+        handle_encoding.clear();
+        handle.EncodeTo(&handle_encoding);
+        index_block_.Add(last_key, handle_encoding);
+      }
+    }
+  }
+
+  if (status.ok()) {
+    status = WriteBlock(&index_block_, &handle);
+    if (status.ok()) {
+      parts_.push_back(handle);
+    }
+  }
+
+  keys_.clear();
+  return status;
+}
+
+Status TrajectoryIndexBuilder::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  std::string contents;
+  PutVarint32(&contents, static_cast<uint32_t>(parts_.size()));
+  for (size_t i = 0; i < parts_.size(); i++) {
+    parts_[i].EncodeTo(&contents);
+  }
+  BlockHandle handle;
+  handle.set_offset(offset_);
+  handle.set_size(contents.size());
+  PutFixed32(&contents, crc32c::Mask(crc32c::Value(
+                            contents.data(), handle.size())));
+  std::string footer;
+  handle.EncodeTo(&footer);
+  footer.resize(BlockHandle::kMaxEncodedLength);
+  PutFixed64(&footer, kTrajectoryIndexMagic);
+  contents.append(footer);
+  Status status = dst_->Append(contents);
+  if (status.ok()) {
+    offset_ += contents.size();
+    status = dst_->Sync();
+  }
+
+  return status;
+}
+
+TrajectoryIndex::TrajectoryIndex(const DirOptions& options,
+                                 RandomAccessFile* src)
+    : options_(options), src_(src) {}
+
+TrajectoryIndex::~TrajectoryIndex() {
+  for (size_t i = 0; i < parts_.size(); i++) {
+    delete parts_[i];
+  }
+  delete src_;
+}
+
+namespace {
+// Read a fixed number of bytes from a file into a given buffer.
+Status ReadFully(RandomAccessFile* src, uint64_t off, size_t n,
+                 std::string* buf) {
+  Slice contents;
+  buf->resize(n);
+  Status status = src->Read(off, n, &contents, &(*buf)[0]);
+  if (status.ok()) {
+    if (contents.size() != n) {
+      status = Status::Corruption("Truncated trajectory index read");
+    } else if (contents.data() != buf->data()) {
+      memcpy(&(*buf)[0], contents.data(), n);
+    }
+  }
+  return status;
+}
+}  // namespace
+
+Status TrajectoryIndex::Open(const DirOptions& options, RandomAccessFile* src,
+                             uint64_t src_sz, TrajectoryIndex** result) {
+  *result = NULL;
+  TrajectoryIndex* const ti = new TrajectoryIndex(options, src);
+  std::string buf;
+  Status status;
+  if (src_sz < kFooterLength) {
+    status = Status::Corruption("Trajectory index too short to be valid");
+  } else {
+    status = ReadFully(src, src_sz - kFooterLength, kFooterLength, &buf);
+  }
+  BlockHandle handle;
+  if (status.ok()) {
+    Slice input(buf);
+    if (DecodeFixed64(input.data() + BlockHandle::kMaxEncodedLength) !=
+        kTrajectoryIndexMagic) {
+      status = Status::Corruption("Bad trajectory index magic number");
+    } else {
+      status = handle.DecodeFrom(&input);
+    }
+  }
+  if (status.ok()) {
+    status = ReadFully(src, handle.offset(), handle.size() + 4, &buf);
+  }
+  uint32_t num_parts = 0;
+  Slice input;
+  if (status.ok()) {
+    input = Slice(buf.data(), handle.size());
+    if (options.verify_checksums) {
+      const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data() +
+                                                        input.size()));
+      if (crc32c::Value(input.data(), input.size()) != crc) {
+        status = Status::Corruption("Trajectory index checksum mismatch");
+      }
+    }
+    if (status.ok() && !GetVarint32(&input, &num_parts)) {
+      status = Status::Corruption("Bad trajectory index partitions");
+    }
+  }
+  ReadOptions opts;
+  opts.verify_checksums = options.verify_checksums;
+  for (uint32_t i = 0; i < num_parts && status.ok(); i++) {
+    status = handle.DecodeFrom(&input);
+    if (status.ok()) {
+      BlockContents contents;
+      status = ReadBlock(src, opts, handle, &contents);
+      if (status.ok()) {
+        ti->parts_.push_back(new Block(contents));
+      }
+    }
+  }
+
+  if (status.ok()) {
+    *result = ti;
+  } else {
+    delete ti;
+  }
+  return status;
+}
+
+Status TrajectoryIndex::Get(uint32_t part, const Slice& key,
+                            std::vector<KeyLocation>* locs) {
+  locs->clear();
+  if (part >= parts_.size()) {
+    return Status::InvalidArgument("Bad partition");
+  }
+  Status status;
+  BlockHandle handle;
+  Iterator* iter = parts_[part]->NewIterator(BytewiseComparator());
+  iter->Seek(key);
+  if (iter->Valid()) {
+    Slice input = iter->value();
+    status = handle.DecodeFrom(&input);
+  } else {
+    status = iter->status();
+    delete iter;
+    return status;  // Key not found
+  }
+  delete iter;
+  if (!status.ok()) {
+    return status;
+  }
+
+  ReadOptions opts;
+  opts.verify_checksums = options_.verify_checksums;
+  BlockContents contents;
+  status = ReadBlock(src_, opts, handle, &contents);
+  if (!status.ok()) {
+    return status;
+  }
+  Block block(contents);
+  iter = block.NewIterator(BytewiseComparator());
+  iter->Seek(key);
+  if (iter->Valid() && iter->key() == key) {
+    Slice input = iter->value();
+    KeyLocation loc;
+    while (!input.empty()) {
+      uint64_t offset;
+      uint64_t size;
+      if (!GetVarint32(&input, &loc.epoch) || !GetVarint64(&input, &offset) ||
+          !GetVarint64(&input, &size)) {
+        status = Status::Corruption("Bad key locations");
+        break;
+      }
+      loc.block.set_offset(offset);
+      loc.block.set_size(size);
+      locs->push_back(loc);
+    }
+  } else {
+    status = iter->status();
+  }
+  delete iter;
+  return status;
+}
+
+}  // namespace plfsio
+}  // namespace pdlfs
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020 Carnegie Mellon University,
+ * Copyright (c) 2020 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "format.h"
+#include "types.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+namespace plfsio {
+
+// The location of a key within a directory: an epoch and the data block
+// holding the key in that epoch.
+struct KeyLocation {
+  uint32_t epoch;
+  BlockHandle block;  // Handle to the data block in the data log
+};
+
+// A trajectory index maps each key of a finished directory to the data blocks
+// holding it across all epochs. It is built after a directory has been
+// finished and is stored next to the directory's log files as a sidecar
+// file, one per rank. A read spanning many epochs then costs one index lookup
+// plus one data block read per epoch, instead of consulting the root index,
+// the epoch index, and the filters of every epoch. Keys are grouped by
+// directory partition. Each partition is written as a series of sorted blocks
+// mapping keys to their encoded locations, followed by an index block.
+class TrajectoryIndexBuilder {
+ public:
+  // We don't own dst.
+  TrajectoryIndexBuilder(const DirOptions& options, WritableFile* dst);
+  ~TrajectoryIndexBuilder();
+
+  // Record the location of a key within the current partition.
+  // Locations of a key must be added in epoch and block order.
+  // REQUIRES: Finish() has NOT been called.
+  void Add(const Slice& key, uint32_t epoch, const BlockHandle& block);
+
+  // Write out all keys of the current partition and start a new partition.
+  // Partitions must be ended in partition order.
+  // REQUIRES: Finish() has NOT been called.
+  Status EndPartition();
+
+  // Write the partition handles and a footer. The file is synced but is not
+  // closed.
+  // REQUIRES: Finish() has NOT been called.
+  Status Finish();
+
+ private:
+  struct Locations {
+    Locations() : epoch(0), offset(~static_cast<uint64_t>(0)) {}
+    std::string encoding;  // Encoded locations
+    uint32_t epoch;        // The last location added
+    uint64_t offset;
+  };
+
+  Status WriteBlock(BlockBuilder* block, BlockHandle* handle);
+
+  const DirOptions& options_;
+  WritableFile* const dst_;
+  std::map<std::string, Locations> keys_;  // Keys of the current partition
+  std::vector<BlockHandle> parts_;         // Index block of each partition
+  uint64_t offset_;                        // Current write offset
+  BlockBuilder data_block_;
+  BlockBuilder index_block_;
+  bool finished_;
+
+  // No copying allowed
+  void operator=(const TrajectoryIndexBuilder&);
+  TrajectoryIndexBuilder(const TrajectoryIndexBuilder&);
+};
+
+// Read a trajectory index written by a TrajectoryIndexBuilder. The index
+// blocks of all partitions are loaded at open time. Each lookup then reads one
+// data block. Safe for concurrent use by multiple threads.
+class TrajectoryIndex {
+ public:
+  ~TrajectoryIndex();
+
+  // Open a trajectory index stored in a given file. We take ownership of src.
+  // Return OK on success, or a non-OK status on errors.
+  static Status Open(const DirOptions& options, RandomAccessFile* src,
+                     uint64_t src_sz, TrajectoryIndex** result);
+
+  // Store all locations of a key in a given partition in *locs, in epoch and
+  // block order. *locs is left empty if the key does not exist.
+  // Return OK on success, or a non-OK status on errors.
+  Status Get(uint32_t part, const Slice& key, std::vector<KeyLocation>* locs);
+
+  uint32_t num_parts() const { return static_cast<uint32_t>(parts_.size()); }
+
+ private:
+  TrajectoryIndex(const DirOptions& options, RandomAccessFile* src);
+  const DirOptions& options_;
+  RandomAccessFile* const src_;
+  std::vector<Block*> parts_;  // Index block of each partition
+
+  // No copying allowed
+  void operator=(const TrajectoryIndex&);
+  TrajectoryIndex(const TrajectoryIndex&);
+};
+
+}  // namespace plfsio
+}  // namespace pdlfs
@@ -21,7 +21,14 @@
 namespace pdlfs {
 namespace plfsio {
 
-IoStats::IoStats() : index_bytes(0), index_ops(0), data_bytes(0), data_ops(0) {}
+IoStats::IoStats()
+    : index_bytes(0),
+      index_ops(0),
+      data_bytes(0),
+      data_ops(0),
+      cache_hits(0),
+      cache_misses(0),
+      index_memory(0) {}
 
 DirOptions::DirOptions()
     : total_memtable_budget(4 << 20),
@@ -29,6 +36,8 @@ DirOptions::DirOptions()
       memtable_reserv(1.00),
       leveldb_compatible(true),
       skip_sort(false),
+      radix_sort(true),
+      sort_helpers(0),
       fixed_kv_length(false),
       key_size(8),
       value_size(32),
@@ -40,6 +49,7 @@ DirOptions::DirOptions()
       cuckoo_seed(301),
       cuckoo_max_moves(500),
       cuckoo_frac(0.95),
+      epoch_filter(false),
       block_size(32 << 10),
       block_util(0.996),
       block_padding(true),
@@ -51,13 +61,25 @@ DirOptions::DirOptions()
       epoch_log_rotation(false),
       tail_padding(false),
       compaction_pool(NULL),
+      compression_pool(NULL),
       reader_pool(NULL),
       read_size(8 << 20),
+      readahead_size(0),
+      readahead_depth(4),
+      readahead_buffer(32 << 20),
+      readahead_pool(NULL),
+      block_cache_size(0),
+      index_cache_size(0),
+      index_page_size(64 << 10),
       parallel_reads(false),
+      scan_parallelism(4),
+      scan_buffer_size(64 << 10),
       paranoid_checks(false),
       ignore_filters(false),
+      ignore_trajectory_index(false),
       compression(kNoCompression),
       index_compression(kNoCompression),
+      compression_level(0),
       force_compression(false),
       verify_checksums(false),
       skip_checksums(false),
@@ -131,6 +153,9 @@ bool ParseFilterType(const Slice& key, const Slice& value, FilterType* result) {
   } else if (value.starts_with("bitmap")) {
     *result = kFtBitmap;
     return true;
+  } else if (value.starts_with("cuckoo")) {
+    *result = kFtCuckooFilter;
+    return true;
   } else {
     Warn(__LOG_ARGS__, "Unknown filter type: %s=%s, option ignored",
          key.c_str(), value.c_str());
@@ -143,6 +168,12 @@ bool ParseCompressionType(const Slice& key, const Slice& value,
   if (value.starts_with("snappy")) {
     *result = kSnappyCompression;
     return true;
+  } else if (value.starts_with("zstd")) {
+    *result = kZstdCompression;
+    return true;
+  } else if (value.starts_with("lz4")) {
+    *result = kLz4Compression;
+    return true;
   } else if (value.starts_with("no")) {
     *result = kNoCompression;
     return true;
@@ -217,6 +248,30 @@ DirOptions ParseDirOptions(const char* input) {
       if (ParseInteger(conf_key, conf_value, &num)) {
         result.block_size = num;
       }
+    } else if (conf_key == "block_cache_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.block_cache_size = num;
+      }
+    } else if (conf_key == "index_cache_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.index_cache_size = num;
+      }
+    } else if (conf_key == "index_page_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.index_page_size = num;
+      }
+    } else if (conf_key == "readahead_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.readahead_size = num;
+      }
+    } else if (conf_key == "readahead_depth") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.readahead_depth = int(num);
+      }
+    } else if (conf_key == "readahead_buffer") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.readahead_buffer = num;
+      }
     } else if (conf_key == "block_padding") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.block_padding = flag;
@@ -237,10 +292,26 @@ DirOptions ParseDirOptions(const char* input) {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.skip_sort = flag;
       }
+    } else if (conf_key == "radix_sort") {
+      if (ParseBool(conf_key, conf_value, &flag)) {
+        result.radix_sort = flag;
+      }
+    } else if (conf_key == "sort_helpers") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.sort_helpers = int(num);
+      }
     } else if (conf_key == "parallel_reads") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.parallel_reads = flag;
       }
+    } else if (conf_key == "scan_parallelism") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.scan_parallelism = int(num);
+      }
+    } else if (conf_key == "scan_buffer_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.scan_buffer_size = num;
+      }
     } else if (conf_key == "paranoid_checks") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.paranoid_checks = flag;
@@ -249,10 +320,18 @@ DirOptions ParseDirOptions(const char* input) {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.epoch_log_rotation = flag;
       }
+    } else if (conf_key == "epoch_filter") {
+      if (ParseBool(conf_key, conf_value, &flag)) {
+        result.epoch_filter = flag;
+      }
     } else if (conf_key == "ignore_filters") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.ignore_filters = flag;
       }
+    } else if (conf_key == "ignore_trajectory_index") {
+      if (ParseBool(conf_key, conf_value, &flag)) {
+        result.ignore_trajectory_index = flag;
+      }
     } else if (conf_key == "fixed_kv") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.fixed_kv_length = flag;
@@ -289,6 +368,10 @@ DirOptions ParseDirOptions(const char* input) {
       if (ParseCompressionType(conf_key, conf_value, &compression_type)) {
         result.index_compression = compression_type;
       }
+    } else if (conf_key == "compression_level") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.compression_level = int(num);
+      }
     } else if (conf_key == "force_compression") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.force_compression = flag;
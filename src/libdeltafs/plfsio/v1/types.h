@@ -36,6 +36,12 @@ struct IoStats {
   uint64_t data_bytes;
   // Total number of I/O operations for reading or writing data
   uint64_t data_ops;
+  // Total number of block reads served by the block cache
+  uint64_t cache_hits;
+  // Total number of block reads that missed the block cache
+  uint64_t cache_misses;
+  // Total bytes of index data held in memory by a reader
+  uint64_t index_memory;
 };
 
 // Directory semantics
@@ -55,14 +61,17 @@ enum DirMode {
 };
 
 // Directory filter types. Bitmap-based filters are optimized
-// for workloads with compact key spaces.
+// for workloads with compact key spaces. Cuckoo filters additionally
+// remember the data block of each key.
 enum FilterType {
   // Do not use any filters
   kFtNoFilter = 0x00,  // For debugging or benchmarking
   // Use bloom filters
   kFtBloomFilter = 0x01,
   // Use bitmap filters
-  kFtBitmap = 0x02
+  kFtBitmap = 0x02,
+  // Use cuckoo filters
+  kFtCuckooFilter = 0x03
 };
 
 // Bitmap compression format.
@@ -110,6 +119,21 @@ struct DirOptions {
   // Default: false
   bool skip_sort;
 
+  // Sort memtables using a radix sort on fixed-width key prefixes.
+  // Full key comparisons are only made among keys sharing the same prefix.
+  // Set to false to sort using key comparisons alone.
+  // The sort allocates two temporary arrays of 12-byte entries, i.e. 24 bytes
+  // per buffered key, which are freed as soon as the memtable is sorted. This
+  // scratch memory is not counted against total_memtable_budget.
+  // Default: true
+  bool radix_sort;
+
+  // Number of helper jobs submitted to the compaction pool to split the
+  // sorting of a large memtable. Only used when radix_sort is true and
+  // compaction_pool is set. Set to 0 to sort within the compaction thread.
+  // Default: 0
+  int sort_helpers;
+
   // If key value length is fixed.
   // This enables alternate block formats when "leveldb_compatible" is OFF.
   // Default: false
@@ -165,6 +189,14 @@ struct DirOptions {
   // Default 0.95
   double cuckoo_frac;
 
+  // Build an additional cuckoo filter for each epoch that maps every key
+  // of the epoch to the table holding it. Point reads consult it before
+  // any table, so a missing key costs a single probe and a present key is
+  // only searched for in the tables listed. Written into the epoch's
+  // handle, so older readers simply ignore it.
+  // Default: false
+  bool epoch_filter;
+
   // Approximate size of user data packed per data block.
   // Note that block is used both as the packaging format and as the logical I/O
   // unit for reading and writing the underlying data log objects.
@@ -228,6 +260,14 @@ struct DirOptions {
   // Default: NULL
   ThreadPool* compaction_pool;
 
+  // Thread pool used to compress and checksum data blocks in parallel with
+  // the compaction thread that fills them. Only used when "compression" is
+  // not kNoCompression. Must not be the same pool as "compaction_pool" as
+  // a compaction waits for its blocks before committing them.
+  // If set to NULL, data blocks are compressed by the compaction thread.
+  // Default: NULL
+  ThreadPool* compression_pool;
+
   // Thread pool used to run concurrent background reads.
   // If set to NULL, Env::Default() may be used to schedule reads if permitted.
   // Otherwise, the caller's thread context will be used directly.
@@ -240,11 +280,72 @@ struct DirOptions {
   // Default: 8MB
   size_t read_size;
 
+  // Size of each window read ahead of sequential data log readers, such as
+  // scans. Windows are aligned to their size. Random reads are unaffected.
+  // Set to 0 to disable read-ahead.
+  // Default: 0
+  size_t readahead_size;
+
+  // Max number of windows read ahead of each sequential reader. Only used
+  // with a readahead pool.
+  // Default: 4
+  int readahead_depth;
+
+  // Memory for windows read ahead of sequential readers. Applies separately
+  // to each data log file when the log is rotated.
+  // Default: 32MB
+  size_t readahead_buffer;
+
+  // Thread pool used to read windows ahead of sequential readers. Must not be
+  // the same pool as "reader_pool" as readers wait for the windows they need.
+  // If set to NULL, each window is read by the first reader that needs it.
+  // Default: NULL
+  ThreadPool* readahead_pool;
+
+  // Capacity of a block cache shared by all partitions of a directory reader.
+  // Fetched data blocks, as well as index blocks that have to be decompressed
+  // before use, are kept in the cache so that repeated reads against the same
+  // epochs do not re-fetch them from the underlying storage.
+  // Set to 0 to disable the cache.
+  // Default: 0
+  size_t block_cache_size;
+
+  // Memory budget for index log data when index logs are loaded lazily.
+  // If set, index logs are not read in full when a partition is opened.
+  // Instead, only the pages that are needed (the root block, the meta
+  // indexes of the epochs being queried, and the table indexes and filters
+  // being consulted) are read on demand, and are kept in a cache of this
+  // capacity shared by all partitions of a directory reader. Index blocks
+  // are copied out of the cache on each use, so lazy loading is best
+  // combined with a block cache (see block_cache_size).
+  // Set to 0 to eagerly read each index log in full.
+  // Default: 0
+  size_t index_cache_size;
+
+  // Size of each page read from an index log when index logs are loaded
+  // lazily.
+  // Default: 64KB
+  size_t index_page_size;
+
   // Set to true to enable parallel reading across different epochs.
   // Otherwise, reads progress serially over all epochs.
   // Default: false
   bool parallel_reads;
 
+  // Max number of background scan tasks in flight when a parallel scan fans
+  // out over all partitions and epochs of a directory. Each task scans a
+  // single epoch of a single partition.
+  // Default: 4
+  int scan_parallelism;
+
+  // Size of the output buffer of each background scan task. Full buffers are
+  // handed over to the scanning thread, which invokes the user callback.
+  // At most "scan_parallelism" full buffers are queued, so a parallel scan
+  // holds about 3 * scan_parallelism * scan_buffer_size bytes of results in
+  // memory at a time unless sorted results are requested.
+  // Default: 64KB
+  size_t scan_buffer_size;
+
   // Perform aggressive checking of the data so we stop early on errors.
   // Default: false
   bool paranoid_checks;
@@ -253,6 +354,11 @@ struct DirOptions {
   // Default: false
   bool ignore_filters;
 
+  // Ignore the directory's trajectory index during reads, if one has been
+  // built (see BuildTrajectoryIndex() in v1.h).
+  // Default: false
+  bool ignore_trajectory_index;
+
   // Compression type to be applied to data blocks.
   // Default: kNoCompression
   CompressionType compression;
@@ -261,6 +367,19 @@ struct DirOptions {
   // Default: kNoCompression
   CompressionType index_compression;
 
+  // Compression level for compression types that support levels (currently
+  // kZstdCompression). Applies to both data and index blocks.
+  // Set to 0 to use the compressor's default level.
+  // Default: 0
+  int compression_level;
+
+  // Dictionary for kZstdCompression. Applies to both data and index blocks.
+  // When set, the same dictionary must be supplied to readers of the
+  // directory. The dictionary is not stored in the directory, and its
+  // memory is owned by the caller and must outlive writers and readers.
+  // Default: empty
+  Slice compression_dict;
+
   // True if compressed data is written out even if compression rate is low.
   // Default: false
   bool force_compression;
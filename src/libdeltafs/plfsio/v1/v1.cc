@@ -14,6 +14,7 @@
 #include "../../util/logging.h"
 #include "filter.h"
 #include "internal.h"
+#include "traj.h"
 #include "types.h"
 
 #include "pdlfs-common/env_files.h"
@@ -21,6 +22,9 @@
 #include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/strutil.h"
 
+#include <algorithm>
+#include <deque>
+#include <queue>
 #include <string>
 #include <vector>
 
@@ -38,20 +42,31 @@ struct DirWriter::Rep {
   Status MaybeRotateLogs(Epoch*);
   Status TryFlush(Epoch*, bool ef = false, bool fi = false);
   Status TryAdd(Epoch*, const Slice& fid, const Slice& data);
+  void EndOp(Epoch*);
   Status EnsureDataPadding(LogSink* sink, size_t footer_size);
   Status InstallDirInfo(const std::string& footer);
   Status Finalize();
 
   const DirOptions options_;
   mutable port::Mutex io_mutex_;  // Protecting the shared data log
+  // Protecting epoch state below. Each directory partition is
+  // separately protected by its own mutex. If both are needed, mutex_
+  // must be locked before any partition mutex.
   mutable port::Mutex mutex_;
-  port::CondVar bg_cv_;
   port::CondVar cv_;
   const std::string dirname_;
   uint32_t num_parts_;
   uint32_t part_mask_;
   Status finish_status_;
-  Epoch* epoch_;   // Current epoch
+  // Current epoch. May be read without mutex_.
+#if __cplusplus >= 201103L
+  std::atomic<Epoch*> epoch_;
+#else
+  Epoch* epoch_;
+#endif
+  // Epochs no longer current. Lock-free writers may still be referencing them
+  // so they are only released when the writer is deleted.
+  std::vector<Epoch*> retired_epochs_;
   bool finished_;  // If Finish() has been called
   WritableFileStats io_stats_;
   const DirOutputStats** compac_stats_;
@@ -62,7 +77,6 @@ struct DirWriter::Rep {
 
 DirWriter::Rep::Rep(const DirOptions& o, const std::string& d)
     : options_(o),
-      bg_cv_(&mutex_),
       cv_(&mutex_),
       dirname_(d),
       num_parts_(0),
@@ -73,8 +87,9 @@ DirWriter::Rep::Rep(const DirOptions& o, const std::string& d)
       idxers_(NULL),
       data_(NULL),
       env_(options_.env) {
-  epoch_ = new Epoch(0, &mutex_);
-  epoch_->Ref();
+  Epoch* const ep = new Epoch(0);
+  ep->Ref();
+  epoch_ = ep;
 }
 
 DirWriter::Rep::~Rep() {
@@ -84,7 +99,11 @@ DirWriter::Rep::~Rep() {
       idxers_[i]->Unref();
     }
   }
-  if (epoch_ != NULL) epoch_->Unref();
+  Epoch* const ep = epoch_;
+  if (ep != NULL) ep->Unref();
+  for (size_t i = 0; i < retired_epochs_.size(); i++) {
+    retired_epochs_[i]->Unref();
+  }
   delete[] compac_stats_;
   delete[] idxers_;
   if (data_ != NULL) {
@@ -173,8 +192,10 @@ Status DirWriter::Rep::Finalize() {
   mutex_.AssertHeld();
   assert(!HasCompaction());
   uint32_t max_epochs = 0;
-  for (uint32_t i = 0; i < num_parts_; i++)
+  for (uint32_t i = 0; i < num_parts_; i++) {
+    MutexLock ml(&idxers_[i]->mu_);
     max_epochs = std::max(max_epochs, idxers_[i]->num_epochs());
+  }
   Footer footer = Mkfoot(options_);
   BlockHandle dummy_handle;
 
@@ -198,6 +219,7 @@ Status DirWriter::Rep::Finalize() {
 
   if (status.ok()) {
     for (uint32_t i = 0; i < num_parts_; i++) {
+      MutexLock ml(&idxers_[i]->mu_);
       status = idxers_[i]->SyncAndClose();
       if (!status.ok()) {
         break;
@@ -219,6 +241,7 @@ Status DirWriter::Rep::ObtainCompactionStatus() {
   mutex_.AssertHeld();
   Status status;
   for (size_t i = 0; i < num_parts_; i++) {
+    MutexLock ml(&idxers_[i]->mu_);
     status = idxers_[i]->bg_status();
     if (!status.ok()) {
       break;
@@ -230,6 +253,7 @@ Status DirWriter::Rep::ObtainCompactionStatus() {
 bool DirWriter::Rep::HasCompaction() {
   mutex_.AssertHeld();
   for (size_t i = 0; i < num_parts_; i++) {
+    MutexLock ml(&idxers_[i]->mu_);
     if (idxers_[i]->has_bg_compaction()) {
       return true;
     }
@@ -237,39 +261,65 @@ bool DirWriter::Rep::HasCompaction() {
   return false;
 }
 
+// Wait for on-going compactions to finish on all directory partitions.
+// Partitions are waited one after another. Will temporarily unlock mutex_.
 Status DirWriter::Rep::WaitForCompaction() {
   mutex_.AssertHeld();
   Status status;
-  while (true) {
-    status = ObtainCompactionStatus();
-    if (status.ok() && HasCompaction()) {
-      bg_cv_.Wait();
-    } else {
+  mutex_.Unlock();
+  for (size_t i = 0; i < num_parts_; i++) {
+    MutexLock ml(&idxers_[i]->mu_);
+    status = idxers_[i]->WaitForCompaction();
+    if (!status.ok()) {
       break;
     }
   }
+  mutex_.Lock();
   return status;
 }
 
 // Insert data into a directory partition. May be blocked due to potential lack
-// of buffer space. Return OK on success, or a non-OK status on errors.
+// of buffer space. Only the target partition is locked so writers hashed to
+// different partitions proceed in parallel. Return OK on success, or a non-OK
+// status on errors.
 Status DirWriter::Rep::TryAdd(Epoch* ep, const Slice& fid, const Slice& data) {
-  mutex_.AssertHeld();
   assert(ep->num_ongoing_ops_ != 0);
   Status status;
   const uint32_t hash = Hash(fid.data(), fid.size(), 0);
   const uint32_t part = hash & part_mask_;
   assert(part < num_parts_);
-  status = idxers_[part]->Add(ep, fid, data);
+  DirIndexer* const idxer = idxers_[part];
+  MutexLock ml(&idxer->mu_);
+  status = idxer->Add(ep, fid, data);
   return status;
 }
 
+// Mark the end of an on-going operation against a given epoch. Threads waiting
+// for the epoch to drain are woken up when the last operation ends.
+// With C++11, mutex_ is only locked when the epoch is being committed.
+// REQUIRES: mutex_ has NOT been locked by the caller if C++11 is used,
+// or mutex_ has been locked otherwise.
+void DirWriter::Rep::EndOp(Epoch* ep) {
+  assert(ep->num_ongoing_ops_ != 0);
+#if __cplusplus >= 201103L
+  if (--ep->num_ongoing_ops_ == 0 && ep->committing_) {
+    MutexLock ml(&mutex_);
+    cv_.SignalAll();
+  }
+#else
+  mutex_.AssertHeld();
+  if (--ep->num_ongoing_ops_ == 0) {
+    cv_.SignalAll();
+  }
+#endif
+}
+
 // Attempt to schedule a minor compaction on all directory partitions
 // simultaneously. If a compaction cannot be scheduled immediately due to a lack
 // of buffer space, it will be added to a waiting list so it can be reattempted
 // later. Return immediately as soon as all partitions have a minor compaction
-// scheduled. Will not wait for all compactions to finish.
-// Return OK on success, or a non-OK status on errors.
+// scheduled. Will not wait for all compactions to finish. Will temporarily
+// unlock mutex_. Return OK on success, or a non-OK status on errors.
 Status DirWriter::Rep::TryFlush(Epoch* ep, bool ef, bool fi) {
   mutex_.AssertHeld();
   if (ef || fi) {
@@ -278,39 +328,37 @@ Status DirWriter::Rep::TryFlush(Epoch* ep, bool ef, bool fi) {
     assert(ep->num_ongoing_ops_ != 0);
   }
   Status status;
-  std::vector<DirIndexer*> remaining;
-  for (size_t i = 0; i < num_parts_; i++) remaining.push_back(idxers_[i]);
   std::vector<DirIndexer*> waiting_list;
+  mutex_.Unlock();  // Partitions are locked individually
 
   DirIndexer::FlushOptions flush_options(ef, fi);
-  while (!remaining.empty()) {
-    waiting_list.clear();
-    for (size_t i = 0; i < remaining.size(); i++) {
-      flush_options.dry_run =
-          true;  // Avoid being blocked waiting for buffer space to reappear
-      status = remaining[i]->Flush(flush_options, ep);
-      flush_options.dry_run = false;
-
-      if (status.IsTryAgain()) {
-        waiting_list.push_back(remaining[i]);  // Try again later
-        status = Status::OK();
-      } else if (status.ok()) {
-        remaining[i]->Flush(flush_options, ep);
-      } else {
-        break;
-      }
-    }
-
-    if (status.ok()) {
-      if (!waiting_list.empty()) {
-        bg_cv_.Wait();  // Waiting for buffer space
-      }
-      waiting_list.swap(remaining);
+  for (size_t i = 0; i < num_parts_; i++) {
+    DirIndexer* const idxer = idxers_[i];
+    MutexLock ml(&idxer->mu_);
+    flush_options.dry_run =
+        true;  // Avoid being blocked waiting for buffer space to reappear
+    status = idxer->Flush(flush_options, ep);
+    flush_options.dry_run = false;
+
+    if (status.IsTryAgain()) {
+      waiting_list.push_back(idxer);  // Try again later
+      status = Status::OK();
+    } else if (status.ok()) {
+      idxer->Flush(flush_options, ep);
     } else {
       break;
     }
   }
 
+  for (size_t i = 0; i < waiting_list.size(); i++) {
+    if (!status.ok()) break;
+    DirIndexer* const idxer = waiting_list[i];
+    MutexLock ml(&idxer->mu_);
+    // Waiting for buffer space
+    status = idxer->Flush(flush_options, ep);
+  }
+
+  mutex_.Lock();
   return status;
 }
 
@@ -336,7 +384,7 @@ Status DirWriter::Finish() {
     } else {
       cur->committing_ = true;
       while (cur->num_ongoing_ops_ != 0) {
-        cur->cv_.Wait();
+        r->cv_.Wait();
       }
       status = r->TryFlush(cur, true /*epoch flush*/, true /*finalize*/);
       if (status.ok()) status = r->WaitForCompaction();
@@ -345,7 +393,7 @@ Status DirWriter::Finish() {
       r->finished_ = true;
       r->epoch_ = NULL;
       r->cv_.SignalAll();
-      cur->Unref();
+      r->retired_epochs_.push_back(cur);
       break;
     }
   }
@@ -380,17 +428,17 @@ Status DirWriter::EpochFlush(int epoch) {
     } else {
       cur->committing_ = true;  // No more writing
       while (cur->num_ongoing_ops_ != 0) {
-        cur->cv_.Wait();
+        r->cv_.Wait();
       }
       status = r->TryFlush(cur, true /*epoch flush*/);
       if (status.ok())
         status = r->MaybeRotateLogs(cur);  // May temporarily unlock
-      Epoch* const nxt = new Epoch(1 + cur->seq_, &r->mutex_);
+      Epoch* const nxt = new Epoch(1 + cur->seq_);
       assert(r->epoch_ == cur);
+      nxt->Ref();
       r->epoch_ = nxt;
       r->cv_.SignalAll();
-      cur->Unref();
-      nxt->Ref();
+      r->retired_epochs_.push_back(cur);
       break;
     }
   }
@@ -423,11 +471,10 @@ Status DirWriter::Flush(int epoch) {
       break;
     } else {
       cur->num_ongoing_ops_++;
-      status = r->TryFlush(cur);
+      status = r->TryFlush(cur);  // May temporarily unlock
       assert(cur->num_ongoing_ops_ != 0);
-      cur->num_ongoing_ops_--;
-      if (cur->committing_ && cur->num_ongoing_ops_ == 0) {
-        cur->cv_.SignalAll();
+      if (--cur->num_ongoing_ops_ == 0) {
+        r->cv_.SignalAll();
       }
       break;
     }
@@ -435,10 +482,27 @@ Status DirWriter::Flush(int epoch) {
   return status;
 }
 
+// With C++11, writers register against the current epoch without locking the
+// writer-wide mutex and only contend on the partitions they hash to. The mutex
+// is only used when the epoch is being committed and the writer has to wait or
+// fail. Without C++11, each insertion is done with the mutex locked.
 Status DirWriter::Add(const Slice& fid, const Slice& data, int epoch) {
   Status status;
   Rep* const r = rep_;
-  MutexLock ml(&r->mutex_);
+#if __cplusplus >= 201103L
+  Epoch* const cur = r->epoch_;  // NULL if finished
+  if (cur != NULL && (epoch == -1 || epoch == int(cur->seq_))) {
+    cur->num_ongoing_ops_++;
+    if (!cur->committing_) {
+      status = r->TryAdd(cur, fid, data);
+      r->EndOp(cur);
+      return status;
+    }
+    r->EndOp(cur);  // Back out and go through the slow path
+  }
+#endif
+  Epoch* ep = NULL;
+  r->mutex_.Lock();
   while (true) {
     if (r->finished_) {
       status = Status::AssertionFailed("Plfsdir already finished");
@@ -456,15 +520,23 @@ Status DirWriter::Add(const Slice& fid, const Slice& data, int epoch) {
       break;
     } else {
       cur->num_ongoing_ops_++;
-      status = r->TryAdd(cur, fid, data);
-      assert(cur->num_ongoing_ops_ != 0);
-      cur->num_ongoing_ops_--;
-      if (cur->committing_ && cur->num_ongoing_ops_ == 0) {
-        cur->cv_.SignalAll();
-      }
+      ep = cur;
       break;
     }
   }
+#if __cplusplus >= 201103L
+  r->mutex_.Unlock();
+  if (ep != NULL) {
+    status = r->TryAdd(ep, fid, data);
+    r->EndOp(ep);
+  }
+#else
+  if (ep != NULL) {
+    status = r->TryAdd(ep, fid, data);
+    r->EndOp(ep);
+  }
+  r->mutex_.Unlock();
+#endif
   return status;
 }
 
@@ -493,6 +565,7 @@ Status DirWriter::Sync() {
   sink->Unlock();
   if (status.ok()) {
     for (uint32_t part = 0; part < r->num_parts_; part++) {
+      MutexLock pl(&r->idxers_[part]->mu_);
       status = r->idxers_[part]->indx_->Lsync();
       if (!status.ok()) {
         break;
@@ -582,8 +655,10 @@ uint64_t DirWriter::TEST_total_memory_usage() const {
   result += r->data_->memory_usage();
   for (size_t i = 0; i < r->num_parts_; i++)
     result += r->idxers_[i]->indx_->memory_usage();
-  for (size_t i = 0; i < r->num_parts_; i++)
+  for (size_t i = 0; i < r->num_parts_; i++) {
+    MutexLock pl(&r->idxers_[i]->mu_);
     result += r->idxers_[i]->memory_usage();
+  }
   return result;
 }
 
@@ -651,6 +726,21 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
   }
 }
 
+#if VERBOSE >= 2
+static const char* CompressionName(CompressionType type) {
+  switch (type) {
+    case kSnappyCompression:
+      return "Snappy";
+    case kZstdCompression:
+      return "Zstd";
+    case kLz4Compression:
+      return "LZ4";
+    default:
+      return "None";
+  }
+}
+#endif
+
 // Fix user-supplied options to be reasonable
 static DirOptions SanitizeWriteOptions(const DirOptions& options) {
   DirOptions result = options;
@@ -722,6 +812,9 @@ std::string FilterOptions(const DirOptions& options) {
       snprintf(tmp, sizeof(tmp), "BF (bits_per_key=%d)",
                int(options.bf_bits_per_key));
       return tmp;
+    case kFtCuckooFilter:
+      snprintf(tmp, sizeof(tmp), "CF (frac=%.2f)", options.cuckoo_frac);
+      return tmp;
     case kFtNoFilter:
       return "Dis";
     default:
@@ -759,8 +852,7 @@ Status DirWriter::TryOpen(Rep* rep) {
   status = LogSink::Open(io_opts, rep->dirname_, &data[0]);
   if (status.ok()) {
     for (size_t i = 0; i < num_parts; i++) {
-      diridxers[i] =
-          new DirIndexer(rep->options_, i, &rep->mutex_, &rep->bg_cv_);
+      diridxers[i] = new DirIndexer(rep->options_, i);
       LogSink::LogOptions idx_opts;
       idx_opts.rank = my_rank;
       idx_opts.sub_partition = static_cast<int>(i);
@@ -829,6 +921,10 @@ Status DirWriter::Open(const DirOptions& _opts, const std::string& dirname,
           int(options.leveldb_compatible) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.skip_sort -> %s",
           int(options.skip_sort) ? "Yes" : "No");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.radix_sort -> %s",
+          int(options.radix_sort) ? "Yes" : "No");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.sort_helpers -> %d",
+          options.sort_helpers);
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.fixed_kv_length -> %s",
           int(options.fixed_kv_length) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.key_size -> %s",
@@ -839,6 +935,8 @@ Status DirWriter::Open(const DirOptions& _opts, const std::string& dirname,
           FilterOptions(options).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.filter_bits_per_key -> %d",
           int(options.filter_bits_per_key));
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.epoch_filter -> %s",
+          int(options.epoch_filter) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.block_size -> %s",
           PrettySize(options.block_size).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.block_util -> %.2f%%",
@@ -861,10 +959,18 @@ Status DirWriter::Open(const DirOptions& _opts, const std::string& dirname,
           options.compaction_pool != NULL
               ? options.compaction_pool->ToDebugString().c_str()
               : "None");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.compression_pool -> %s",
+          options.compression_pool != NULL
+              ? options.compression_pool->ToDebugString().c_str()
+              : "None");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.compression -> %s",
-          options.compression == kSnappyCompression ? "Snappy" : "None");
+          CompressionName(options.compression));
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.index_compression -> %s",
-          options.index_compression == kSnappyCompression ? "Snappy" : "None");
+          CompressionName(options.index_compression));
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.compression_level -> %d",
+          options.compression_level);
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.compression_dict -> %s",
+          PrettySize(options.compression_dict.size()).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.force_compression -> %s",
           int(options.force_compression) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.skip_checksums -> %s",
@@ -902,12 +1008,24 @@ class DirReaderImpl : public DirReader {
 
   virtual Status Count(const CountOp& op, size_t* result);
   virtual Status Read(const ReadOp& op, const Slice& fid, std::string* dst);
+  virtual Status MultiRead(const ReadOp& op, const std::vector<Slice>& fids,
+                           std::vector<std::string>* dsts);
   virtual Status Scan(const ScanOp& op, ScanSaver, void*);
 
   virtual IoStats TEST_iostats() const;
 
+  Status BuildTrajectoryIndex();
+
  private:
   Status OpenDir(size_t part);
+  Status AcquireDir(uint32_t part, Dir** result);
+  void ReleaseDir(Dir* dir);
+  struct ScanContext;
+  struct ScanTask;
+  Status ParallelScan(const ScanOp& op, ScanSaver saver, void* arg);
+  static int BufferRecord(void* arg, const Slice& key, const Slice& value);
+  static void BGScan(void* arg);
+  void RunScanTask(ScanTask* task);
   RandomAccessFileStats io_stats_;
   friend class DirReader;
 
@@ -916,11 +1034,19 @@ class DirReaderImpl : public DirReader {
   uint32_t num_parts_;
   uint32_t part_mask_;
 
+  // Only held when opening partitions and updating partition references.
+  // Opened partitions are immutable and are read without holding mutex_.
   mutable port::Mutex mutex_;
-  port::CondVar cond_cv_;
   // Lazily initialized directory partitions
   Dir** dirs_;
   LogSource* data_;
+  // Shared by all partitions. NULL if caching is disabled
+  BlockCache* block_cache_;
+  // Shared by all partitions. NULL if index logs are eagerly loaded
+  LogPageCache* page_cache_;
+  // NULL if the directory has no trajectory index or the index is ignored
+  TrajectoryIndex* traj_;
+  RandomAccessFileStats traj_stats_;
 };
 
 DirReaderImpl::DirReaderImpl(const DirOptions& opts, const std::string& name)
@@ -928,9 +1054,19 @@ DirReaderImpl::DirReaderImpl(const DirOptions& opts, const std::string& name)
       name_(name),
       num_parts_(0),
       part_mask_(~static_cast<uint32_t>(0)),
-      cond_cv_(&mutex_),
       dirs_(NULL),
-      data_(NULL) {}
+      data_(NULL),
+      block_cache_(NULL),
+      page_cache_(NULL),
+      traj_(NULL) {
+  if (options_.block_cache_size != 0) {
+    block_cache_ = new BlockCache(options_.block_cache_size);
+  }
+  if (options_.index_cache_size != 0) {
+    page_cache_ = new LogPageCache(options_.index_cache_size,
+                                   options_.index_page_size);
+  }
+}
 
 DirReaderImpl::~DirReaderImpl() {
   MutexLock ml(&mutex_);
@@ -943,6 +1079,9 @@ DirReaderImpl::~DirReaderImpl() {
   if (data_ != NULL) {
     data_->Unref();
   }
+  delete block_cache_;
+  delete page_cache_;
+  delete traj_;
 }
 
 // Open a directory partition if it has not been opened before.
@@ -954,20 +1093,34 @@ Status DirReaderImpl::OpenDir(size_t part) {
   assert(part < num_parts_);
   if (dirs_[part] == NULL) {
     mutex_.Unlock();  // Unlock when reading dir indexes
+#if VERBOSE >= 3
+    const uint64_t start = CurrentMicros();
+#endif
     LogSource* indx = NULL;
-    Dir* dir = new Dir(options_, &mutex_, &cond_cv_);
+    Dir* dir = new Dir(options_, &mutex_);
+    dir->InstallBlockCache(block_cache_, static_cast<uint32_t>(part));
     dir->Ref();
     LogSource::LogOptions idx_opts;
     idx_opts.type = kIdxIoType;
     idx_opts.sub_partition = static_cast<int>(part);
     idx_opts.rank = options_.rank;
     if (options_.measure_reads) idx_opts.seq_stats = &dir->io_stats_;
+    if (options_.measure_reads) idx_opts.stats = &dir->lazy_io_stats_;
+    idx_opts.page_cache = page_cache_;
     idx_opts.io_size = options_.read_size;
     idx_opts.env = options_.env;
     status = LogSource::Open(idx_opts, name_, &indx);
     if (status.ok()) {
       status = dir->Open(indx);
     }
+#if VERBOSE >= 3
+    if (status.ok()) {
+      Verbose(__LOG_ARGS__, 3,
+              "Opened dir partition %d in %.3f ms, index in memory=%s",
+              int(part), (CurrentMicros() - start) / 1000.0,
+              PrettySize(dir->index_memory()).c_str());
+    }
+#endif
     mutex_.Lock();
     if (status.ok()) {
       dir->InstallDataSource(data_);
@@ -983,26 +1136,45 @@ Status DirReaderImpl::OpenDir(size_t part) {
   return status;
 }
 
+// Open a directory partition if needed and obtain a reference to it. The
+// reference must be released through ReleaseDir(). mutex_ is only held during
+// the call so that multiple readers may access opened partitions in parallel.
+// Return OK on success, or a non-OK status on errors.
+// REQUIRES: mutex_ has NOT been locked.
+Status DirReaderImpl::AcquireDir(uint32_t part, Dir** result) {
+  MutexLock ml(&mutex_);
+  Status status = OpenDir(part);
+  if (status.ok()) {
+    assert(dirs_[part] != NULL);
+    *result = dirs_[part];
+    (*result)->Ref();
+  }
+  return status;
+}
+
+// REQUIRES: mutex_ has NOT been locked.
+void DirReaderImpl::ReleaseDir(Dir* dir) {
+  MutexLock ml(&mutex_);
+  dir->Unref();
+}
+
 // Perform a count operation on all partitions.
 // Return OK on success, or a non-OK status on errors.
 Status DirReaderImpl::Count(const CountOp& op, size_t* result) {
   Status status;
-  MutexLock ml(&mutex_);
   size_t subtotal;
+  Dir* dir;
 
   *result = 0;
   for (uint32_t part = 0; part < num_parts_; part++) {
-    status = OpenDir(part);
+    status = AcquireDir(part, &dir);
     if (status.ok()) {
-      assert(dirs_[part] != NULL);
-      Dir* const dir = dirs_[part];
-      dir->Ref();
       Dir::CountOptions opts;
       opts.epoch_start = op.epoch_start;
       opts.epoch_end = op.epoch_end;
 
-      status = dirs_[part]->Count(opts, &subtotal);
-      dir->Unref();
+      status = dir->Count(opts, &subtotal);
+      ReleaseDir(dir);
       if (status.ok()) {
         *result += subtotal;
       }
@@ -1016,22 +1188,341 @@ Status DirReaderImpl::Count(const CountOp& op, size_t* result) {
   return status;
 }
 
+// State shared by all tasks of a scan. Each task scans a single epoch of a
+// single partition and buffers the results in memory it owns. Full buffers
+// are queued for the scanning thread, which alone invokes the user callback.
+// Tasks block when too many buffers are queued.
+struct DirReaderImpl::ScanContext {
+  explicit ScanContext(port::Mutex* mu) : cv(mu), space_cv(mu) {}
+  port::CondVar cv;        // Signaled when a buffer is queued or a task ends
+  port::CondVar space_cv;  // Signaled when queued buffers are dequeued
+  std::deque<std::string*> ready;  // Full buffers waiting to be delivered
+  size_t max_ready;
+  size_t buffer_size;
+  bool sorted;  // Results are delivered after all tasks are done
+  bool stop;    // Set on errors or when the user no longer wants results
+  int num_running;
+  Status status;
+  size_t table_seeks;
+  size_t seeks;
+  size_t n;
+};
+
+struct DirReaderImpl::ScanTask {
+  DirReaderImpl* reader;
+  ScanContext* ctx;
+  port::Mutex* mu;
+  uint32_t part;
+  uint32_t epoch;
+  // Encoded results. Each result is a length-prefixed key followed by a
+  // length-prefixed value.
+  std::string* buf;
+};
+
+namespace {
+struct Record {
+  Slice key;
+  Slice value;
+};
+
+// Decode all results in a given buffer. Return false on errors.
+bool DecodeRecords(const std::string& buf, std::vector<Record>* records) {
+  Slice input = buf;
+  Record r;
+  while (!input.empty()) {
+    if (!GetLengthPrefixedSlice(&input, &r.key) ||
+        !GetLengthPrefixedSlice(&input, &r.value)) {
+      return false;
+    }
+    records->push_back(r);
+  }
+  return true;
+}
+
+// Pass all results in a given buffer to the user. Return false if the user
+// does not want more results.
+bool DeliverRecords(const std::string& buf, DirReader::ScanSaver saver,
+                    void* arg) {
+  Slice input = buf;
+  Slice key;
+  Slice value;
+  while (!input.empty()) {
+    if (!GetLengthPrefixedSlice(&input, &key) ||
+        !GetLengthPrefixedSlice(&input, &value)) {
+      return false;
+    } else if (saver(arg, key, value) == -1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct RecordLess {
+  bool operator()(const Record& a, const Record& b) const {
+    return a.key.compare(b.key) < 0;
+  }
+};
+
+// Sort the results in a given buffer by key, keeping the relative order of
+// results with the same key.
+void SortRecords(std::string* buf) {
+  std::vector<Record> records;
+  DecodeRecords(*buf, &records);
+  std::stable_sort(records.begin(), records.end(), RecordLess());
+  std::string result;
+  result.reserve(buf->size());
+  for (size_t i = 0; i < records.size(); i++) {
+    PutLengthPrefixedSlice(&result, records[i].key);
+    PutLengthPrefixedSlice(&result, records[i].value);
+  }
+  buf->swap(result);
+}
+
+// A cursor over a sorted run of results.
+struct Run {
+  Slice input;
+  Record current;
+  size_t seq;  // Runs are ordered by partition and then by epoch
+  bool Next() {
+    return GetLengthPrefixedSlice(&input, &current.key) &&
+           GetLengthPrefixedSlice(&input, &current.value);
+  }
+};
+
+// Orders runs for a min-heap. Ties are broken by run sequence.
+struct RunGreater {
+  bool operator()(const Run* a, const Run* b) const {
+    int r = a->current.key.compare(b->current.key);
+    if (r != 0) return r > 0;
+    return a->seq > b->seq;
+  }
+};
+}  // namespace
+
+// Append a result to the task's buffer. Hand over the buffer to the scanning
+// thread once it is full.
+int DirReaderImpl::BufferRecord(void* arg, const Slice& key,
+                                const Slice& value) {
+  ScanTask* const t = reinterpret_cast<ScanTask*>(arg);
+  ScanContext* const ctx = t->ctx;
+  PutLengthPrefixedSlice(t->buf, key);
+  PutLengthPrefixedSlice(t->buf, value);
+  if (!ctx->sorted && t->buf->size() >= ctx->buffer_size) {
+    MutexLock ml(t->mu);
+    while (ctx->ready.size() >= ctx->max_ready && !ctx->stop) {
+      ctx->space_cv.Wait();
+    }
+    if (ctx->stop) {
+      t->buf->clear();
+      return -1;
+    }
+    ctx->ready.push_back(t->buf);
+    if (ctx->ready.size() == 1) {
+      ctx->cv.Signal();  // Only the scanning thread waits on cv
+    }
+    t->buf = new std::string;
+    t->buf->reserve(ctx->buffer_size + 64);
+  }
+  return 0;
+}
+
+void DirReaderImpl::BGScan(void* arg) {
+  ScanTask* const t = reinterpret_cast<ScanTask*>(arg);
+  t->reader->RunScanTask(t);
+}
+
+// Scan an epoch of a partition. Lock not held.
+void DirReaderImpl::RunScanTask(ScanTask* t) {
+  ScanContext* const ctx = t->ctx;
+  Dir::ScanStats stats;
+  stats.total_table_seeks = 0;
+  stats.total_seeks = 0;
+  stats.n = 0;
+  Dir* dir;
+  Status status = AcquireDir(t->part, &dir);
+  if (status.ok()) {
+    Dir::ScanOptions opts;
+    opts.epoch_start = t->epoch;
+    opts.epoch_end = t->epoch + 1;
+    opts.force_serial_reads = true;
+    Dir::Saver dir_saver = BufferRecord;
+    opts.usr_cb = reinterpret_cast<void*>(dir_saver);
+    opts.arg_cb = t;
+    char tmp[256];  // Temporary buffer space for the read operation
+    opts.tmp_length = sizeof(tmp);
+    opts.tmp = tmp;
+
+    status = dir->Scan(opts, &stats);
+    ReleaseDir(dir);
+  }
+  if (status.ok() && ctx->sorted) {
+    SortRecords(t->buf);
+  }
+
+  MutexLock ml(t->mu);
+  if (!ctx->sorted && !t->buf->empty() && !ctx->stop) {
+    ctx->ready.push_back(t->buf);
+    t->buf = NULL;
+  }
+  if (!status.ok() && ctx->status.ok()) {
+    ctx->status = status;
+    ctx->stop = true;
+  }
+  ctx->table_seeks += stats.total_table_seeks;
+  ctx->seeks += stats.total_seeks;
+  ctx->n += stats.n;
+  assert(ctx->num_running > 0);
+  ctx->num_running--;
+  ctx->cv.Signal();
+}
+
+// Scan all partitions and epochs concurrently. At most "scan_parallelism"
+// tasks are scheduled at a time. Results are delivered to the user as tasks
+// hand over their buffers, or, if sorted results are requested, merged from
+// the sorted results of all tasks after all tasks are done.
+// Return OK on success, or a non-OK status on errors.
+Status DirReaderImpl::ParallelScan(const ScanOp& op, ScanSaver saver,
+                                   void* arg) {
+  const bool bg = options_.parallel_reads && !op.no_parallel_reads &&
+                  (options_.reader_pool != NULL || options_.allow_env_threads);
+  assert(bg || op.sorted);  // Tasks run inline must not hand over buffers
+  const size_t max_running =
+      std::max(1, bg ? options_.scan_parallelism : 1);
+  port::Mutex mu;
+  ScanContext ctx(&mu);
+  ctx.max_ready = max_running;
+  ctx.buffer_size = std::max<size_t>(options_.scan_buffer_size, 1);
+  ctx.sorted = op.sorted;
+  ctx.stop = false;
+  ctx.num_running = 0;
+  ctx.table_seeks = 0;
+  ctx.seeks = 0;
+  ctx.n = 0;
+  // Tasks must stay alive until background jobs are done with them
+  std::vector<ScanTask> tasks;
+  const uint32_t epoch_end =
+      std::min(op.epoch_end, static_cast<uint32_t>(options_.num_epochs));
+  for (uint32_t part = 0; part < num_parts_; part++) {
+    for (uint32_t epoch = op.epoch_start; epoch < epoch_end; epoch++) {
+      ScanTask t;
+      t.reader = this;
+      t.ctx = &ctx;
+      t.mu = &mu;
+      t.part = part;
+      t.epoch = epoch;
+      t.buf = NULL;
+      tasks.push_back(t);
+    }
+  }
+
+  std::deque<std::string*> bufs;
+  size_t next = 0;
+  MutexLock ml(&mu);
+  while (true) {
+    while (next < tasks.size() && !ctx.stop &&
+           size_t(ctx.num_running) < max_running) {
+      ScanTask* const t = &tasks[next++];
+      t->buf = new std::string;
+      if (!ctx.sorted) t->buf->reserve(ctx.buffer_size + 64);
+      ctx.num_running++;
+      if (!bg) {
+        mu.Unlock();
+        RunScanTask(t);
+        mu.Lock();
+      } else if (options_.reader_pool != NULL) {
+        options_.reader_pool->Schedule(BGScan, t);
+      } else {
+        Env::Default()->Schedule(BGScan, t);
+      }
+    }
+    if (!ctx.ready.empty()) {
+      // Take all queued buffers at once
+      bufs.swap(ctx.ready);
+      ctx.space_cv.SignalAll();
+      mu.Unlock();
+      bool stop = false;
+      for (size_t i = 0; i < bufs.size(); i++) {
+        if (!stop) stop = !DeliverRecords(*bufs[i], saver, arg);
+        delete bufs[i];
+      }
+      bufs.clear();
+      mu.Lock();
+      if (stop) {
+        ctx.stop = true;
+        ctx.space_cv.SignalAll();
+      }
+    } else if (ctx.num_running == 0 && (next == tasks.size() || ctx.stop)) {
+      break;
+    } else {
+      ctx.cv.Wait();
+    }
+  }
+
+  // Merge the sorted results of all tasks
+  if (ctx.sorted && !ctx.stop) {
+    mu.Unlock();
+    std::vector<Run> runs(tasks.size());
+    std::priority_queue<Run*, std::vector<Run*>, RunGreater> heap;
+    for (size_t i = 0; i < tasks.size(); i++) {
+      runs[i].input = *tasks[i].buf;
+      runs[i].seq = i;
+      if (runs[i].Next()) {
+        heap.push(&runs[i]);
+      }
+    }
+    while (!heap.empty()) {
+      Run* const run = heap.top();
+      heap.pop();
+      if (saver(arg, run->current.key, run->current.value) == -1) {
+        break;
+      }
+      if (run->Next()) {
+        heap.push(run);
+      }
+    }
+    mu.Lock();
+  }
+
+  for (size_t i = 0; i < tasks.size(); i++) {
+    delete tasks[i].buf;
+  }
+  while (!ctx.ready.empty()) {
+    delete ctx.ready.front();
+    ctx.ready.pop_front();
+  }
+  if (ctx.status.ok()) {
+    if (op.table_seeks != NULL) {
+      *op.table_seeks = ctx.table_seeks;
+    }
+    if (op.seeks != NULL) {
+      *op.seeks = ctx.seeks;
+    }
+    if (op.n != NULL) {
+      *op.n = ctx.n;
+    }
+  }
+
+  return ctx.status;
+}
+
 // Perform a scan operation on all partitions.
 // Return OK on success, or a non-OK status on errors.
 Status DirReaderImpl::Scan(const ScanOp& op, ScanSaver saver, void* arg) {
+  if (op.sorted ||
+      (options_.parallel_reads && !op.no_parallel_reads &&
+       (options_.reader_pool != NULL || options_.allow_env_threads))) {
+    return ParallelScan(op, saver, arg);
+  }
   Status status;
-  MutexLock ml(&mutex_);
   Dir::ScanStats stats;
   stats.total_table_seeks = 0;
   stats.total_seeks = 0;
   stats.n = 0;
+  Dir* dir;
 
   for (uint32_t part = 0; part < num_parts_; part++) {
-    status = OpenDir(part);
+    status = AcquireDir(part, &dir);
     if (status.ok()) {
-      assert(dirs_[part] != NULL);
-      Dir* const dir = dirs_[part];
-      dir->Ref();
       Dir::ScanOptions opts;
       opts.epoch_start = op.epoch_start;
       opts.epoch_end = op.epoch_end;
@@ -1043,8 +1534,8 @@ Status DirReaderImpl::Scan(const ScanOp& op, ScanSaver saver, void* arg) {
       opts.tmp_length = sizeof(tmp);
       opts.tmp = tmp;
 
-      status = dirs_[part]->Scan(opts, &stats);
-      dir->Unref();
+      status = dir->Scan(opts, &stats);
+      ReleaseDir(dir);
     }
 
     if (!status.ok()) {
@@ -1074,16 +1565,23 @@ Status DirReaderImpl::Read(const ReadOp& op, const Slice& fid,
   Status status;
   uint32_t hash = Hash(fid.data(), fid.size(), 0);
   uint32_t part = hash & part_mask_;
-  MutexLock ml(&mutex_);
   Dir::ReadStats stats;
   stats.total_table_seeks = 0;
   stats.total_seeks = 0;
+  std::vector<KeyLocation> locs;
+  Dir* dir;
+
+  // With a trajectory index, absent keys are rejected without touching
+  // the partition and present keys are read directly from their blocks
+  if (traj_ != NULL) {
+    status = traj_->Get(part, fid, &locs);
+    if (!status.ok() || locs.empty()) {
+      return status;
+    }
+  }
 
-  status = OpenDir(part);
+  status = AcquireDir(part, &dir);
   if (status.ok()) {
-    assert(dirs_[part] != NULL);
-    Dir* const dir = dirs_[part];
-    dir->Ref();
     Dir::ReadOptions opts;
     opts.epoch_start = op.epoch_start;
     opts.epoch_end = op.epoch_end;
@@ -1092,8 +1590,71 @@ Status DirReaderImpl::Read(const ReadOp& op, const Slice& fid,
     opts.tmp_length = sizeof(tmp);
     opts.tmp = tmp;
 
-    status = dirs_[part]->Read(opts, fid, dst, &stats);
-    dir->Unref();
+    if (traj_ != NULL) {
+      status = dir->ReadLocations(opts, fid, locs, dst, &stats);
+    } else {
+      status = dir->Read(opts, fid, dst, &stats);
+    }
+    ReleaseDir(dir);
+  }
+
+  if (status.ok()) {
+    if (op.table_seeks != NULL) {
+      *op.table_seeks = stats.total_table_seeks;
+    }
+    if (op.seeks != NULL) {
+      *op.seeks = stats.total_seeks;
+    }
+  }
+
+  return status;
+}
+
+// Perform a read operation for a batch of keys. Keys are grouped by
+// partition and each partition is searched once for all its keys.
+// Return OK on success, or a non-OK status on errors.
+Status DirReaderImpl::MultiRead(const ReadOp& op,
+                                const std::vector<Slice>& fids,
+                                std::vector<std::string>* dsts) {
+  Status status;
+  dsts->clear();
+  dsts->resize(fids.size());
+  std::vector<std::vector<size_t> > parts(num_parts_);
+  for (size_t i = 0; i < fids.size(); i++) {
+    uint32_t hash = Hash(fids[i].data(), fids[i].size(), 0);
+    parts[hash & part_mask_].push_back(i);
+  }
+  Dir::ReadStats stats;
+  stats.total_table_seeks = 0;
+  stats.total_seeks = 0;
+  std::vector<Slice> keys;
+  std::vector<std::string*> part_dsts;
+  Dir* dir;
+
+  for (uint32_t part = 0; part < num_parts_; part++) {
+    if (parts[part].empty()) {
+      continue;
+    }
+    status = AcquireDir(part, &dir);
+    if (status.ok()) {
+      keys.clear();
+      part_dsts.clear();
+      for (size_t j = 0; j < parts[part].size(); j++) {
+        keys.push_back(fids[parts[part][j]]);
+        part_dsts.push_back(&(*dsts)[parts[part][j]]);
+      }
+      Dir::ReadOptions opts;
+      opts.epoch_start = op.epoch_start;
+      opts.epoch_end = op.epoch_end;
+      opts.force_serial_reads = op.no_parallel_reads;
+
+      status = dir->MultiRead(opts, keys, &part_dsts[0], &stats);
+      ReleaseDir(dir);
+    }
+
+    if (!status.ok()) {
+      break;
+    }
   }
 
   if (status.ok()) {
@@ -1115,13 +1676,72 @@ IoStats DirReaderImpl::TEST_iostats() const {
     if (dirs_[i] != NULL) {
       result.index_bytes += dirs_[i]->io_stats_.TotalBytes();
       result.index_ops += dirs_[i]->io_stats_.TotalOps();
+      result.index_bytes += dirs_[i]->lazy_io_stats_.TotalBytes();
+      result.index_ops += dirs_[i]->lazy_io_stats_.TotalOps();
+      result.index_memory += dirs_[i]->index_memory();
     }
   }
+  if (page_cache_ != NULL) {
+    result.index_memory += page_cache_->memory_usage();
+  }
+  result.index_bytes += traj_stats_.TotalBytes();
+  result.index_ops += traj_stats_.TotalOps();
   result.data_bytes = io_stats_.TotalBytes();
   result.data_ops = io_stats_.TotalOps();
+  if (block_cache_ != NULL) {
+    result.cache_hits = block_cache_->hits();
+    result.cache_misses = block_cache_->misses();
+  }
   return result;
 }
 
+namespace {
+void AddLocation(void* arg, const Slice& key, uint32_t epoch,
+                 const BlockHandle& block) {
+  reinterpret_cast<TrajectoryIndexBuilder*>(arg)->Add(key, epoch, block);
+}
+}  // namespace
+
+// Build a trajectory index for all partitions of the directory. Partitions
+// are processed one at a time so that only the keys of a single partition are
+// held in memory. Return OK on success, or a non-OK status on errors.
+Status DirReaderImpl::BuildTrajectoryIndex() {
+  Env* const env = options_.env;
+  const std::string fname = TrajectoryIndexFileName(name_, options_.rank);
+  WritableFile* file;
+  Status status = env->NewWritableFile(fname.c_str(), &file);
+  if (!status.ok()) {
+    return status;
+  }
+
+  TrajectoryIndexBuilder builder(options_, file);
+  Dir* dir;
+  for (uint32_t part = 0; part < num_parts_ && status.ok(); part++) {
+    status = AcquireDir(part, &dir);
+    if (status.ok()) {
+      status = dir->ListLocations(AddLocation, &builder);
+      ReleaseDir(dir);
+    }
+    if (status.ok()) {
+      status = builder.EndPartition();
+    }
+  }
+
+  if (status.ok()) {
+    status = builder.Finish();
+  }
+  if (status.ok()) {
+    status = file->Close();
+  } else {
+    file->Close();
+  }
+  delete file;
+  if (!status.ok()) {
+    env->DeleteFile(fname.c_str());
+  }
+  return status;
+}
+
 DirReader::CountOp::CountOp()
     : epoch_start(0), epoch_end(~static_cast<uint32_t>(0)) {}
 
@@ -1152,6 +1772,7 @@ DirReader::ScanOp::ScanOp()
     : epoch_start(0),
       epoch_end(~static_cast<uint32_t>(0)),
       no_parallel_reads(false),
+      sorted(false),
       table_seeks(NULL),
       seeks(NULL),
       n(NULL) {}
@@ -1175,6 +1796,8 @@ static std::string FilterName(FilterType type) {
       return "Bloom filter";
     case kFtBitmap:
       return "Bitmap";
+    case kFtCuckooFilter:
+      return "Cuckoo filter";
     default:
       return "Unk";
   }
@@ -1251,12 +1874,32 @@ Status DirReader::Open(const DirOptions& _opts, const std::string& dirname,
               : "None");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.read_size -> %s",
           PrettySize(options.read_size).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.readahead_size -> %s (depth=%d)",
+          PrettySize(options.readahead_size).c_str(), options.readahead_depth);
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.readahead_buffer -> %s",
+          PrettySize(options.readahead_buffer).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.readahead_pool -> %s",
+          options.readahead_pool != NULL
+              ? options.readahead_pool->ToDebugString().c_str()
+              : "None");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.block_cache_size -> %s",
+          PrettySize(options.block_cache_size).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.index_cache_size -> %s",
+          PrettySize(options.index_cache_size).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.index_page_size -> %s",
+          PrettySize(options.index_page_size).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.parallel_reads -> %s",
           int(options.parallel_reads) ? "Yes" : "No");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.scan_parallelism -> %d",
+          options.scan_parallelism);
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.scan_buffer_size -> %s",
+          PrettySize(options.scan_buffer_size).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.paranoid_checks -> %s",
           int(options.paranoid_checks) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.ignore_filters -> %s",
           int(options.ignore_filters) ? "Yes" : "No");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.ignore_trajectory_index -> %s",
+          int(options.ignore_trajectory_index) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.verify_checksums -> %s",
           int(options.verify_checksums) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.skip_checksums -> %s",
@@ -1313,6 +1956,10 @@ Status DirReader::Open(const DirOptions& _opts, const std::string& dirname,
   io_opts.sub_partition = -1;  // The data file does not have any sub-partitions
   if (options.epoch_log_rotation) io_opts.num_rotas = options.num_epochs + 1;
   if (options.measure_reads) io_opts.stats = &impl->io_stats_;
+  io_opts.readahead_size = options.readahead_size;
+  io_opts.readahead_depth = options.readahead_depth;
+  io_opts.readahead_buffer = options.readahead_buffer;
+  io_opts.readahead_pool = options.readahead_pool;
   io_opts.env = env;
   status = LogSource::Open(io_opts, dirname, &data);
   if (!status.ok()) {
@@ -1333,6 +1980,32 @@ Status DirReader::Open(const DirOptions& _opts, const std::string& dirname,
     }
   }
 
+  // Open the trajectory index if the directory has one. A bad index is
+  // ignored and reads fall back to the directory's own indexes.
+  if (status.ok() && !options.ignore_trajectory_index) {
+    const std::string fname = TrajectoryIndexFileName(dirname, my_rank);
+    uint64_t fsize;
+    if (env->GetFileSize(fname.c_str(), &fsize).ok()) {
+      RandomAccessFile* file;
+      Status s = env->NewRandomAccessFile(fname.c_str(), &file);
+      if (s.ok()) {
+        if (options.measure_reads) {
+          file = new MonitoredRandomAccessFile(&impl->traj_stats_, file);
+        }
+        s = TrajectoryIndex::Open(impl->options_, file, fsize, &impl->traj_);
+      }
+      if (s.ok() && impl->traj_->num_parts() != num_parts) {
+        s = Status::Corruption("Trajectory index partitions mismatch");
+        delete impl->traj_;
+        impl->traj_ = NULL;
+      }
+      if (!s.ok()) {
+        Warn(__LOG_ARGS__, "Cannot open trajectory index %s: %s",
+             fname.c_str(), s.ToString().c_str());
+      }
+    }
+  }
+
   if (status.ok()) {
     // Dir indexes to be fetched later
     impl->dirs_ = new Dir*[num_parts]();
@@ -1353,5 +2026,19 @@ Status DirReader::Open(const DirOptions& _opts, const std::string& dirname,
   return status;
 }
 
+Status BuildTrajectoryIndex(const DirOptions& _opts,
+                            const std::string& dirname) {
+  DirOptions options = _opts;
+  options.ignore_trajectory_index = true;  // Always read the dir itself
+  DirReader* reader;
+  Status status = DirReader::Open(options, dirname, &reader);
+  if (status.ok()) {
+    status = static_cast<DirReaderImpl*>(reader)->BuildTrajectoryIndex();
+    delete reader;
+  }
+
+  return status;
+}
+
 }  // namespace plfsio
 }  // namespace pdlfs
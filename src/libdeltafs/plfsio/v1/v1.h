@@ -13,6 +13,9 @@
 
 #include "types.h"
 
+#include <string>
+#include <vector>
+
 namespace pdlfs {
 namespace plfsio {
 
@@ -109,7 +112,9 @@ class DirWriter {
   Rep* rep_;
 };
 
-// Deltafs Plfs Dir Reader
+// Deltafs Plfs Dir Reader. Safe for concurrent use by multiple threads.
+// Reads against partitions that have already been opened proceed in parallel
+// without any reader-wide locking.
 class DirReader {
  public:
   DirReader() {}
@@ -146,19 +151,34 @@ class DirReader {
   // Return OK on success, or a non-OK status on errors.
   virtual Status Read(const ReadOp& op, const Slice& fid, std::string* dst) = 0;
 
-  // Default: scan all epochs and allow parallel reads
+  // Obtain the values to a batch of keys stored in a given epoch range.
+  // Values found for fids[i] are stored in (*dsts)[i]. Keys are grouped by
+  // partition and epoch so that indexes and filters are consulted once per
+  // batch and data blocks shared by multiple keys are fetched once.
+  // Report operation stats in *table_seeks and *seeks.
+  // Return OK on success, or a non-OK status on errors.
+  virtual Status MultiRead(const ReadOp& op, const std::vector<Slice>& fids,
+                           std::vector<std::string>* dsts) = 0;
+
+  // Default: scan all epochs, allow parallel reads, and return results in no
+  // particular order
   struct ScanOp {
     ScanOp();
     void SetEpoch(int epoch);
     uint32_t epoch_start;
     uint32_t epoch_end;
     bool no_parallel_reads;
+    // Return results in key order. Values of the same key are returned in
+    // epoch order. All results are buffered in memory before being returned.
+    bool sorted;
     size_t* table_seeks;
     size_t* seeks;
     size_t* n;
   };
   typedef int (*ScanSaver)(void* arg, const Slice& key, const Slice& value);
-  // List all keys stored in a given epoch range.
+  // List all keys stored in a given epoch range. With parallel reads, all
+  // partitions and epochs are scanned concurrently. The callback is always
+  // invoked from the calling thread.
   // Report operation stats in *table_seeks, *seeks, and *n.
   // Return OK on success, or a non-OK status on errors.
   virtual Status Scan(const ScanOp& op, ScanSaver, void*) = 0;
@@ -172,5 +192,14 @@ class DirReader {
   DirReader(const DirReader&);
 };
 
+// Build a trajectory index for a finished directory. The index maps each key
+// to the data blocks holding it across all epochs and is stored as a sidecar
+// file next to the directory's log files. Dir readers opened afterwards use it
+// automatically, so a read spanning N epochs costs one index lookup plus at
+// most N data block reads. An existing index is overwritten.
+// Return OK on success, or a non-OK status on errors.
+extern Status BuildTrajectoryIndex(const DirOptions& options,
+                                   const std::string& dirname);
+
 }  // namespace plfsio
 }  // namespace pdlfs
@@ -17,6 +17,7 @@
 #include "pdlfs-common/histogram.h"
 #include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/port.h"
+#include "pdlfs-common/random.h"
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 #include "pdlfs-common/xxhash.h"
@@ -58,6 +59,14 @@ class WriteBufTest {
     delete buf_;  // Done
   }
 
+  // Recreate the buffer to apply new options.
+  void Reopen() {
+    delete buf_;
+    buf_ = new WriteBuffer(options_);
+    kv_.clear();
+    num_entries_ = 0;
+  }
+
   Iterator* Flush() {
     buf_->Finish();
     ASSERT_EQ(buf_->NumEntries(), num_entries_);
@@ -74,6 +83,27 @@ class WriteBufTest {
     num_entries_++;
   }
 
+  void AddKey(const std::string& key) {
+    std::string value;
+    test::RandomString(&rnd_, value_size, &value);
+    kv_.insert(std::make_pair(key, value));
+    buf_->Add(key, value);
+    num_entries_++;
+  }
+
+  // Check that the iterator returns all keys in order.
+  void CheckAll(Iterator* iter) {
+    iter->SeekToFirst();
+    std::map<std::string, std::string>::iterator it = kv_.begin();
+    for (; it != kv_.end(); ++it) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_TRUE(iter->key() == it->first);
+      ASSERT_TRUE(iter->value() == it->second);
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+  }
+
   void CheckFirst(Iterator* iter) {
     iter->SeekToFirst();
     ASSERT_TRUE(iter->Valid());
@@ -112,6 +142,58 @@ TEST(WriteBufTest<>, FixedSizedValue) {
   delete iter;
 }
 
+TEST(WriteBufTest<>, RadixSort) {
+  for (int i = 0; i < 10000; i++) {
+    Add(rnd_.Next64());
+  }
+  Iterator* iter = Flush();
+  CheckAll(iter);
+  delete iter;
+}
+
+TEST(WriteBufTest<>, RadixSortVarLenKeys) {
+  char tmp[30];
+  for (int i = 0; i < 3000; i++) {
+    // Many keys share the same 8-byte prefix
+    snprintf(tmp, sizeof(tmp), "particle-%d", (i * 7919) % 100000);
+    AddKey(tmp);
+    snprintf(tmp, sizeof(tmp), "p%d", i);
+    AddKey(tmp);
+  }
+  AddKey(std::string("p1\0", 3));
+  AddKey(std::string("p1\0\0\0\0\0\0\0", 9));
+  Iterator* iter = Flush();
+  CheckAll(iter);
+  delete iter;
+}
+
+TEST(WriteBufTest<>, ComparisonSort) {
+  options_.radix_sort = false;
+  Reopen();
+  for (int i = 0; i < 10000; i++) {
+    Add(rnd_.Next64());
+  }
+  Iterator* iter = Flush();
+  CheckAll(iter);
+  delete iter;
+}
+
+TEST(WriteBufTest<>, ParallelRadixSort) {
+  ThreadPool* pool = ThreadPool::NewFixed(4, true);
+  options_.compaction_pool = pool;
+  options_.sort_helpers = 4;
+  Reopen();
+  for (int i = 0; i < (100 << 10); i++) {
+    Add(rnd_.Next64());
+  }
+  Iterator* iter = Flush();
+  CheckAll(iter);
+  delete iter;
+  delete buf_;
+  buf_ = NULL;
+  delete pool;
+}
+
 class PlfsIoTest {
  public:
   PlfsIoTest() {
@@ -199,6 +281,25 @@ class PlfsIoTest {
     return tmp;
   }
 
+  std::vector<std::string> MultiRead(const std::vector<std::string>& keys) {
+    std::vector<std::string> tmp;
+    std::vector<Slice> fids(keys.begin(), keys.end());
+    DirReader::ReadOp op;
+    if (writer_ != NULL) Finish();
+    if (reader_ == NULL) OpenReader();
+    ASSERT_OK(reader_->MultiRead(op, fids, &tmp));
+    return tmp;
+  }
+
+  // Check MultiRead against Read for a given set of keys.
+  void CheckMultiRead(const std::vector<std::string>& keys) {
+    std::vector<std::string> vals = MultiRead(keys);
+    ASSERT_EQ(vals.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(vals[i], Read(keys[i])) << keys[i];
+    }
+  }
+
   std::string Read(const Slice& key) {
     std::string tmp;
     DirReader::ReadOp op;
@@ -394,6 +495,171 @@ TEST(PlfsIoTest, Snappy2) {
   ASSERT_EQ(Count(3), 0);
 }
 
+// Blocks are stored uncompressed if zstd is not compiled in.
+TEST(PlfsIoTest, Zstd) {
+  static const char dict[] = "v1v2v3v4v5v6k1k2";
+  options_.compression = kZstdCompression;
+  options_.index_compression = kZstdCompression;
+  options_.compression_level = 19;
+  options_.compression_dict = Slice(dict, sizeof(dict) - 1);
+  options_.force_compression = true;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k2", "v4");
+  MakeEpoch();
+  Append("k1", "v5");
+  Append("k2", "v6");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v3v5");
+  ASSERT_TRUE(Read("k1.1").empty());
+  ASSERT_EQ(Read("k2"), "v2v4v6");
+  ASSERT_EQ(Scan(0), "v1v2");
+  ASSERT_EQ(Scan(1), "v3v4");
+  ASSERT_EQ(Scan(2), "v5v6");
+  ASSERT_EQ(Count(0), 2);
+  ASSERT_EQ(Count(1), 2);
+  ASSERT_EQ(Count(2), 2);
+  ASSERT_EQ(Count(3), 0);
+}
+
+// Blocks are stored uncompressed if lz4 is not compiled in.
+TEST(PlfsIoTest, Lz4) {
+  options_.compression = kLz4Compression;
+  options_.index_compression = kLz4Compression;
+  options_.force_compression = true;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k2", "v4");
+  MakeEpoch();
+  Append("k1", "v5");
+  Append("k2", "v6");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v3v5");
+  ASSERT_TRUE(Read("k1.1").empty());
+  ASSERT_EQ(Read("k2"), "v2v4v6");
+  ASSERT_EQ(Scan(0), "v1v2");
+  ASSERT_EQ(Scan(1), "v3v4");
+  ASSERT_EQ(Scan(2), "v5v6");
+  ASSERT_EQ(Count(0), 2);
+  ASSERT_EQ(Count(1), 2);
+  ASSERT_EQ(Count(2), 2);
+  ASSERT_EQ(Count(3), 0);
+}
+
+// Data blocks are compressed by a separate pool and committed in order.
+TEST(PlfsIoTest, ParallelCompression) {
+  options_.compression = kLz4Compression;
+  options_.force_compression = true;
+  options_.compression_pool = ThreadPool::NewFixed(2);
+  options_.lg_parts = 1;
+  options_.block_size = 1 << 10;        // Spread keys over many data blocks
+  options_.block_batch_size = 8 << 10;  // And many commits
+  char tmp[20];
+  for (int padding = 1; padding >= 0; padding--) {
+    options_.block_padding = padding != 0;
+    for (int e = 0; e < 2; e++) {
+      for (int i = e; i < 3000; i += 2) {
+        snprintf(tmp, sizeof(tmp), "k%05d", i);
+        Append(Slice(tmp), Slice(tmp + 1));
+      }
+      MakeEpoch();
+    }
+    for (int i = 0; i < 3000; i += 7) {
+      snprintf(tmp, sizeof(tmp), "k%05d", i);
+      ASSERT_EQ(Read(Slice(tmp)), tmp + 1);
+    }
+    ASSERT_TRUE(Read("k03000").empty());
+    ASSERT_EQ(Count(0), 1500);
+    ASSERT_EQ(Count(1), 1500);
+    ASSERT_EQ(Scan(1).size(), 1500 * 5);
+    delete reader_;
+    reader_ = NULL;
+    epoch_ = 0;
+  }
+  delete options_.compression_pool;
+}
+
+TEST(PlfsIoTest, BlockCache) {
+  // Blocks read from mmapped files are never cached
+  options_.env = Env::GetUnBufferedIoEnv();
+  options_.block_cache_size = 4 << 20;
+  options_.index_compression = kSnappyCompression;
+  options_.force_compression = true;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k2", "v4");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v3");
+  IoStats stats = reader_->TEST_iostats();
+  const uint64_t data_ops = stats.data_ops;
+  ASSERT_EQ(stats.cache_hits, 0);
+  ASSERT_TRUE(stats.cache_misses != 0);
+  ASSERT_EQ(Read("k1"), "v1v3");
+  ASSERT_EQ(Read("k2"), "v2v4");
+  ASSERT_EQ(Scan(0), "v1v2");
+  ASSERT_EQ(Scan(1), "v3v4");
+  stats = reader_->TEST_iostats();
+  ASSERT_TRUE(stats.cache_hits != 0);
+  ASSERT_EQ(stats.data_ops, data_ops);  // All data blocks served from cache
+}
+
+TEST(PlfsIoTest, MultiRead) {
+  options_.lg_parts = 1;
+  options_.block_size = 256;  // Spread keys over many data blocks
+  options_.block_padding = false;
+  char tmp[20];
+  for (int e = 0; e < 3; e++) {
+    for (int i = e; i < 1000; i += 2) {
+      snprintf(tmp, sizeof(tmp), "k%05d", i);
+      Append(Slice(tmp), Slice(tmp + 1));
+    }
+    MakeEpoch();
+  }
+  std::vector<std::string> keys;
+  for (int i = 1001; i >= 0; i -= 3) {  // Unsorted, with missing keys
+    snprintf(tmp, sizeof(tmp), "k%05d", i);
+    keys.push_back(tmp);
+  }
+  keys.push_back("k00010");  // Duplicated key
+  CheckMultiRead(keys);
+  ASSERT_EQ(MultiRead(keys).back(), "0001000010");
+  options_.parallel_reads = true;
+  options_.reader_pool = ThreadPool::NewFixed(2);
+  delete reader_;
+  reader_ = NULL;
+  CheckMultiRead(keys);
+  delete reader_;
+  reader_ = NULL;
+  delete options_.reader_pool;
+}
+
+TEST(PlfsIoTest, MultiReadMultiMap) {
+  options_.mode = kDmMultiMap;
+  Append("k1", "v1");
+  Append("k1", "v2");
+  Append("k2", "v3");
+  MakeEpoch();
+  Append("k2", "v4");
+  Append("k3", "v5");
+  MakeEpoch();
+  std::vector<std::string> keys;
+  keys.push_back("k3");
+  keys.push_back("k2");
+  keys.push_back("k1");
+  keys.push_back("k0");
+  std::vector<std::string> vals = MultiRead(keys);
+  ASSERT_EQ(vals[0], "v5");
+  ASSERT_EQ(vals[1], "v3v4");
+  ASSERT_EQ(vals[2], "v1v2");
+  ASSERT_TRUE(vals[3].empty());
+}
+
 TEST(PlfsIoTest, LargeBatch) {
   const std::string dummy_val(32, 'x');
   const int batch_size = 64 << 10;
@@ -449,6 +715,156 @@ TEST(PlfsIoTest, NoFilter) {
   ASSERT_EQ(Count(3), 0);
 }
 
+TEST(PlfsIoTest, LazyIndex) {
+  options_.index_cache_size = 4 << 10;  // Forces page evictions
+  options_.index_page_size = 512;
+  options_.block_size = 256;
+  options_.measure_reads = true;
+  char tmp[20];
+  for (int e = 0; e < 3; e++) {
+    for (int i = 0; i < 500; i++) {
+      snprintf(tmp, sizeof(tmp), "k%06d", i * 3 + e);
+      Append(tmp, tmp);
+    }
+    MakeEpoch();
+  }
+  for (int i = 0; i < 1500; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d", i);
+    ASSERT_EQ(Read(tmp), tmp);
+    snprintf(tmp, sizeof(tmp), "k%06d.1", i);
+    ASSERT_TRUE(Read(tmp).empty());
+  }
+  const IoStats stats = reader_->TEST_iostats();
+  ASSERT_TRUE(stats.index_ops != 0);
+  ASSERT_LE(stats.index_memory, options_.index_cache_size);
+  ASSERT_EQ(Count(-1), 1500);
+  ASSERT_EQ(Scan(1).size(), 500 * 7);
+}
+
+TEST(PlfsIoTest, CuckooFilter) {
+  options_.filter = kFtCuckooFilter;
+  options_.block_size = 256;
+  char tmp[20];
+  for (int i = 0; i < 2000; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d", i);
+    Append(tmp, tmp);
+  }
+  MakeEpoch();
+  for (int i = 0; i < 2000; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d", i);
+    ASSERT_EQ(Read(tmp), tmp);
+  }
+  const uint64_t data_ops = reader_->TEST_iostats().data_ops;
+  for (int i = 0; i < 2000; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d.1", i);
+    ASSERT_TRUE(Read(tmp).empty());
+  }
+  // Expect almost no data reads for absent keys
+  ASSERT_LE(reader_->TEST_iostats().data_ops - data_ops, 10);
+  ASSERT_EQ(Count(0), 2000);
+}
+
+TEST(PlfsIoTest, CuckooFilterMultiMap) {
+  options_.filter = kFtCuckooFilter;
+  options_.mode = kDmMultiMap;
+  options_.block_size = 256;
+  std::string expected;
+  char tmp[20];
+  for (int i = 0; i < 500; i++) {
+    snprintf(tmp, sizeof(tmp), "v%03d", i);
+    Append("k1", tmp);
+    expected += tmp;
+    Append(tmp, tmp);
+  }
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), expected);
+  ASSERT_EQ(Read("v042"), "v042");
+  ASSERT_TRUE(Read("k2").empty());
+}
+
+TEST(PlfsIoTest, EpochFilter) {
+  options_.epoch_filter = true;
+  options_.bf_bits_per_key = 0;  // No table filters
+  options_.block_size = 256;
+  char tmp[20];
+  for (int e = 0; e < 2; e++) {
+    for (int i = 0; i < 2000; i++) {
+      snprintf(tmp, sizeof(tmp), "k%d%06d", e, i);
+      Append(tmp, tmp);
+      if (i % 250 == 249) {  // Start a new table
+        ASSERT_OK(writer_->Flush(epoch_));
+      }
+    }
+    MakeEpoch();
+  }
+  for (int e = 0; e < 2; e++) {
+    for (int i = 0; i < 2000; i++) {
+      snprintf(tmp, sizeof(tmp), "k%d%06d", e, i);
+      ASSERT_EQ(Read(tmp), tmp);
+    }
+  }
+  const uint64_t data_ops = reader_->TEST_iostats().data_ops;
+  for (int i = 0; i < 2000; i++) {
+    snprintf(tmp, sizeof(tmp), "k0%06d.1", i);
+    ASSERT_TRUE(Read(tmp).empty());
+  }
+  // Expect almost no data reads for absent keys
+  ASSERT_LE(reader_->TEST_iostats().data_ops - data_ops, 10);
+  ASSERT_EQ(Count(0), 2000);
+  ASSERT_EQ(Count(1), 2000);
+}
+
+TEST(PlfsIoTest, TrajectoryIndex) {
+  options_.mode = kDmMultiMap;
+  options_.block_size = 256;
+  char tmp[20];
+  for (int e = 0; e < 5; e++) {
+    if (e != 2) {  // Leave epoch 2 empty
+      for (int i = 0; i < 500; i++) {
+        snprintf(tmp, sizeof(tmp), "k%06d", i);
+        Append(tmp, tmp);
+        if (i == 7) {  // A second value within the same block
+          Append(tmp, "x");
+        }
+        if (i % 100 == 99) {  // Start a new table
+          ASSERT_OK(writer_->Flush(epoch_));
+        }
+      }
+    }
+    MakeEpoch();
+  }
+  Finish();
+  std::vector<std::string> expected;
+  for (int i = 0; i < 500; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d", i);
+    expected.push_back(Read(tmp));
+  }
+  ASSERT_EQ(expected[7], "k000007xk000007xk000007xk000007x");
+  delete reader_;
+  reader_ = NULL;
+  ASSERT_OK(BuildTrajectoryIndex(options_, dirname_));
+  OpenReader();
+  for (int i = 0; i < 500; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d", i);
+    const uint64_t data_ops = reader_->TEST_iostats().data_ops;
+    ASSERT_EQ(Read(tmp), expected[i]);
+    // One data block read per non-empty epoch
+    ASSERT_LE(reader_->TEST_iostats().data_ops - data_ops, 4);
+  }
+  const uint64_t data_ops = reader_->TEST_iostats().data_ops;
+  for (int i = 0; i < 500; i++) {
+    snprintf(tmp, sizeof(tmp), "k%06d.1", i);
+    ASSERT_TRUE(Read(tmp).empty());
+  }
+  ASSERT_EQ(reader_->TEST_iostats().data_ops, data_ops);
+  DirReader::ReadOp op;
+  op.epoch_start = 1;
+  op.epoch_end = 4;
+  std::string dst;
+  ASSERT_OK(reader_->Read(op, "k000007", &dst));
+  ASSERT_EQ(dst, "k000007xk000007x");
+}
+
 TEST(PlfsIoTest, LogRotation) {
   options_.epoch_log_rotation = true;
   Append("k1", "v1");
@@ -478,6 +894,232 @@ TEST(PlfsIoTest, MultiMap) {
   ASSERT_EQ(Read("k1"), "v1v2v4v5v6v7v9");
 }
 
+namespace {
+struct WriterState {
+  port::Mutex mu;
+  port::CondVar cv;
+  DirWriter* writer;
+  int num_running;
+  int next_id;
+  Status status;
+  WriterState() : cv(&mu), writer(NULL), num_running(0), next_id(0) {}
+};
+
+void WriteKeys(void* arg) {
+  WriterState* const st = reinterpret_cast<WriterState*>(arg);
+  st->mu.Lock();
+  const int id = st->next_id++;
+  st->mu.Unlock();
+  char tmp[20];
+  Status s;
+  for (int i = 0; i < 1000 && s.ok(); i++) {
+    snprintf(tmp, sizeof(tmp), "t%d-k%d", id, i);
+    s = st->writer->Add(tmp, tmp, 0);
+  }
+  MutexLock ml(&st->mu);
+  if (!s.ok() && st->status.ok()) st->status = s;
+  st->num_running--;
+  st->cv.SignalAll();
+}
+}  // namespace
+
+TEST(PlfsIoTest, ConcurrentWriters) {
+  options_.total_memtable_budget = 4 << 20;
+  options_.allow_env_threads = true;
+  options_.lg_parts = 2;
+  OpenWriter();
+  WriterState state;
+  state.writer = writer_;
+  state.num_running = 4;
+  for (int i = 0; i < 4; i++) {
+    Env::Default()->StartThread(WriteKeys, &state);
+  }
+  {
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_OK(state.status);
+  MakeEpoch();
+  ASSERT_EQ(Count(0), 4000);
+  ASSERT_EQ(Read("t0-k0"), "t0-k0");
+  ASSERT_EQ(Read("t1-k499"), "t1-k499");
+  ASSERT_EQ(Read("t2-k999"), "t2-k999");
+  ASSERT_EQ(Read("t3-k123"), "t3-k123");
+  ASSERT_TRUE(Read("t4-k0").empty());
+}
+
+namespace {
+struct ReaderState {
+  port::Mutex mu;
+  port::CondVar cv;
+  DirReader* reader;
+  int num_running;
+  int next_id;
+  int num_errors;
+  Status status;
+  ReaderState()
+      : cv(&mu), reader(NULL), num_running(0), next_id(0), num_errors(0) {}
+};
+
+void ReadKeys(void* arg) {
+  ReaderState* const st = reinterpret_cast<ReaderState*>(arg);
+  st->mu.Lock();
+  const int id = st->next_id++;
+  st->mu.Unlock();
+  std::string expected;
+  std::string dst;
+  char tmp[20];
+  int errors = 0;
+  Status s;
+  for (int i = 0; i < 1000 && s.ok(); i++) {
+    snprintf(tmp, sizeof(tmp), "t%d-k%d", id, i);
+    expected = std::string(tmp) + tmp;  // One copy per epoch
+    dst.clear();
+    DirReader::ReadOp op;
+    s = st->reader->Read(op, tmp, &dst);
+    if (s.ok() && dst != expected) errors++;
+  }
+  if (s.ok()) {
+    size_t n = 0;
+    s = st->reader->Count(DirReader::CountOp(), &n);
+    if (s.ok() && n != 8000) errors++;
+  }
+  MutexLock ml(&st->mu);
+  if (!s.ok() && st->status.ok()) st->status = s;
+  st->num_errors += errors;
+  st->num_running--;
+  st->cv.SignalAll();
+}
+}  // namespace
+
+// Multiple threads share a single reader. Partitions are opened
+// lazily by whichever thread touches them first.
+TEST(PlfsIoTest, ConcurrentReaders) {
+  options_.total_memtable_budget = 4 << 20;
+  options_.lg_parts = 2;
+  char tmp[20];
+  for (int e = 0; e < 2; e++) {
+    for (int t = 0; t < 4; t++) {
+      for (int i = 0; i < 1000; i++) {
+        snprintf(tmp, sizeof(tmp), "t%d-k%d", t, i);
+        Append(tmp, tmp);
+      }
+    }
+    MakeEpoch();
+  }
+  Finish();
+  OpenReader();
+  ReaderState state;
+  state.reader = reader_;
+  state.num_running = 4;
+  for (int i = 0; i < 4; i++) {
+    Env::Default()->StartThread(ReadKeys, &state);
+  }
+  {
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_OK(state.status);
+  ASSERT_EQ(state.num_errors, 0);
+}
+
+namespace {
+int SaveRecord(void* arg, const Slice& key, const Slice& value) {
+  std::vector<std::string>* const records =
+      reinterpret_cast<std::vector<std::string>*>(arg);
+  records->push_back(key.ToString() + "=" + value.ToString());
+  return 0;
+}
+}  // namespace
+
+TEST(PlfsIoTest, ParallelScan) {
+  options_.total_memtable_budget = 4 << 20;
+  options_.mode = kDmMultiMap;
+  options_.lg_parts = 2;
+  options_.block_size = 256;
+  char tmp[20];
+  for (int e = 0; e < 3; e++) {
+    for (int i = 0; i < 1000; i++) {
+      snprintf(tmp, sizeof(tmp), "k%04d", (i * 7919) % 1000);
+      Append(tmp, std::string(1, char('a' + e)));
+    }
+    MakeEpoch();
+  }
+  Finish();
+  std::vector<std::string> expected;
+  for (int i = 0; i < 1000; i++) {
+    for (int e = 0; e < 3; e++) {
+      snprintf(tmp, sizeof(tmp), "k%04d=%c", i, char('a' + e));
+      expected.push_back(tmp);
+    }
+  }
+  options_.parallel_reads = true;
+  options_.allow_env_threads = true;
+  options_.scan_parallelism = 3;
+  options_.scan_buffer_size = 256;
+  OpenReader();
+  DirReader::ScanOp op;
+  size_t n = 0;
+  op.n = &n;
+  std::vector<std::string> results;
+  ASSERT_OK(reader_->Scan(op, SaveRecord, &results));
+  ASSERT_EQ(n, expected.size());
+  std::sort(results.begin(), results.end());
+  ASSERT_TRUE(results == expected);
+  op.sorted = true;
+  results.clear();
+  ASSERT_OK(reader_->Scan(op, SaveRecord, &results));
+  ASSERT_TRUE(results == expected);
+  // Sorted scans without background threads
+  op.no_parallel_reads = true;
+  results.clear();
+  ASSERT_OK(reader_->Scan(op, SaveRecord, &results));
+  ASSERT_TRUE(results == expected);
+}
+
+TEST(PlfsIoTest, ReadAhead) {
+  options_.block_size = 512;
+  char tmp[20];
+  for (int e = 0; e < 2; e++) {
+    for (int i = 0; i < 2000; i++) {
+      snprintf(tmp, sizeof(tmp), "k%d%06d", e, i);
+      Append(tmp, tmp);
+      if (i % 500 == 499) {  // Start a new table
+        ASSERT_OK(writer_->Flush(epoch_));
+      }
+    }
+    MakeEpoch();
+  }
+  Finish();
+  std::string expected = Scan(-1);
+  ASSERT_EQ(expected.size(), 4000 * 8);
+  const uint64_t data_ops = reader_->TEST_iostats().data_ops;
+  delete reader_;
+  reader_ = NULL;
+  ThreadPool* const pool = ThreadPool::NewFixed(2);
+  for (int i = 0; i < 2; i++) {
+    options_.readahead_size = 16 << 10;
+    options_.readahead_buffer = 64 << 10;
+    options_.readahead_pool = i == 0 ? NULL : pool;
+    OpenReader();
+    const uint64_t open_ops = reader_->TEST_iostats().data_ops;
+    ASSERT_EQ(Scan(-1), expected);
+    // Most blocks are served from windows read ahead
+    ASSERT_LT(reader_->TEST_iostats().data_ops - open_ops, data_ops / 4);
+    for (int j = 0; j < 2000; j += 7) {
+      snprintf(tmp, sizeof(tmp), "k1%06d", j);
+      ASSERT_EQ(Read(tmp), tmp);
+    }
+    delete reader_;
+    reader_ = NULL;
+  }
+  delete pool;
+}
+
 namespace {
 
 class WriteLock {
@@ -615,6 +1257,8 @@ class PlfsIoBench {
       return deffmt;
     } else if (strcmp(env, "bf") == 0) {
       return deffmt;
+    } else if (strcmp(env, "cf") == 0) {
+      return deffmt;
     } else if (strcmp(env, "bmp") == 0) {
       return kFmtUncompressed;
     } else if (strcmp(env, "r") == 0) {
@@ -643,6 +1287,8 @@ class PlfsIoBench {
       return deftype;
     } else if (strcmp(env, "bf") == 0) {
       return kFtBloomFilter;
+    } else if (strcmp(env, "cf") == 0) {
+      return kFtCuckooFilter;
     } else if (strcmp(env, "bmp") == 0) {
       return kFtBitmap;
     } else if (strcmp(env, "r") == 0) {
@@ -749,6 +1395,9 @@ class PlfsIoBench {
     mfiles_ = GetOption("NUM_FILES", 16);  // 16 million per epoch
 
     num_threads_ = GetOption("NUM_THREADS", 4);  // Threads for bg compaction
+    num_writers_ = GetOption("NUM_WRITERS", 1);  // Threads for inserting data
+    // Threads for compressing data blocks
+    num_compression_threads_ = GetOption("COMPRESSION_THREADS", 0);
     // For advanced perf diagnosis
     print_events_ = GetOption("PRINT_EVENTS", false);
     force_fifo_ = GetOption("FORCE_FIFO", false);
@@ -764,6 +1413,8 @@ class PlfsIoBench {
 #endif
     }
     options_.lg_parts = GetOption("LG_PARTS", 2);
+    // Keys inserted by concurrent writers won't arrive in order
+    if (num_writers_ > 1) ordered_keys_ = false;
     options_.skip_sort = ordered_keys_ != 0;
     options_.leveldb_compatible = GetOption("LEVELDB_FMT", true) != 0;
     options_.fixed_kv_length = GetOption("FIXED_KV", true) != 0;
@@ -786,6 +1437,7 @@ class PlfsIoBench {
     options_.filter = GetFilterType(kFtBloomFilter);
     options_.filter_bits_per_key =
         static_cast<size_t>(GetOption("FT_BITS", 16));
+    options_.epoch_filter = GetOption("EPOCH_FILTER", false) != 0;
     options_.value_size = static_cast<size_t>(GetOption("VALUE_SIZE", 40));
     options_.key_size = static_cast<size_t>(GetOption("KEY_SIZE", 8));
     options_.data_buffer =
@@ -944,6 +1596,65 @@ class PlfsIoBench {
     char key_[20];
   };
 
+  // State shared by all concurrent writer threads.
+  struct InsertState {
+    InsertState() : cv(&mu), num_running(0) {}
+    port::Mutex mu;
+    port::CondVar cv;
+    int num_running;
+    Status status;
+  };
+
+  // Each writer thread inserts a disjoint range of keys.
+  struct InsertTask {
+    PlfsIoBench* bench;
+    InsertState* state;
+    int base_offset;
+    int size;
+  };
+
+  static void InsertWork(void* arg) {
+    InsertTask* const t = reinterpret_cast<InsertTask*>(arg);
+    PlfsIoBench* const b = t->bench;
+    BigBatch batch(b->options_, b->keys_, t->base_offset, t->size);
+    batch.Seek(0);
+    Status s;
+    while (batch.Valid()) {
+      s = b->writer_->Add(batch.fid(), batch.data(), 0);
+      if (s.ok()) {
+        batch.Next();
+      } else {
+        break;
+      }
+    }
+    MutexLock ml(&t->state->mu);
+    if (t->state->status.ok()) t->state->status = s;
+    assert(t->state->num_running > 0);
+    t->state->num_running--;
+    t->state->cv.SignalAll();
+  }
+
+  // Insert keys using num_writers_ threads and wait for all of them to finish.
+  Status ParallelInsert(int num_files) {
+    InsertState state;
+    std::vector<InsertTask> tasks(static_cast<size_t>(num_writers_));
+    state.num_running = num_writers_;
+    for (int i = 0; i < num_writers_; i++) {
+      const int64_t n = num_files;
+      tasks[i].bench = this;
+      tasks[i].state = &state;
+      tasks[i].base_offset = static_cast<int>(n * i / num_writers_);
+      tasks[i].size =
+          static_cast<int>(n * (i + 1) / num_writers_) - tasks[i].base_offset;
+      Env::Default()->StartThread(InsertWork, &tasks[i]);
+    }
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+    return state.status;
+  }
+
 #if defined(PDLFS_PLATFORM_POSIX) && defined(PDLFS_OS_LINUX)
   void* MaybeForceFifoScheduling(pthread_attr_t* attr) {
     if (!force_fifo_) return NULL;
@@ -982,6 +1693,10 @@ class PlfsIoBench {
       options_.allow_env_threads = false;
       options_.compaction_pool = NULL;
     }
+    if (num_compression_threads_ != 0) {
+      options_.compression_pool =
+          ThreadPool::NewFixed(num_compression_threads_, true);
+    }
     bool owns_env = false;
     if (env_ == NULL) {
       const uint64_t speed = static_cast<uint64_t>(mbps_ << 20);
@@ -1000,21 +1715,26 @@ class PlfsIoBench {
     const uint64_t start = CurrentMicros();
     fprintf(stderr, "Inserting data...\n");
     const int num_files = (mfiles_ << 20);
-    BigBatch batch(options_, keys_, 0, num_files);
-    batch.Seek(0);
-    for (int i = 0; i < num_files; i++) {
-      // Report progress
-      if ((i & 0x7FFFF) == 0) {
-        fprintf(stderr, "\r%.2f%%", 100.0 * i / num_files);
-      }
-      s = writer_->Add(batch.fid(), batch.data(), 0);
-      if (s.ok()) {
-        batch.Next();
-      } else {
-        break;
+    if (num_writers_ > 1) {
+      s = ParallelInsert(num_files);
+    } else {
+      BigBatch batch(options_, keys_, 0, num_files);
+      batch.Seek(0);
+      for (int i = 0; i < num_files; i++) {
+        // Report progress
+        if ((i & 0x7FFFF) == 0) {
+          fprintf(stderr, "\r%.2f%%", 100.0 * i / num_files);
+        }
+        s = writer_->Add(batch.fid(), batch.data(), 0);
+        if (s.ok()) {
+          batch.Next();
+        } else {
+          break;
+        }
       }
     }
     ASSERT_OK(s) << "Cannot write";
+    const uint64_t insert_dura = CurrentMicros() - start;
     fprintf(stderr, "\r100.00%%");
     fprintf(stderr, "\n");
 
@@ -1027,9 +1747,9 @@ class PlfsIoBench {
     const uint64_t end = CurrentMicros();
     const uint64_t dura = end - start;
 #ifdef PDLFS_PLATFORM_POSIX
-    PrintStats(tmp_usage, dura, owns_env);
+    PrintStats(tmp_usage, dura, insert_dura, owns_env);
 #else
-    PrintStats(dura, owns_env);
+    PrintStats(dura, insert_dura, owns_env);
 #endif
     if (print_events_) {
       printer_.PrintEvents();
@@ -1042,6 +1762,8 @@ class PlfsIoBench {
       delete options_.compaction_pool;
       options_.compaction_pool = NULL;
     }
+    delete options_.compression_pool;
+    options_.compression_pool = NULL;
     if (owns_env) {
       delete options_.env;
       options_.env = NULL;
@@ -1061,6 +1783,8 @@ class PlfsIoBench {
         return "BF (std bloom filter)";
       case kFtBitmap:
         return "BM (bitmap)";
+      case kFtCuckooFilter:
+        return "CF (cuckoo filter)";
       default:
         return "Unknown";
     }
@@ -1089,9 +1813,9 @@ class PlfsIoBench {
 
 #ifdef PDLFS_PLATFORM_POSIX
   void PrintStats(const struct rusage& tmp_usage, uint64_t dura,
-                  bool owns_env) {
+                  uint64_t insert_dura, bool owns_env) {
 #else
-  void PrintStats(uint64_t dura, bool owns_env) {
+  void PrintStats(uint64_t dura, uint64_t insert_dura, bool owns_env) {
 #endif
     const double k = 1000.0, ki = 1024.0;
     fprintf(stderr, "----------------------------------------\n");
@@ -1141,6 +1865,8 @@ class PlfsIoBench {
       fprintf(stderr, "                 BM Fmt: %s\n",
               ToString(options_.bm_fmt));
     }
+    fprintf(stderr, "           Epoch Filter: %s\n",
+            options_.epoch_filter ? "Yes" : "No");
     fprintf(stderr, "     Num Files Inserted: %d M\n", mfiles_);
     fprintf(stderr, "        Logic File Data: %d MiB\n",
             int((options_.key_size + options_.value_size) * mfiles_));
@@ -1154,6 +1880,8 @@ class PlfsIoBench {
             int(options_.block_size) >> 10, options_.block_util * 100);
     fprintf(stderr, "Num MemTable Partitions: %d\n", 1 << options_.lg_parts);
     fprintf(stderr, "         Num Bg Threads: %d\n", num_threads_);
+    fprintf(stderr, "Num Compression Threads: %d\n",
+            num_compression_threads_);
     if (owns_env) {
       fprintf(stderr, "    Emulated Link Speed: %d MiB/s (per log)\n", mbps_);
     } else {
@@ -1162,6 +1890,9 @@ class PlfsIoBench {
     fprintf(stderr, "            Write Speed: %.3f MiB/s (observed by app)\n",
             1.0 * k * k * (options_.key_size + options_.value_size) * mfiles_ /
                 dura);
+    fprintf(stderr, "     Num Writer Threads: %d\n", num_writers_);
+    fprintf(stderr, "      Insert Throughput: %.3f Mops/s (excl. flush)\n",
+            1.0 * (mfiles_ << 20) / insert_dura);
     fprintf(stderr, "              Index Buf: %d MiB (x%d)\n",
             int(options_.index_buffer) >> 20, 1 << options_.lg_parts);
     fprintf(stderr, "     Min Index I/O Size: %d MiB\n",
@@ -1231,6 +1962,8 @@ class PlfsIoBench {
   int ordered_keys_;
   int mfiles_;        // Number of files to insert (in Millions)
   int num_threads_;   // Number of bg compaction threads
+  int num_writers_;   // Number of concurrent writer threads
+  int num_compression_threads_;  // Number of bg block compression threads
   int force_fifo_;    // Force real-time FIFO scheduling
   int print_events_;  // Dump background events
   EventPrinter printer_;
@@ -1424,8 +2157,24 @@ class PlfsQuBench : protected PlfsIoBench {
     mbps_ = 0;
 
     force_negative_lookups_ = GetOption("FALSE_KEYS", false);
+    options_.block_cache_size =
+        static_cast<size_t>(GetOption("BLOCK_CACHE", 0) << 20);
+    options_.index_cache_size =  // 0 to eagerly load index logs
+        static_cast<size_t>(GetOption("INDEX_CACHE", 0) << 20);
+    options_.index_page_size =
+        static_cast<size_t>(GetOption("INDEX_PAGE", 64) << 10);
+    traj_index_ = GetOption("TRAJ_INDEX", false);
+    scan_ = GetOption("SCAN", false);  // Also scan the entire dir
+    scan_threads_ = GetOption("SCAN_THREADS", 4);  // 0 for serial scans
+    scan_sorted_ = GetOption("SCAN_SORTED", false);
+    readahead_ = GetOption("READAHEAD", 0);  // In KB, 0 to disable
+    readahead_threads_ = GetOption("READAHEAD_THREADS", 1);
+    batch_size_ = GetOption("READ_BATCH", 1);  // Keys per MultiRead
+    num_readers_ = GetOption("READ_THREADS", 1);
     num_empty_reads_ = 0;
     num_reads_ = 0;
+    open_dura_ = 0;
+    open_index_memory_ = 0;
 
     options_.verify_checksums = false;
     options_.paranoid_checks = true;
@@ -1452,15 +2201,131 @@ class PlfsQuBench : protected PlfsIoBench {
     options_.allow_env_threads = false;
     options_.reader_pool = NULL;
     options_.env = env_;
-    Status s = DirReader::Open(options_, home_, &reader_);
+    uint64_t start = CurrentMicros();
+    Status s;
+    if (traj_index_) {
+      fprintf(stderr, "Building trajectory index...\n");
+      s = BuildTrajectoryIndex(options_, home_);
+      ASSERT_OK(s) << "Cannot build trajectory index";
+      fprintf(stderr, "Done! (%.3f s)\n", (CurrentMicros() - start) / 1e6);
+      start = CurrentMicros();
+    }
+    s = DirReader::Open(options_, home_, &reader_);
     ASSERT_OK(s) << "Cannot open dir";
+    // Partitions are opened on first use
+    std::string dummy_buf;
+    DirReader::ReadOp op;
+    s = reader_->Read(op, std::string(options_.key_size, 'x'), &dummy_buf);
+    ASSERT_OK(s) << "Cannot read";
+    open_dura_ = CurrentMicros() - start;
+    open_index_memory_ = reader_->TEST_iostats().index_memory;
     fprintf(stderr, "Reading dir...\n");
-    const uint64_t start = CurrentMicros();
+    start = CurrentMicros();
     const int num_files = (mfiles_ << 20);
+    if (num_readers_ > 1) {
+      s = ParallelQuery(num_files);
+    } else {
+      s = SerialQuery(num_files);
+    }
+    ASSERT_OK(s) << "Cannot read";
+    fprintf(stderr, "\r100.00%%\n");
+    fprintf(stderr, "Done!\n");
+
+    uint64_t dura = CurrentMicros() - start;
+
+    Report(dura);
+
+    delete reader_;
+    reader_ = NULL;
+
+    if (scan_) {
+      RunScan();
+    }
+  }
+
+  static int CountRecord(void* arg, const Slice& key, const Slice& value) {
+    ++*reinterpret_cast<uint64_t*>(arg);
+    return 0;
+  }
+
+  // Scan all epochs of all partitions and report the scan throughput.
+  void RunScan() {
+    ThreadPool* pool = NULL;
+    if (scan_threads_ > 0) {
+      pool = ThreadPool::NewFixed(scan_threads_, true);
+      options_.reader_pool = pool;
+      options_.parallel_reads = true;
+      options_.scan_parallelism = scan_threads_;
+    }
+    ThreadPool* readahead_pool = NULL;
+    if (readahead_ > 0) {
+      options_.readahead_size = static_cast<size_t>(readahead_) << 10;
+      if (readahead_threads_ > 0) {
+        readahead_pool = ThreadPool::NewFixed(readahead_threads_, true);
+        options_.readahead_pool = readahead_pool;
+      }
+    }
+    Status s = DirReader::Open(options_, home_, &reader_);
+    ASSERT_OK(s) << "Cannot open dir";
+    const IoStats open_stats = reader_->TEST_iostats();
+    fprintf(stderr, "Scanning dir...\n");
+    uint64_t num_records = 0;
+    DirReader::ScanOp op;
+    op.sorted = scan_sorted_;
+    const uint64_t start = CurrentMicros();
+    s = reader_->Scan(op, CountRecord, &num_records);
+    ASSERT_OK(s) << "Cannot scan";
+    const uint64_t dura = CurrentMicros() - start;
+    fprintf(stderr, "Done!\n");
+    const IoStats stats = reader_->TEST_iostats();
+    const uint64_t data_bytes = stats.data_bytes - open_stats.data_bytes;
+    const uint64_t data_ops = stats.data_ops - open_stats.data_ops;
+    const double k = 1000.0;
+    fprintf(stderr, "----------------------------------------\n");
+    fprintf(stderr, "         Scan Time: %.3f s\n", dura / k / k);
+    fprintf(stderr, "      Scan Threads: %d\n", scan_threads_);
+    fprintf(stderr, "       Sorted Scan: %s\n", scan_sorted_ ? "Yes" : "No");
+    fprintf(stderr, "   Read-ahead Size: %d KB (%d threads)\n", readahead_,
+            readahead_ > 0 ? readahead_threads_ : 0);
+    fprintf(stderr, "       Num Records: %llu\n",
+            static_cast<unsigned long long>(num_records));
+    fprintf(stderr, "   Scan Throughput: %.3f M records/s\n",
+            1.0 * num_records / dura);
+    const double mb = 1.0 * data_bytes / 1024 / 1024;
+    fprintf(stderr, "   Data Bytes Read: %.3f MB (%.3f MB/s)\n", mb,
+            mb / dura * k * k);
+    fprintf(stderr, "     Data Read Ops: %llu (%.3f KB per op)\n",
+            static_cast<unsigned long long>(data_ops),
+            data_ops != 0 ? 1.0 * data_bytes / data_ops / 1024 : 0.0);
+
+    delete reader_;
+    reader_ = NULL;
+    delete readahead_pool;
+    delete pool;
+  }
+
+  // Return the key to look up for a given file id. Negative lookups use a
+  // hash of the file id stored in *tmp, which must hold at least 16 bytes.
+  Slice QueryKey(const Slice& fid, char* tmp) const {
+    if (force_negative_lookups_) {
+      uint64_t h1 = xxhash64(fid.data(), fid.size(), 301);
+      memcpy(tmp + 8, &h1, 8);
+      uint64_t h2 = xxhash64(fid.data(), fid.size(), 103);
+      memcpy(tmp, &h2, 8);
+      return Slice(tmp, options_.key_size);
+    } else {
+      return fid;
+    }
+  }
+
+  // Look up all keys from the caller's thread.
+  Status SerialQuery(int num_files) {
+    Status s;
     BigBatch batch(options_, keys_, 0, num_files);
     batch.Seek(0);
     uint64_t accumulated_seeks = 0;
     std::string dummy_buf;
+    std::vector<std::string> keys;
     char tmp[20];
     memset(tmp, 0, sizeof(tmp));
     while (batch.Valid()) {
@@ -1470,13 +2335,17 @@ class PlfsQuBench : protected PlfsIoBench {
         fprintf(stderr, "\r%.2f%%", 100.0 * i / num_files);
       }
       dummy_buf.clear();
-      Slice k = batch.fid();
-      if (force_negative_lookups_) {
-        uint64_t h1 = xxhash64(k.data(), k.size(), 301);
-        memcpy(tmp + 8, &h1, 8);
-        uint64_t h2 = xxhash64(k.data(), k.size(), 103);
-        memcpy(tmp, &h2, 8);
-        k = Slice(tmp, options_.key_size);
+      Slice k = QueryKey(batch.fid(), tmp);
+      if (batch_size_ > 1) {
+        keys.push_back(k.ToString());
+        batch.Next();
+        if (keys.size() == size_t(batch_size_) || !batch.Valid()) {
+          s = MultiRead(&keys, &num_reads_, &num_empty_reads_);
+          if (!s.ok()) {
+            break;
+          }
+        }
+        continue;
       }
       DirReader::ReadOp op;
       s = reader_->Read(op, k, &dummy_buf);
@@ -1492,22 +2361,125 @@ class PlfsQuBench : protected PlfsIoBench {
       }
       batch.Next();
     }
-    ASSERT_OK(s) << "Cannot read";
-    fprintf(stderr, "\r100.00%%\n");
-    fprintf(stderr, "Done!\n");
+    return s;
+  }
 
-    uint64_t dura = CurrentMicros() - start;
+  // State shared by all concurrent reader threads.
+  struct QueryState {
+    QueryState() : cv(&mu), num_running(0) {}
+    port::Mutex mu;
+    port::CondVar cv;
+    int num_running;
+    Status status;
+  };
 
-    Report(dura);
+  // Each reader thread looks up a disjoint range of keys.
+  struct QueryTask {
+    PlfsQuBench* bench;
+    QueryState* state;
+    int base_offset;
+    int size;
+    uint64_t num_reads;
+    uint64_t num_empty_reads;
+  };
 
-    delete reader_;
-    reader_ = NULL;
+  static void QueryWork(void* arg) {
+    QueryTask* const t = reinterpret_cast<QueryTask*>(arg);
+    PlfsQuBench* const b = t->bench;
+    BigBatch batch(b->options_, b->keys_, t->base_offset, t->size);
+    batch.Seek(0);
+    std::string dummy_buf;
+    std::vector<std::string> keys;
+    char tmp[20];
+    memset(tmp, 0, sizeof(tmp));
+    Status s;
+    while (batch.Valid()) {
+      Slice k = b->QueryKey(batch.fid(), tmp);
+      if (b->batch_size_ > 1) {
+        keys.push_back(k.ToString());
+        batch.Next();
+        if (keys.size() == size_t(b->batch_size_) || !batch.Valid()) {
+          s = b->MultiRead(&keys, &t->num_reads, &t->num_empty_reads);
+          if (!s.ok()) {
+            break;
+          }
+        }
+        continue;
+      }
+      dummy_buf.clear();
+      DirReader::ReadOp op;
+      s = b->reader_->Read(op, k, &dummy_buf);
+      if (!s.ok()) {
+        break;
+      }
+      t->num_reads++;
+      if (dummy_buf.empty()) {
+        t->num_empty_reads++;
+      }
+      batch.Next();
+    }
+    MutexLock ml(&t->state->mu);
+    if (t->state->status.ok()) t->state->status = s;
+    assert(t->state->num_running > 0);
+    t->state->num_running--;
+    t->state->cv.SignalAll();
+  }
+
+  // Look up keys using num_readers_ threads sharing a single reader and wait
+  // for all of them to finish. Per-read seek stats are not collected.
+  Status ParallelQuery(int num_files) {
+    QueryState state;
+    std::vector<QueryTask> tasks(static_cast<size_t>(num_readers_));
+    state.num_running = num_readers_;
+    for (int i = 0; i < num_readers_; i++) {
+      const int64_t n = num_files;
+      tasks[i].bench = this;
+      tasks[i].state = &state;
+      tasks[i].base_offset = static_cast<int>(n * i / num_readers_);
+      tasks[i].size =
+          static_cast<int>(n * (i + 1) / num_readers_) - tasks[i].base_offset;
+      tasks[i].num_reads = 0;
+      tasks[i].num_empty_reads = 0;
+      Env::Default()->StartThread(QueryWork, &tasks[i]);
+    }
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+    for (int i = 0; i < num_readers_; i++) {
+      num_reads_ += tasks[i].num_reads;
+      num_empty_reads_ += tasks[i].num_empty_reads;
+    }
+    return state.status;
+  }
+
+  // Read a batch of keys using a single MultiRead and clear the batch.
+  Status MultiRead(std::vector<std::string>* keys, uint64_t* num_reads,
+                   uint64_t* num_empty_reads) {
+    std::vector<Slice> fids(keys->begin(), keys->end());
+    std::vector<std::string> results;
+    DirReader::ReadOp op;
+    Status s = reader_->MultiRead(op, fids, &results);
+    if (s.ok()) {
+      for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].empty()) {
+          ++*num_empty_reads;
+        }
+      }
+      *num_reads += results.size();
+    }
+    keys->clear();
+    return s;
   }
 
   void Report(uint64_t dura) {
     const double k = 1000.0, ki = 1024.0;
     fprintf(stderr, "----------------------------------------\n");
     fprintf(stderr, "             Total Time: %.3f s\n", dura / k / k);
+    fprintf(stderr, "        Keys Per Lookup: %d\n", batch_size_);
+    fprintf(stderr, "         Reader Threads: %d\n", num_readers_);
+    fprintf(stderr, "                    QPS: %.3f K\n",
+            1.0 * num_reads_ / (dura / k / k) / k);
     fprintf(stderr, "          Avg Read Time: %.3f us\n",
             1.0 * dura / (mfiles_ << 20));
     fprintf(stderr, "              Num Reads: %.2f M\n", num_reads_ / ki / ki);
@@ -1531,9 +2503,31 @@ class PlfsQuBench : protected PlfsIoBench {
             1.0 * stats.data_bytes / ki / ki / ki);
     fprintf(stderr, "           Avg I/O size: %.3f KB\n",
             1.0 * stats.data_bytes / stats.data_ops / ki);
-  }
+    const uint64_t lookups = stats.cache_hits + stats.cache_misses;
+    fprintf(stderr, "    Block Cache Hit Rate: %.2f%% (%llu lookups)\n",
+            lookups != 0 ? 100.0 * stats.cache_hits / lookups : 0.0,
+            static_cast<unsigned long long>(lookups));
+    fprintf(stderr, "             Index Mode: %s\n",
+            options_.index_cache_size != 0 ? "Lazy" : "Eager");
+    fprintf(stderr, "          Dir Open Time: %.3f ms\n", open_dura_ / k);
+    fprintf(stderr, "  Index Memory (opened): %.3f MB\n",
+            1.0 * open_index_memory_ / ki / ki);
+    fprintf(stderr, "    Index Memory (done): %.3f MB\n",
+            1.0 * stats.index_memory / ki / ki);
+  }
+
+  uint64_t open_dura_;
+  uint64_t open_index_memory_;
 
   int force_negative_lookups_;
+  int traj_index_;  // Build and use a trajectory index
+  int scan_;
+  int scan_threads_;
+  int scan_sorted_;
+  int readahead_;
+  int readahead_threads_;
+  int batch_size_;
+  int num_readers_;
   DirReader* reader_;
 
   uint64_t num_empty_reads_;
@@ -1541,6 +2535,221 @@ class PlfsQuBench : protected PlfsIoBench {
   Histo seeks_;
 };
 
+// Compare memtable sort methods over increasingly large write buffers.
+class PlfsSortBench {
+ public:
+  PlfsSortBench() {
+    max_mentries_ = PlfsIoBench::GetOption("SORT_MAX_ENTRIES", 16);
+    num_threads_ = PlfsIoBench::GetOption("NUM_THREADS", 4);
+    options_.key_size =
+        static_cast<size_t>(PlfsIoBench::GetOption("KEY_SIZE", 8));
+    options_.value_size =
+        static_cast<size_t>(PlfsIoBench::GetOption("VALUE_SIZE", 8));
+  }
+
+  void LogAndApply() {
+    ThreadPool* const pool = ThreadPool::NewFixed(num_threads_, true);
+    fprintf(stderr, "Sort helpers: %d\n", num_threads_);
+    fprintf(stderr, "%10s %14s %14s %14s\n", "Entries", "std::sort", "Radix",
+            "Radix+Helpers");
+    for (int m = 1; m <= max_mentries_; m *= 2) {
+      const uint32_t n = static_cast<uint32_t>(m) << 20;
+      DirOptions options = options_;
+      options.radix_sort = false;
+      const uint64_t t1 = RunSort(options, n);
+      options.radix_sort = true;
+      const uint64_t t2 = RunSort(options, n);
+      options.compaction_pool = pool;
+      options.sort_helpers = num_threads_;
+      const uint64_t t3 = RunSort(options, n);
+      fprintf(stderr, "%9dM %11.3f ms %11.3f ms %11.3f ms\n", m, t1 / 1000.0,
+              t2 / 1000.0, t3 / 1000.0);
+    }
+    delete pool;
+  }
+
+ private:
+  // Fill a write buffer with n random keys and return the
+  // time in microseconds spent sorting them.
+  uint64_t RunSort(const DirOptions& options, uint32_t n) {
+    WriteBuffer buf(options);
+    buf.Reserve(n * (options.key_size + options.value_size + 2));
+    const std::string value(options.value_size, 'x');
+    char key[20];
+    memset(key, 0, sizeof(key));
+    ASSERT_TRUE(options.key_size <= sizeof(key));
+    for (uint32_t i = 0; i < n; i++) {
+      const uint64_t h = xxhash64(&i, sizeof(i), 0);
+      memcpy(key, &h, 8);
+      buf.Add(Slice(key, options.key_size), value);
+    }
+    const uint64_t start = CurrentMicros();
+    buf.Finish();
+    return CurrentMicros() - start;
+  }
+
+  int max_mentries_;  // Max num of entries to sort (in Millions)
+  int num_threads_;
+  DirOptions options_;
+};
+
+// Compare block compression types over data blocks filled with synthetic
+// VPIC particle records. Each record is keyed by an 8-byte particle id and
+// stores 3 float in-cell offsets, a 4-byte cell index, 3 float momentums,
+// and a float weight. Compression types not compiled in are skipped.
+class PlfsCompressionBench {
+ public:
+  PlfsCompressionBench() : rnd_(301) {
+    total_mb_ = PlfsIoBench::GetOption("COMPRESS_MB", 64);
+    block_size_ =
+        static_cast<size_t>(PlfsIoBench::GetOption("BLOCK_SIZE", 32) << 10);
+    level_ = PlfsIoBench::GetOption("COMPRESS_LEVEL", 0);
+  }
+
+  void LogAndApply() {
+    std::vector<std::string> blocks;
+    MakeBlocks(&blocks);
+    fprintf(stderr, "%d MB of VPIC records in %d KB blocks (level=%d)\n",
+            total_mb_, int(block_size_ >> 10), level_);
+    fprintf(stderr, "%8s %10s %14s %14s\n", "Type", "Ratio", "Compress",
+            "Uncompress");
+    Run(kSnappyCompression, "snappy", blocks);
+    Run(kLz4Compression, "lz4", blocks);
+    Run(kZstdCompression, "zstd", blocks);
+  }
+
+ private:
+  float NextFloat(float min, float max) {
+    return min + (max - min) * (rnd_.Next() / 2147483647.0f);
+  }
+
+  // Approximate a normal distribution by summing uniform variables.
+  float NextMomentum() {
+    float sum = 0;
+    for (int i = 0; i < 4; i++) sum += NextFloat(-0.1f, 0.1f);
+    return sum;
+  }
+
+  void MakeBlocks(std::vector<std::string>* blocks) {
+    const size_t total = static_cast<size_t>(total_mb_) << 20;
+    const size_t record_size = 8 + 32;
+    const size_t per_block = block_size_ / (record_size + 3);
+    BlockBuilder builder(16);
+    std::vector<uint64_t> ids(per_block);
+    std::string key, value;
+    size_t bytes = 0;
+    int32_t cell = 0;
+    while (bytes < total) {
+      for (size_t i = 0; i < per_block; i++) ids[i] = rnd_.Next64();
+      std::sort(ids.begin(), ids.end());  // Blocks are sorted by key
+      builder.Reset();
+      for (size_t i = 0; i < per_block; i++) {
+        key.clear();
+        PutFixed64(&key, 0);
+        EncodeBigEndian(&key[0], ids[i]);
+        value.clear();
+        float f[8];
+        f[0] = NextFloat(-1, 1);  // dx
+        f[1] = NextFloat(-1, 1);  // dy
+        f[2] = NextFloat(-1, 1);  // dz
+        if (rnd_.OneIn(4)) cell++;
+        memcpy(&f[3], &cell, 4);  // Cell index
+        f[4] = NextMomentum();    // ux
+        f[5] = NextMomentum();    // uy
+        f[6] = NextMomentum();    // uz
+        f[7] = 0.125f;            // Weight
+        value.append(reinterpret_cast<char*>(f), sizeof(f));
+        builder.Add(key, value);
+      }
+      Slice contents = builder.Finish();
+      blocks->push_back(contents.ToString());
+      bytes += contents.size();
+    }
+  }
+
+  static void EncodeBigEndian(char* dst, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+      dst[i] = static_cast<char>(v & 0xff);
+      v >>= 8;
+    }
+  }
+
+  bool Compress(CompressionType type, const Slice& input, std::string* output) {
+    switch (type) {
+      case kSnappyCompression:
+        return port::Snappy_Compress(input.data(), input.size(), output);
+      case kLz4Compression:
+        return port::Lz4_Compress(input.data(), input.size(), output);
+      case kZstdCompression:
+        return port::Zstd_Compress(level_, NULL, 0, input.data(),
+                                   input.size(), output);
+      default:
+        return false;
+    }
+  }
+
+  static bool Uncompress(CompressionType type, const Slice& input,
+                         std::string* output) {
+    size_t n = 0;
+    switch (type) {
+      case kSnappyCompression:
+        if (!port::Snappy_GetUncompressedLength(input.data(), input.size(),
+                                                &n))
+          return false;
+        output->resize(n);
+        return port::Snappy_Uncompress(input.data(), input.size(),
+                                       &(*output)[0]);
+      case kLz4Compression:
+        if (!port::Lz4_GetUncompressedLength(input.data(), input.size(), &n))
+          return false;
+        output->resize(n);
+        return port::Lz4_Uncompress(input.data(), input.size(), &(*output)[0]);
+      case kZstdCompression:
+        if (!port::Zstd_GetUncompressedLength(input.data(), input.size(), &n))
+          return false;
+        output->resize(n);
+        return port::Zstd_Uncompress(NULL, 0, input.data(), input.size(),
+                                     &(*output)[0]);
+      default:
+        return false;
+    }
+  }
+
+  void Run(CompressionType type, const char* name,
+           const std::vector<std::string>& blocks) {
+    std::vector<std::string> compressed(blocks.size());
+    uint64_t raw_bytes = 0;
+    uint64_t compressed_bytes = 0;
+    uint64_t start = CurrentMicros();
+    for (size_t i = 0; i < blocks.size(); i++) {
+      if (!Compress(type, blocks[i], &compressed[i])) {
+        fprintf(stderr, "%8s %10s\n", name, "n/a");
+        return;
+      }
+      raw_bytes += blocks[i].size();
+      compressed_bytes += compressed[i].size();
+    }
+    const uint64_t compress_micros = CurrentMicros() - start;
+    std::string output;
+    start = CurrentMicros();
+    for (size_t i = 0; i < blocks.size(); i++) {
+      ASSERT_TRUE(Uncompress(type, compressed[i], &output));
+      ASSERT_TRUE(output == blocks[i]);
+    }
+    const uint64_t uncompress_micros = CurrentMicros() - start;
+    const double mb = 1.0 * raw_bytes / 1024.0 / 1024.0;
+    fprintf(stderr, "%8s %9.3fx %9.1f MB/s %9.1f MB/s\n", name,
+            1.0 * raw_bytes / compressed_bytes,
+            mb / (compress_micros / 1000.0 / 1000.0),
+            mb / (uncompress_micros / 1000.0 / 1000.0));
+  }
+
+  Random rnd_;
+  int total_mb_;  // Total amount of raw block contents (in MB)
+  size_t block_size_;
+  int level_;
+};
+
 }  // namespace plfsio
 }  // namespace pdlfs
 
@@ -1552,11 +2761,14 @@ class PlfsQuBench : protected PlfsIoBench {
 #endif
 
 static void BM_Usage() {
-  fprintf(stderr, "Use --bench=io or --bench=qu to select a benchmark.\n");
+  fprintf(stderr,
+          "Use --bench=io, --bench=qu, --bench=sort, or --bench=compress to "
+          "select a benchmark.\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "== workload confs\n");
   fprintf(stderr, "LINK_SPEED\n");
   fprintf(stderr, "NUM_FILES\n");
+  fprintf(stderr, "NUM_WRITERS\n");
   fprintf(stderr, "UNORDERED_MODE\n");
   fprintf(stderr, "PREPARE_KEYS\n");
   fprintf(stderr, "ORDERED_KEYS\n");
@@ -1572,6 +2784,7 @@ static void BM_Usage() {
   fprintf(stderr, "MIN_INDEX_BUFFER\n");
   fprintf(stderr, "INDEX_BUFFER\n");
   fprintf(stderr, "NUM_THREADS\n");
+  fprintf(stderr, "COMPRESSION_THREADS\n");
   fprintf(stderr, "MEMTABLE_SIZE\n");
   fprintf(stderr, "BLOCK_BATCH_SIZE\n");
   fprintf(stderr, "BLOCK_SIZE\n");
@@ -1580,14 +2793,29 @@ static void BM_Usage() {
   fprintf(stderr, "SNAPPY\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "== plfsdir filter options\n");
-  fprintf(stderr, "FT_TYPE (bf, bmp, r, fvbp, fpfd)\n");
+  fprintf(stderr, "FT_TYPE (bf, cf, bmp, r, fvbp, fpfd)\n");
   fprintf(stderr, "FT_BITS\n");
   fprintf(stderr, "BM_KEY_BITS\n");
   fprintf(stderr, "BF_BITS\n");
+  fprintf(stderr, "EPOCH_FILTER\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "== adv. options\n");
   fprintf(stderr, "FORCE_FIFO\n");
   fprintf(stderr, "FALSE_KEYS\n");
+  fprintf(stderr, "BLOCK_CACHE\n");
+  fprintf(stderr, "INDEX_CACHE\n");
+  fprintf(stderr, "INDEX_PAGE\n");
+  fprintf(stderr, "TRAJ_INDEX\n");
+  fprintf(stderr, "SCAN\n");
+  fprintf(stderr, "SCAN_THREADS\n");
+  fprintf(stderr, "SCAN_SORTED\n");
+  fprintf(stderr, "READAHEAD\n");
+  fprintf(stderr, "READAHEAD_THREADS\n");
+  fprintf(stderr, "READ_BATCH\n");
+  fprintf(stderr, "READ_THREADS\n");
+  fprintf(stderr, "SORT_MAX_ENTRIES\n");
+  fprintf(stderr, "COMPRESS_MB\n");
+  fprintf(stderr, "COMPRESS_LEVEL\n");
   fprintf(stderr, "\n");
 }
 
@@ -1598,6 +2826,12 @@ static void BM_LogAndApply(const char* bm) {
   } else if (strcmp(bm, "qu") == 0) {
     pdlfs::plfsio::PlfsQuBench bench;
     bench.LogAndApply();
+  } else if (strcmp(bm, "sort") == 0) {
+    pdlfs::plfsio::PlfsSortBench bench;
+    bench.LogAndApply();
+  } else if (strcmp(bm, "compress") == 0) {
+    pdlfs::plfsio::PlfsCompressionBench bench;
+    bench.LogAndApply();
   } else {
     BM_Usage();
   }